@@ -0,0 +1,81 @@
+/*
+ * Copyright 2012 BrewPi/Elco Jacobs.
+ *
+ * This file is part of BrewPi.
+ *
+ * BrewPi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BrewPi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BrewPi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <Arduino.h>
+#include <limits.h>
+
+#include "BeerEstimator.h"
+#include "temperatureFormats.h"
+
+void BeerEstimator::init(void){
+	initialized = false;
+}
+
+void BeerEstimator::update(fixed7_9 beerTemp, fixed7_9 fridgeTemp, bool actuatorActive){
+	fixed7_25 measurement = ((fixed7_25) beerTemp)<<16;
+	fixed7_25 diff = (((fixed7_25) fridgeTemp)<<16) - measurement;
+
+	if(!initialized){
+		temp = measurement;
+		slope = 0;
+		prevDiff = diff;
+		pTT = BEER_ESTIMATOR_P_TEMP;
+		pTr = 0;
+		pRr = BEER_ESTIMATOR_P_SLOPE;
+		initialized = true;
+		return;
+	}
+
+	// predict
+	temp += slope / 3600;
+	diff = diff + measurement - temp; // use estimated beer temperature for the difference
+	slope += ((int64_t) BEER_ESTIMATOR_COUPLING * (diff - prevDiff))>>9;
+	prevDiff = diff;
+
+	// P = F*P*F' + Q, with F = [1 1/3600; 0 1]
+	pTT += (2 * pTr + pRr / 3600) / 3600 + BEER_ESTIMATOR_Q_TEMP;
+	pTr += pRr / 3600;
+	if(actuatorActive){
+		pRr += BEER_ESTIMATOR_Q_SLOPE << BEER_ESTIMATOR_Q_SLOPE_ACTIVE_SHIFT;
+	}
+	else{
+		pRr += BEER_ESTIMATOR_Q_SLOPE;
+	}
+
+	// correct with beer measurement
+	fixed7_25 s = pTT + BEER_ESTIMATOR_R;
+	fixed7_25 kT = ((int64_t) pTT << 25) / s; // Kalman gain for temperature
+	fixed7_25 kR = ((int64_t) pTr << 25) / s; // Kalman gain for slope
+	fixed7_25 innovation = measurement - temp;
+	temp += ((int64_t) kT * innovation)>>25;
+	slope += ((int64_t) kR * innovation)>>25;
+
+	// P = (I - K*H)*P
+	pRr -= ((int64_t) kR * pTr)>>25;
+	pTT -= ((int64_t) kT * pTT)>>25;
+	pTr -= ((int64_t) kT * pTr)>>25;
+}
+
+fixed7_9 BeerEstimator::readTemp(void){
+	return temp>>16;
+}
+
+fixed7_9 BeerEstimator::readSlope(void){
+	return slope>>16;
+}
\ No newline at end of file
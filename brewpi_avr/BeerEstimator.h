@@ -0,0 +1,74 @@
+/*
+ * Copyright 2012 BrewPi/Elco Jacobs.
+ *
+ * This file is part of BrewPi.
+ *
+ * BrewPi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BrewPi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BrewPi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BEERESTIMATOR_H_
+#define BEERESTIMATOR_H_
+
+/* This class implements a Kalman filter that tracks the beer temperature and its slope.
+
+ State: beer temperature T (deg) and slope r (deg/hour). One step is one sample, which is one second.
+	T(k+1) = T(k) + r(k)/3600
+	r(k+1) = r(k) + c * (d(k) - d(k-1)) + w		with d = Tfridge - Tbeer
+ The beer is heated or cooled by the fridge air: r = c*(Tfridge - Tbeer) + fermentation heat.
+ A change in the fridge - beer difference changes the slope immediately, so the slope follows the fridge
+ instead of waiting for the beer temperature to show a trend. The fermentation heat is a random walk (w).
+ When the heater or compressor is running, the slope can change faster, so the process noise is increased.
+
+ Only the beer temperature is measured. Values and covariance are stored as fixed7_25.
+ Products are calculated with 64 bits, the filter runs once per second.
+*/
+
+#include "temperatureFormats.h"
+
+#define BEER_ESTIMATOR_COUPLING 77				// c, 0.15 per hour in fixed7_9. Time constant of the beer is ~7 hours
+#define BEER_ESTIMATOR_R 33554L					// measurement variance, 0.001 deg^2 in fixed7_25
+#define BEER_ESTIMATOR_Q_TEMP 34L				// process variance of temperature, 1e-6 deg^2 in fixed7_25
+#define BEER_ESTIMATOR_Q_SLOPE 839L				// process variance of slope, 2.5e-5 (deg/h)^2 in fixed7_25
+#define BEER_ESTIMATOR_Q_SLOPE_ACTIVE_SHIFT 2	// process variance of slope is 4x higher when heating or cooling
+#define BEER_ESTIMATOR_P_TEMP (1L<<22)			// initial variance of temperature, 0.125 deg^2
+#define BEER_ESTIMATOR_P_SLOPE (4L<<25)			// initial variance of slope, 4 (deg/h)^2
+
+class BeerEstimator{
+	public:
+	BeerEstimator(){
+		initialized = false;
+	};
+	~BeerEstimator(){};
+
+	void init(void); // start again from the next measurement
+	// add a new measurement. actuatorActive should be true when the heater or compressor is on.
+	void update(fixed7_9 beerTemp, fixed7_9 fridgeTemp, bool actuatorActive);
+	bool isInitialized(void){
+		return initialized;
+	};
+
+	fixed7_9 readTemp(void); // estimated beer temperature
+	fixed7_9 readSlope(void); // estimated slope in deg/hour
+
+	private:
+	bool initialized;
+	fixed7_25 temp; // deg
+	fixed7_25 slope; // deg/hour
+	fixed7_25 prevDiff; // fridge - beer difference of last step
+	fixed7_25 pTT; // covariance matrix [pTT pTr; pTr pRr]
+	fixed7_25 pTr;
+	fixed7_25 pRr;
+};
+
+#endif /* BEERESTIMATOR_H_ */
\ No newline at end of file
@@ -86,15 +86,16 @@ bool DallasTemperature::isConnected(uint8_t* deviceAddress)
 // also allows for updating the read scratchpad
 bool DallasTemperature::isConnected(uint8_t* deviceAddress, uint8_t* scratchPad)
 {
-  readScratchPad(deviceAddress, scratchPad);
+  if (!readScratchPad(deviceAddress, scratchPad)) return false;
   return (_wire->crc8(scratchPad, 8) == scratchPad[SCRATCHPAD_CRC]);
 }
 
 // read device's scratch pad
-void DallasTemperature::readScratchPad(uint8_t* deviceAddress, uint8_t* scratchPad)
+// returns false when no device answered the reset pulse, the scratchpad is not read then (Elco, BrewPi)
+bool DallasTemperature::readScratchPad(uint8_t* deviceAddress, uint8_t* scratchPad)
 {
   // send the command
-  _wire->reset();
+  if (!_wire->reset()) return false;
   _wire->select(deviceAddress);
   _wire->write(READSCRATCH);
 
@@ -156,10 +157,11 @@ void DallasTemperature::readScratchPad(uint8_t* deviceAddress, uint8_t* scratchP
   scratchPad[SCRATCHPAD_CRC] = _wire->read();
 
   _wire->reset();
+  return true;
 }
 
 // writes device's scratch pad
-void DallasTemperature::writeScratchPad(uint8_t* deviceAddress, const uint8_t* scratchPad)
+void DallasTemperature::writeScratchPad(uint8_t* deviceAddress, const uint8_t* scratchPad, bool copyToEeprom)
 {
   _wire->reset();
   _wire->select(deviceAddress);
@@ -169,6 +171,7 @@ void DallasTemperature::writeScratchPad(uint8_t* deviceAddress, const uint8_t* s
   // DS18S20 does not use the configuration register
   if (deviceAddress[0] != DS18S20MODEL) _wire->write(scratchPad[CONFIGURATION]); // configuration
   _wire->reset();
+  if (!copyToEeprom) return;
   // save the newly written values to eeprom
   _wire->write(COPYSCRATCH, parasite);
   if (parasite) delay(10); // 10ms delay
@@ -212,7 +215,7 @@ void DallasTemperature::setResolution(uint8_t newResolution)
 
 // set resolution of a device to 9, 10, 11, or 12 bits
 // if new resolution is out of range, 9 bits is used. 
-bool DallasTemperature::setResolution(uint8_t* deviceAddress, uint8_t newResolution)
+bool DallasTemperature::setResolution(uint8_t* deviceAddress, uint8_t newResolution, bool copyToEeprom)
 {
   ScratchPad scratchPad;
   if (isConnected(deviceAddress, scratchPad))
@@ -236,7 +239,7 @@ bool DallasTemperature::setResolution(uint8_t* deviceAddress, uint8_t newResolut
           scratchPad[CONFIGURATION] = TEMP_9_BIT;
           break;
       }
-      writeScratchPad(deviceAddress, scratchPad);
+      writeScratchPad(deviceAddress, scratchPad, copyToEeprom);
     }
 	return true;  // new value set
   }
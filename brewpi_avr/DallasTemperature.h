@@ -82,11 +82,12 @@ class DallasTemperature
   // also allows for updating the read scratchpad
   bool isConnected(uint8_t*, uint8_t*);
 
-  // read device's scratchpad
-  void readScratchPad(uint8_t*, uint8_t*);
+  // read device's scratchpad, returns false when no device answered the reset pulse
+  bool readScratchPad(uint8_t*, uint8_t*);
 
-  // write device's scratchpad
-  void writeScratchPad(uint8_t*, const uint8_t*);
+  // write device's scratchpad. When copyToEeprom is false, the values are lost at power down,
+  // but the EEPROM of the device is not worn out by frequent changes (Elco, BrewPi)
+  void writeScratchPad(uint8_t*, const uint8_t*, bool copyToEeprom = true);
 
   // read device's power requirements
   bool readPowerSupply(uint8_t*);
@@ -101,7 +102,7 @@ class DallasTemperature
   uint8_t getResolution(uint8_t*);
 
   // set resolution of a device to 9, 10, 11, or 12 bits
-  bool setResolution(uint8_t*, uint8_t);
+  bool setResolution(uint8_t*, uint8_t, bool copyToEeprom = true);
   
   // sets/gets the waitForConversion flag
   void setWaitForConversion(bool);
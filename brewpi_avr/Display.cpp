@@ -89,7 +89,7 @@ void Display::printFridgeSet(void){
 void Display::printTemperature(fixed7_9 temp){
 	char tempString[9];
 	tempToString(tempString, temp, 1 , 9);
-	for(int i = 0; i<(5-strlen(tempString));i++){
+	for(int i = 0; i<(5-(int) strlen(tempString));i++){
 		lcd.write(' ');
 	}
 	lcd.print(tempString);
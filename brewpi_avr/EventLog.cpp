@@ -0,0 +1,74 @@
+/*
+ * Copyright 2012 BrewPi/Elco Jacobs.
+ *
+ * This file is part of BrewPi.
+ *
+ * BrewPi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BrewPi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BrewPi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <Arduino.h>
+
+#include "EventLog.h"
+#include "Ticks.h"
+
+EventLog eventLog;
+
+Event EventLog::events[EVENT_LOG_SIZE];
+uint8_t EventLog::oldest;
+uint8_t EventLog::numEvents;
+uint16_t EventLog::sequence;
+uint16_t EventLog::lostEvents;
+
+// returns a free slot in the ring buffer, overwriting the oldest event when the buffer is full
+Event * EventLog::addEvent(uint8_t code, uint8_t numArgs){
+	if(numEvents == EVENT_LOG_SIZE){
+		oldest = (oldest + 1) % EVENT_LOG_SIZE;
+		numEvents--;
+		lostEvents++;
+	}
+	Event * event = &events[(oldest + numEvents) % EVENT_LOG_SIZE];
+	numEvents++;
+	sequence++;
+	event->time = ticks.millis64();
+	event->code = code;
+	event->numArgs = numArgs;
+	return event;
+}
+
+void EventLog::add(uint8_t code){
+	addEvent(code, 0);
+}
+
+void EventLog::add(uint8_t code, fixed7_9 arg0){
+	Event * event = addEvent(code, 1);
+	event->args[0] = arg0;
+}
+
+void EventLog::add(uint8_t code, fixed7_9 arg0, fixed7_9 arg1, fixed7_9 arg2, fixed7_9 arg3){
+	Event * event = addEvent(code, 4);
+	event->args[0] = arg0;
+	event->args[1] = arg1;
+	event->args[2] = arg2;
+	event->args[3] = arg3;
+}
+
+const Event & EventLog::peek(uint8_t index){
+	return events[(oldest + index) % EVENT_LOG_SIZE];
+}
+
+void EventLog::clear(void){
+	oldest = 0;
+	numEvents = 0;
+	lostEvents = 0;
+}
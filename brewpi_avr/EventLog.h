@@ -0,0 +1,107 @@
+/*
+ * Copyright 2012 BrewPi/Elco Jacobs.
+ *
+ * This file is part of BrewPi.
+ *
+ * BrewPi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BrewPi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BrewPi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef EVENTLOG_H_
+#define EVENTLOG_H_
+
+#include <inttypes.h>
+#include "temperatureFormats.h"
+#include "Ticks.h"
+
+/* Log of events with a numeric code instead of an English sentence. The host renders the text.
+ An event is the code, the uptime in milliseconds and up to 4 fixed7_9 arguments.
+ The uptime is sent as Unix time, converted with the clock received from the host (see Ticks.h).
+ Events are buffered in RAM until the host requests them with 'g', so events raised while the link is down are not lost.
+ When the buffer is full, the oldest event is dropped and counted as lost.
+ Every event gets a sequence number, the host can use it to detect events it missed.
+
+ The codes are part of the protocol: never renumber them, only add new ones at the end.
+ The arguments of each code are listed below. Temperatures are in Celsius (fixed7_9), independent of tempFormat.
+*/
+
+enum{
+	EVENT_NONE,
+	EVENT_RESTARTED,						// no arguments
+	EVENT_DOOR_OPENED,						// no arguments
+	EVENT_DOOR_CLOSED,						// no arguments
+	EVENT_MODE_CHANGED_WEB,					// mode character
+	EVENT_MODE_CHANGED_MENU,				// mode character
+	EVENT_BEER_SETTING_CHANGED_WEB,			// new setting (temperature)
+	EVENT_BEER_SETTING_CHANGED_PROFILE,		// new setting (temperature)
+	EVENT_BEER_SETTING_CHANGED_MENU,		// new setting (temperature)
+	EVENT_FRIDGE_SETTING_CHANGED_WEB,		// new setting (temperature)
+	EVENT_FRIDGE_SETTING_CHANGED_MENU,		// new setting (temperature)
+	EVENT_POS_PEAK_DETECTED,				// peak (temperature)
+	EVENT_POS_DRIFT_DETECTED,				// temperature used as peak, drifting up after heating too short
+	EVENT_NEG_PEAK_DETECTED,				// peak (temperature)
+	EVENT_NEG_DRIFT_DETECTED,				// temperature used as peak, drifting down after cooling too short
+	EVENT_HEAT_ESTIMATOR_UPDATED,			// peak, estimated peak (temperatures), new estimator, new lag (fixed point)
+	EVENT_COOL_ESTIMATOR_UPDATED,			// peak, estimated peak (temperatures), new estimator, new lag (fixed point)
+	EVENT_SENSOR_NOT_FOUND,					// pin number
+	EVENT_SENSOR_DISCONNECTED,				// pin number
+	EVENT_SENSOR_RECONNECTED,				// pin number
+	NUM_EVENTS
+};
+
+#define EVENT_MAX_ARGS 4
+
+#ifndef EVENT_LOG_SIZE
+#define EVENT_LOG_SIZE 12 // events buffered until the host requests them, 18 bytes each
+#endif
+
+struct Event{
+	uptime_t time; // uptime in milliseconds when the event was raised
+	uint8_t code;
+	uint8_t numArgs;
+	fixed7_9 args[EVENT_MAX_ARGS];
+};
+
+class EventLog{
+	public:
+	EventLog(){};
+	~EventLog(){};
+
+	static void add(uint8_t code);
+	static void add(uint8_t code, fixed7_9 arg0);
+	static void add(uint8_t code, fixed7_9 arg0, fixed7_9 arg1, fixed7_9 arg2, fixed7_9 arg3);
+
+	static uint8_t count(void){ // number of buffered events
+		return numEvents;
+	};
+	static const Event & peek(uint8_t index); // index 0 is the oldest buffered event
+	static uint16_t firstSequence(void){ // sequence number of the oldest buffered event
+		return sequence - numEvents;
+	};
+	static uint16_t lost(void){ // events dropped because the buffer was full, since the last clear()
+		return lostEvents;
+	};
+	static void clear(void); // remove all buffered events after they have been sent
+
+	private:
+	static Event * addEvent(uint8_t code, uint8_t numArgs);
+	static Event events[EVENT_LOG_SIZE];
+	static uint8_t oldest; // position of the oldest event in the ring buffer
+	static uint8_t numEvents;
+	static uint16_t sequence; // sequence number of the next event
+	static uint16_t lostEvents;
+};
+
+extern EventLog eventLog;
+
+#endif /* EVENTLOG_H_ */
@@ -0,0 +1,125 @@
+/*
+ * Copyright 2012 BrewPi/Elco Jacobs.
+ *
+ * This file is part of BrewPi.
+ *
+ * BrewPi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BrewPi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BrewPi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <limits.h>
+
+#include "FilterBank.h"
+#include "FixedPoint.h"
+#include "FixedFilter.h"
+
+fixed7_25 FilterBank::xv[3][FILTER_BANK_CHANNELS];
+fixed7_25 FilterBank::yv[3][FILTER_BANK_CHANNELS];
+fixed7_25 FilterBank::input[FILTER_BANK_CHANNELS];
+bool FilterBank::hasInput[FILTER_BANK_CHANNELS];
+uint8_t FilterBank::a[FILTER_BANK_CHANNELS];
+uint8_t FilterBank::b[FILTER_BANK_CHANNELS];
+uint8_t FilterBank::newest[FILTER_BANK_CHANNELS];
+uint8_t FilterBank::numChannels;
+
+uint8_t FilterBank::addChannel(void){
+	uint8_t channel = numChannels++; // FILTER_BANK_CHANNELS is checked at compile time by the user
+	setCoefficients(channel, SETTLING_TIME_50_SAMPLES); // same default as FixedFilter
+	return channel;
+}
+
+void FilterBank::init(uint8_t channel, fixed7_9 val){
+	fixed7_25 doublePrecision = FixedPoint7_9::fromRaw(val).convert<7, 25>().raw; // 16 extra bits are used in the filter for the fraction part
+	input[channel] = doublePrecision;
+	hasInput[channel] = false;
+	newest[channel] = 0;
+	for(uint8_t tap = 0; tap < 3; tap++){
+		xv[tap][channel] = doublePrecision;
+		yv[tap][channel] = doublePrecision;
+	}
+}
+
+void FilterBank::setCoefficients(uint8_t channel, uint16_t ab){
+	a[channel] = (ab & 0xFF00)>>8;
+	b[channel] = ab & 0x00FF;
+}
+
+void FilterBank::setInput(uint8_t channel, fixed7_9 val){
+	input[channel] = FixedPoint7_9::fromRaw(val).convert<7, 25>().raw;
+	hasInput[channel] = true;
+}
+
+void FilterBank::update(void){
+	for(uint8_t i = 0; i < numChannels; i++){
+		if(!hasInput[i]){
+			continue; // no new sample, the channel keeps its state
+		}
+		hasInput[i] = false;
+		uint8_t n1 = newest[i]; // previous sample
+		uint8_t n2 = previous(n1);
+		uint8_t n0 = previous(n2); // the oldest tap becomes the newest
+		newest[i] = n0;
+		
+		fixed7_25 x0 = input[i];
+		fixed7_25 x1 = xv[n1][i];
+		fixed7_25 x2 = xv[n2][i];
+		fixed7_25 y1 = yv[n1][i];
+		fixed7_25 y2 = yv[n2][i];
+		uint8_t ai = a[i];
+		uint8_t bi = b[i];
+		xv[n0][i] = x0; // overwrites the oldest input, which is not needed anymore
+		/* Same order of operations as FixedFilter::addDoublePrecision to prevent overflow */
+		yv[n0][i] = ((y1 - y2) + y1) // expected value + 1*
+		- (y1>>bi) + (y2>>bi) + // expected value +0*
+		+ (x0>>ai) + (x1>>(ai-1)) + (x2>>ai) // expected value +(1>>(a-2))
+		- (y2>>(ai-2)); // expected value -(1>>(a-2))
+	}
+}
+
+fixed7_9 FilterBank::readInput(uint8_t channel){
+	return FixedPoint7_25::fromRaw(xv[newest[channel]][channel]).convert<7, 9>().raw;
+}
+
+fixed7_9 FilterBank::readOutput(uint8_t channel){
+	return FixedPoint7_25::fromRaw(yv[newest[channel]][channel]).convert<7, 9>().raw;
+}
+
+fixed7_25 FilterBank::readOutputDoublePrecision(uint8_t channel){
+	return yv[newest[channel]][channel];
+}
+
+fixed7_9 FilterBank::detectPosPeak(uint8_t channel){
+	uint8_t n0 = newest[channel];
+	fixed7_25 y0 = yv[n0][channel];
+	fixed7_25 y1 = yv[previous(n0)][channel];
+	fixed7_25 y2 = yv[previous(previous(n0))][channel];
+	if(y0 < y1 && y1 >= y2){
+		return FixedPoint7_25::fromRaw(y1).convert<7, 9>().raw;
+	}
+	else{
+		return INT_MIN;
+	}
+}
+
+fixed7_9 FilterBank::detectNegPeak(uint8_t channel){
+	uint8_t n0 = newest[channel];
+	fixed7_25 y0 = yv[n0][channel];
+	fixed7_25 y1 = yv[previous(n0)][channel];
+	fixed7_25 y2 = yv[previous(previous(n0))][channel];
+	if(y0 > y1 && y1 <= y2){
+		return FixedPoint7_25::fromRaw(y1).convert<7, 9>().raw;
+	}
+	else{
+		return INT_MIN;
+	}
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright 2012 BrewPi/Elco Jacobs.
+ *
+ * This file is part of BrewPi.
+ *
+ * BrewPi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BrewPi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BrewPi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FILTERBANK_H_
+#define FILTERBANK_H_
+
+#include <inttypes.h>
+#include "temperatureFormats.h"
+
+/* All FixedFilter channels of the sensors in one engine, updated together once per sample.
+ The filter equation is the one of FixedFilter, see FixedFilter.h for the coefficients.
+ The state is stored as a structure of arrays: tap k of all channels is contiguous in xv[k] and yv[k].
+ Instead of shifting its taps, every channel has a circular index that rotates through the 3 taps.
+ Set the input of each channel with setInput(), then update() filters all channels in one loop.
+ A channel that did not get a new input since the last update is skipped: its index and taps stay as they are,
+ like a FixedFilter that is not updated when its sensor skips a sample.
+ The channels are handed out by addChannel(), the user checks at compile time that FILTER_BANK_CHANNELS is enough.
+
+ TempSensor still uses separate FixedFilter objects. On the host the bank is not faster for a few channels
+ (tools/filterBankBench.cpp), and the AVR cycle counts of tools/avrCycleBench.cpp are not measured yet.
+ Only switch the sensors to the bank when those counts show that it is faster per channel.
+*/
+
+#ifndef FILTER_BANK_CHANNELS
+#define FILTER_BANK_CHANNELS 4 // fast and slow filter of 2 sensors
+#endif
+
+class FilterBank{
+	public:
+	FilterBank(){};
+	~FilterBank(){};
+
+	static uint8_t addChannel(void); // returns the new channel
+	static void init(uint8_t channel, fixed7_9 val);
+	static void setCoefficients(uint8_t channel, uint16_t ab);
+	static void setInput(uint8_t channel, fixed7_9 val);
+	static void update(void); // filter all channels
+	static fixed7_9 readInput(uint8_t channel); // returns the most recent filter input
+	static fixed7_9 readOutput(uint8_t channel); // returns the most recent filter output
+	static fixed7_25 readOutputDoublePrecision(uint8_t channel);
+	static fixed7_9 detectPosPeak(uint8_t channel); //returns positive peak or INT_MIN when no peak has been found
+	static fixed7_9 detectNegPeak(uint8_t channel); //returns negative peak or INT_MIN when no peak has been found
+
+	private:
+	static fixed7_25 xv[3][FILTER_BANK_CHANNELS];
+	static fixed7_25 yv[3][FILTER_BANK_CHANNELS];
+	static fixed7_25 input[FILTER_BANK_CHANNELS]; // input for the next update
+	static bool hasInput[FILTER_BANK_CHANNELS]; // input was set since the last update
+	static uint8_t a[FILTER_BANK_CHANNELS];
+	static uint8_t b[FILTER_BANK_CHANNELS];
+	static uint8_t newest[FILTER_BANK_CHANNELS]; // per channel, tap that holds the most recent input and output
+	static uint8_t numChannels;
+	
+	static uint8_t previous(uint8_t tap){
+		return (tap == 0) ? 2 : tap - 1;
+	};
+};
+
+#endif /* FILTERBANK_H_ */
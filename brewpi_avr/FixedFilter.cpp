@@ -21,6 +21,7 @@
 #include <stdlib.h>
 #include <limits.h>
 #include "temperatureFormats.h"
+#include "FixedPoint.h"
 
 FixedFilter::FixedFilter(){
 	setCoefficients(SETTLING_TIME_50_SAMPLES); // default to 50 samples settling time
@@ -41,8 +42,8 @@ void FixedFilter::setCoefficients(uint16_t ab){
 }	
 
 fixed7_9 FixedFilter::add(fixed7_9 val){
-	fixed7_25 returnVal = addDoublePrecision( ((fixed7_25) val) << 16);
-	return returnVal>>16;
+	fixed7_25 returnVal = addDoublePrecision(FixedPoint7_9::fromRaw(val).convert<7, 25>().raw);
+	return FixedPoint7_25::fromRaw(returnVal).convert<7, 9>().raw;
 }
 
 fixed7_25 FixedFilter::addDoublePrecision(fixed7_25 val){
@@ -63,11 +64,11 @@ fixed7_25 FixedFilter::addDoublePrecision(fixed7_25 val){
 }
 
 fixed7_9 FixedFilter::readOutput(void){
-	return yv[0]>>16; // return 16 most significant bits of most recent output
+	return FixedPoint7_25::fromRaw(yv[0]).convert<7, 9>().raw; // return 16 most significant bits of most recent output
 }
 
 fixed7_9 FixedFilter::readInput(void){
-	return xv[0]>>16; // return 16 most significant bits of most recent input
+	return FixedPoint7_25::fromRaw(xv[0]).convert<7, 9>().raw; // return 16 most significant bits of most recent input
 }
 
 fixed7_25 FixedFilter::readOutputDoublePrecision(void){
@@ -79,8 +80,7 @@ fixed7_25 FixedFilter::readPrevOutputDoublePrecision(void){
 }
 
 void FixedFilter::init(fixed7_9 val){
-		xv[0] = val;
-		xv[0] = xv[0]<<16; // 16 extra bits are used in the filter for the fraction part
+		xv[0] = FixedPoint7_9::fromRaw(val).convert<7, 25>().raw; // 16 extra bits are used in the filter for the fraction part
 
 		xv[1] = xv[0];
 		xv[2] = xv[0];
@@ -92,7 +92,7 @@ void FixedFilter::init(fixed7_9 val){
 
 fixed7_9 FixedFilter::detectPosPeak(void){
 	if(yv[0] < yv[1] && yv[1] >= yv[2]){
-		return yv[1]>>16;
+		return FixedPoint7_25::fromRaw(yv[1]).convert<7, 9>().raw;
 	}
 	else{
 		return INT_MIN;
@@ -101,7 +101,7 @@ fixed7_9 FixedFilter::detectPosPeak(void){
 
 fixed7_9 FixedFilter::detectNegPeak(void){
 	if(yv[0] > yv[1] && yv[1] <= yv[2]){
-		return yv[1]>>16;
+		return FixedPoint7_25::fromRaw(yv[1]).convert<7, 9>().raw;
 	}
 	else{
 		return INT_MIN;
@@ -28,11 +28,12 @@ H(z) = 2^-a * -------------------------------------------------
 
  All filter coefficients are powers of two, so the filter can be efficiently implemented with bit shifts
  The DC gain is exactly 1.
- For real poles, and therefore no overshoot, use a <= 2b+4.
+ For real poles, and therefore no overshoot, use a >= 2b+4.
  To calculate the poles, you can use this wolfram alpha link:
  http://www.wolframalpha.com/input/?i=solve+%281++%2B+%28-2+%2B+2^-b%29z^-1++%2B+%281-2^-b+%2B+4*+2^-a%29z^-2%29+%3D+0+where+a+%3D+24+and+b+%3D+10
  The filter has a zero at z = -1
  For a=2b+4, it has a pole at z = (2^(b+1)-1) / 2^(b+1)
+ tools/filterDesign.cpp lists the step response, delay and noise for all settings and recommends one for a settling time.
  Use this MATLAB script to visualize the filter:
 	 a=12; b=4; FS=1;
 	 DEN = [1  , -2 + 2^-b  , 1-2^-b+ 4*2^-a]; NUM = 2^(-a)*[1, 2, 1];
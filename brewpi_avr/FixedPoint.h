@@ -0,0 +1,171 @@
+/*
+ * Copyright 2012 BrewPi/Elco Jacobs.
+ *
+ * This file is part of BrewPi.
+ *
+ * BrewPi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BrewPi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BrewPi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FIXEDPOINT_H_
+#define FIXEDPOINT_H_
+
+#include <inttypes.h>
+
+/* Fixed point number with IntBits signed integer bits and FracBits fraction bits, FixedPoint<7,9> has the same format as fixed7_9.
+ The object only holds the raw integer, so it has the size of the smallest integer type that fits and structs keep their layout.
+ Everything is resolved at compile time: a conversion between formats compiles to the same shift as the hand written code,
+ the saturation checks are only generated when the destination has fewer integer bits.
+
+ Operators:
+ - a + b, a - b: same format, saturating.
+ - a * b: exact product in the format FixedPoint<IntBits1+IntBits2, FracBits1+FracBits2>.
+   The operands are widened to the product type, which avr-gcc compiles to a widening multiply (__mulhisi3 for two 16 bit operands)
+   instead of the full 32x32 bit multiply you get when the operands are cast to fixed23_9 first.
+   Convert the product to the format you need, which saturates when needed:
+		cv.p = (Kp * beerDiff).convert<23, 9>().raw;
+ - a.multiplyInto<ToIntBits, ToFracBits>(b): product in the raw type of the destination, without saturation.
+   For a 16 bit by 32 bit product into 32 bits, where the exact product would need a 64 bit multiply (__muldi3).
+   Only use it when the operands are limited so the product fits.
+*/
+
+template<uint8_t Bytes> struct FixedPointStorage;
+template<> struct FixedPointStorage<1>{ typedef int8_t type; typedef uint8_t unsignedType; };
+template<> struct FixedPointStorage<2>{ typedef int16_t type; typedef uint16_t unsignedType; };
+template<> struct FixedPointStorage<3>{ typedef int32_t type; typedef uint32_t unsignedType; };
+template<> struct FixedPointStorage<4>{ typedef int32_t type; typedef uint32_t unsignedType; };
+template<> struct FixedPointStorage<5>{ typedef int64_t type; typedef uint64_t unsignedType; };
+template<> struct FixedPointStorage<6>{ typedef int64_t type; typedef uint64_t unsignedType; };
+template<> struct FixedPointStorage<7>{ typedef int64_t type; typedef uint64_t unsignedType; };
+template<> struct FixedPointStorage<8>{ typedef int64_t type; typedef uint64_t unsignedType; };
+
+// Shift left by Amount, or right by -Amount when it is negative. Right shifts round down, like >>.
+template<int Amount, bool Left = (Amount >= 0)> struct FixedPointShift{
+	template<typename T> static T apply(T val){
+		return val << Amount;
+	}
+};
+template<int Amount> struct FixedPointShift<Amount, false>{
+	template<typename T> static T apply(T val){
+		return val >> -Amount;
+	}
+};
+
+// Shift a raw value into the type To. Left shifts are done in the destination type, so no bits are lost,
+// right shifts in the source type. Only the specialization for the sign of Amount is instantiated: a left shift
+// of the narrow source type would overflow, even in a branch that never runs (int is 16 bits on the AVR).
+template<int Amount, bool Left = (Amount >= 0)> struct FixedPointRescale{
+	template<typename To, typename From> static To apply(From val){
+		return FixedPointShift<Amount>::apply((To) val);
+	}
+};
+template<int Amount> struct FixedPointRescale<Amount, false>{
+	template<typename To, typename From> static To apply(From val){
+		return (To) FixedPointShift<Amount>::apply(val);
+	}
+};
+
+template<uint8_t IntBits, uint8_t FracBits>
+class FixedPoint{
+	public:
+	typedef typename FixedPointStorage<(IntBits + FracBits + 7) / 8>::type raw_t;
+	typedef typename FixedPointStorage<(IntBits + FracBits + 7) / 8>::unsignedType unsigned_raw_t;
+
+	raw_t raw; // the integer value, scaled by 2^FracBits
+
+	static FixedPoint fromRaw(raw_t val){
+		FixedPoint result;
+		result.raw = val;
+		return result;
+	};
+	static raw_t maxRaw(void){
+		return (raw_t) ((((uint64_t) 1) << (IntBits + FracBits - 1)) - 1);
+	};
+	static raw_t minRaw(void){
+		return -maxRaw() - 1;
+	};
+
+	// conversion to another format, saturates at the limits of the destination
+	template<uint8_t ToIntBits, uint8_t ToFracBits>
+	FixedPoint<ToIntBits, ToFracBits> convert(void) const{
+		typedef FixedPoint<ToIntBits, ToFracBits> To;
+		typedef typename To::raw_t to_raw_t;
+		const int shift = (int) ToFracBits - (int) FracBits;
+		if(ToIntBits < IntBits){
+			// limits of the destination in this format. They fit, because the destination has less integer bits.
+			const raw_t upper = (raw_t) FixedPointShift<-shift>::apply((int64_t) To::maxRaw());
+			const raw_t lower = (raw_t) FixedPointShift<-shift>::apply((int64_t) To::minRaw());
+			if(raw > upper){
+				return To::fromRaw(To::maxRaw());
+			}
+			if(raw < lower){
+				return To::fromRaw(To::minRaw());
+			}
+		}
+		return To::fromRaw(FixedPointRescale<shift>::template apply<to_raw_t>(raw));
+	};
+
+	FixedPoint operator+(const FixedPoint & other) const{
+		return saturate(raw, other.raw, (raw_t) ((unsigned_raw_t) raw + (unsigned_raw_t) other.raw));
+	};
+
+	FixedPoint operator-(const FixedPoint & other) const{
+		// -other.raw can overflow, so the sign of other is inverted in the overflow check instead
+		raw_t difference = (raw_t) ((unsigned_raw_t) raw - (unsigned_raw_t) other.raw);
+		if(((raw ^ other.raw) & (raw ^ difference)) < 0){
+			return fromRaw(raw < 0 ? minRaw() : maxRaw());
+		}
+		return clamp(difference);
+	};
+
+	template<uint8_t OtherIntBits, uint8_t OtherFracBits>
+	FixedPoint<IntBits + OtherIntBits, FracBits + OtherFracBits> operator*(const FixedPoint<OtherIntBits, OtherFracBits> & other) const{
+		typedef FixedPoint<IntBits + OtherIntBits, FracBits + OtherFracBits> Product;
+		return Product::fromRaw((typename Product::raw_t) raw * (typename Product::raw_t) other.raw);
+	};
+
+	template<uint8_t ToIntBits, uint8_t ToFracBits, uint8_t OtherIntBits, uint8_t OtherFracBits>
+	FixedPoint<ToIntBits, ToFracBits> multiplyInto(const FixedPoint<OtherIntBits, OtherFracBits> & other) const{
+		typedef FixedPoint<ToIntBits, ToFracBits> To;
+		typedef typename To::raw_t to_raw_t;
+		const int shift = (int) ToFracBits - (int) FracBits - (int) OtherFracBits;
+		return To::fromRaw(FixedPointShift<shift>::apply((to_raw_t) raw * (to_raw_t) other.raw));
+	};
+
+	private:
+	// sum wrapped around when both operands have the same sign and the sum has a different sign
+	static FixedPoint saturate(raw_t a, raw_t b, raw_t sum){
+		if(((a ^ sum) & (b ^ sum)) < 0){
+			return fromRaw(a < 0 ? minRaw() : maxRaw());
+		}
+		return clamp(sum);
+	};
+	// the format can have less bits than the raw integer type, like FixedPoint<15,9> in an int32_t
+	static FixedPoint clamp(raw_t val){
+		if(IntBits + FracBits < 8 * sizeof(raw_t)){
+			if(val > maxRaw()){
+				return fromRaw(maxRaw());
+			}
+			if(val < minRaw()){
+				return fromRaw(minRaw());
+			}
+		}
+		return fromRaw(val);
+	};
+};
+
+typedef FixedPoint<7, 9> FixedPoint7_9;
+typedef FixedPoint<23, 9> FixedPoint23_9;
+typedef FixedPoint<7, 25> FixedPoint7_25;
+
+#endif /* FIXEDPOINT_H_ */
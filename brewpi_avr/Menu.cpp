@@ -25,17 +25,18 @@
 #include "TempControl.h"
 #include "temperatureFormats.h"
 #include "RotaryEncoder.h"
-#include "PiLink.h"
+#include "EventLog.h"
+#include "Ticks.h"
 
 Menu menu;
 
 void Menu::pickSettingToChange(void){
 	rotaryEncoder.setRange(0, 0, 2); // mode setting, beer temp, fridge temp
-	unsigned long timer = millis();
+	uptime_t timer = ticks.millis64();
 	uint8_t blinkTimer = 0;
-	while((millis()) - timer < MENU_TIMEOUT){ // time out at 10 seconds
+	while(ticks.timeSince(timer) < MENU_TIMEOUT){ // time out at 10 seconds
 		if(rotaryEncoder.changed()){
-			timer=millis();
+			timer=ticks.millis64();
 			blinkTimer = 0;		
 		}
 		if(blinkTimer == 0){
@@ -90,10 +91,10 @@ void Menu::pickMode(void){
 	rotaryEncoder.setRange(startValue, 0, 3); // toggle between beer constant, beer profile, fridge constant
 	const char lookup[] = {'b', 'f', 'p', 'o'};
 	uint8_t blinkTimer = 0;
-	unsigned long timer = millis();
-	while((millis()) - timer < MENU_TIMEOUT){ // time out at 10 seconds
+	uptime_t timer = ticks.millis64();
+	while(ticks.timeSince(timer) < MENU_TIMEOUT){ // time out at 10 seconds
 		if(rotaryEncoder.changed()){
-			timer=millis();
+			timer=ticks.millis64();
 			blinkTimer = 0;
 			
 			tempControl.setMode(lookup[rotaryEncoder.read()]);
@@ -106,11 +107,8 @@ void Menu::pickMode(void){
 				else if(tempControl.getMode() == MODE_FRIDGE_CONSTANT){
 					menu.pickFridgeSetting();
 				}
-				else if(tempControl.getMode() == MODE_BEER_PROFILE){
-					piLink.printBeerAnnotation(PSTR("Changed to profile mode in menu."));
-				}
-				else if(tempControl.getMode() == MODE_OFF){
-					piLink.printBeerAnnotation(PSTR("Temp control turned off in menu."));
+				else if(tempControl.getMode() == MODE_BEER_PROFILE || tempControl.getMode() == MODE_OFF){
+					eventLog.add(EVENT_MODE_CHANGED_MENU, tempControl.getMode());
 				}						
 				return;
 			}
@@ -144,18 +142,17 @@ void Menu::pickBeerSetting(void){
 	rotaryEncoder.setRange(fixedToTenths(startVal), fixedToTenths(tempControl.cc.tempSettingMin), fixedToTenths(tempControl.cc.tempSettingMax));
 	
 	uint8_t blinkTimer = 0;
-	unsigned long timer = millis();
-	while((millis()) - timer < MENU_TIMEOUT){ // time out at 10 seconds
+	uptime_t timer = ticks.millis64();
+	while(ticks.timeSince(timer) < MENU_TIMEOUT){ // time out at 10 seconds
 		if(rotaryEncoder.changed()){
-			timer=millis();
+			timer=ticks.millis64();
 			blinkTimer = 0;
 			
 			tempControl.setBeerTemp(tenthsToFixed(rotaryEncoder.read()));			
 			display.printBeerSet();
 			if(rotaryEncoder.pushed() ){
 				rotaryEncoder.resetPushed();
-				char tempString[9];
-				piLink.printBeerAnnotation(PSTR("Beer temperature setting changed to %s in Menu."), tempToString(tempString,tempControl.getBeerSetting(),1,9));
+				eventLog.add(EVENT_BEER_SETTING_CHANGED_MENU, tempControl.getBeerSetting());
 				return;
 			}
 		}
@@ -188,18 +185,17 @@ void Menu::pickFridgeSetting(void){
 	rotaryEncoder.setRange(fixedToTenths(startVal), fixedToTenths(tempControl.cc.tempSettingMin), fixedToTenths(tempControl.cc.tempSettingMax));
 	
 	uint8_t blinkTimer = 0;
-	unsigned long timer = millis();
-	while((millis()) - timer < MENU_TIMEOUT){ // time out at 10 seconds
+	uptime_t timer = ticks.millis64();
+	while(ticks.timeSince(timer) < MENU_TIMEOUT){ // time out at 10 seconds
 		if(rotaryEncoder.changed()){
-			timer=millis();
+			timer=ticks.millis64();
 			blinkTimer = 0;
 			
 			tempControl.setFridgeTemp(tenthsToFixed(rotaryEncoder.read()));			
 			display.printFridgeSet();
 			if(rotaryEncoder.pushed() ){
 				rotaryEncoder.resetPushed();
-				char tempString[9];
-				piLink.printFridgeAnnotation(PSTR("Fridge temperature setting changed to %s in Menu."), tempToString(tempString,tempControl.getFridgeSetting(),1,9));
+				eventLog.add(EVENT_FRIDGE_SETTING_CHANGED_MENU, tempControl.getFridgeSetting());
 				return;
 			}
 		}
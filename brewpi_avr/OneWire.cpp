@@ -97,6 +97,7 @@ sample code bearing this copyright.
 */
 
 #include "OneWire.h"
+#include "OneWireUart.h"
 
 
 OneWire::OneWire(uint8_t pin)
@@ -104,6 +105,10 @@ OneWire::OneWire(uint8_t pin)
 	pinMode(pin, INPUT);
 	bitmask = PIN_TO_BITMASK(pin);
 	baseReg = PIN_TO_BASEREG(pin);
+#if ONEWIRE_UART
+	uart = (pin == ONEWIRE_UART_PIN);
+	if (uart) OneWireUart::init();
+#endif
 #if ONEWIRE_SEARCH
 	reset_search();
 #endif
@@ -123,6 +128,9 @@ uint8_t OneWire::reset(void)
 	uint8_t r;
 	uint8_t retries = 125;
 
+#if ONEWIRE_UART
+	if (uart) return OneWireUart::reset();
+#endif
 	noInterrupts();
 	DIRECT_MODE_INPUT(reg, mask);
 	interrupts();
@@ -155,6 +163,12 @@ void OneWire::write_bit(uint8_t v)
 	IO_REG_TYPE mask=bitmask;
 	volatile IO_REG_TYPE *reg IO_REG_ASM = baseReg;
 
+#if ONEWIRE_UART
+	if (uart) {
+		OneWireUart::write_bit(v & 1);
+		return;
+	}
+#endif
 	if (v & 1) {
 		noInterrupts();
 		DIRECT_WRITE_LOW(reg, mask);
@@ -184,6 +198,9 @@ uint8_t OneWire::read_bit(void)
 	volatile IO_REG_TYPE *reg IO_REG_ASM = baseReg;
 	uint8_t r;
 
+#if ONEWIRE_UART
+	if (uart) return OneWireUart::read_bit();
+#endif
 	noInterrupts();
 	DIRECT_MODE_OUTPUT(reg, mask);
 	DIRECT_WRITE_LOW(reg, mask);
@@ -206,6 +223,14 @@ uint8_t OneWire::read_bit(void)
 void OneWire::write(uint8_t v, uint8_t power /* = 0 */) {
     uint8_t bitMask;
 
+#if ONEWIRE_UART
+    if (uart) {
+	// queued, the bus is released by the UART after each slot. When the bus does not echo,
+	// the slots are dropped and the next reset() reports no presence
+	OneWireUart::write(v);
+	return;
+    }
+#endif
     for (bitMask = 0x01; bitMask; bitMask <<= 1) {
 	OneWire::write_bit( (bitMask & v)?1:0);
     }
@@ -235,6 +260,9 @@ uint8_t OneWire::read() {
     uint8_t bitMask;
     uint8_t r = 0;
 
+#if ONEWIRE_UART
+    if (uart) return OneWireUart::read();
+#endif
     for (bitMask = 0x01; bitMask; bitMask <<= 1) {
 	if ( OneWire::read_bit()) r |= bitMask;
     }
@@ -268,6 +296,9 @@ void OneWire::skip()
 
 void OneWire::depower()
 {
+#if ONEWIRE_UART
+	if (uart) return;
+#endif
 	noInterrupts();
 	DIRECT_MODE_INPUT(baseReg, bitmask);
 	interrupts();
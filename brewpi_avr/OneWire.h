@@ -45,12 +45,35 @@
 #define ONEWIRE_CRC16 1
 #endif
 
+// Set this to 1 to drive the bus of the OneWire object created for
+// ONEWIRE_UART_PIN with USART1 instead of bit banging (Leonardo only).
+// See OneWireUart.h for the wiring.
+#ifndef ONEWIRE_UART
+#define ONEWIRE_UART 0
+#endif
+#define ONEWIRE_UART_PIN 0 // RX1
+
 #define FALSE 0
 #define TRUE  1
 
 // Platform specific I/O definitions
 
-#if defined(__AVR__)
+#if defined(ONEWIRE_HOST)
+// Host test programs in tools/ simulate the bus: every access to the pin calls the simulation
+#define PIN_TO_BASEREG(pin)             (portInputRegister(digitalPinToPort(pin)))
+#define PIN_TO_BITMASK(pin)             (digitalPinToBitMask(pin))
+#define IO_REG_TYPE uint8_t
+#define IO_REG_ASM
+uint8_t oneWireHostRead(volatile uint8_t * base, uint8_t mask);
+void oneWireHostMode(volatile uint8_t * base, uint8_t mask, bool output);
+void oneWireHostWrite(volatile uint8_t * base, uint8_t mask, bool high);
+#define DIRECT_READ(base, mask)         oneWireHostRead(base, mask)
+#define DIRECT_MODE_INPUT(base, mask)   oneWireHostMode(base, mask, false)
+#define DIRECT_MODE_OUTPUT(base, mask)  oneWireHostMode(base, mask, true)
+#define DIRECT_WRITE_LOW(base, mask)    oneWireHostWrite(base, mask, false)
+#define DIRECT_WRITE_HIGH(base, mask)   oneWireHostWrite(base, mask, true)
+
+#elif defined(__AVR__)
 #define PIN_TO_BASEREG(pin)             (portInputRegister(digitalPinToPort(pin)))
 #define PIN_TO_BITMASK(pin)             (digitalPinToBitMask(pin))
 #define IO_REG_TYPE uint8_t
@@ -83,6 +106,9 @@ class OneWire
   private:
     IO_REG_TYPE bitmask;
     volatile IO_REG_TYPE *baseReg;
+#if ONEWIRE_UART
+    uint8_t uart; // bus is driven by USART1
+#endif
 
 #if ONEWIRE_SEARCH
     // global search state
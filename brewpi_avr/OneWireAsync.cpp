@@ -0,0 +1,205 @@
+/*
+ * Copyright 2012 BrewPi/Elco Jacobs.
+ *
+ * This file is part of BrewPi.
+ *
+ * BrewPi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BrewPi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BrewPi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <Arduino.h>
+#include <util/atomic.h>
+
+#include "OneWireAsync.h"
+#include "pins.h"
+
+// Timing in microseconds
+#define ONEWIRE_ASYNC_RESET_LOW 500 // reset pulse, minimum 480
+// sample presence pulse after releasing the bus. Every sensor answers from 60 to 75 us, the interrupt latency
+// is added, so sample early in that window
+#define ONEWIRE_ASYNC_PRESENCE_WAIT 62
+#define ONEWIRE_ASYNC_RESET_RECOVERY 418 // rest of presence time slot, at least 480 us after releasing the bus
+#define ONEWIRE_ASYNC_WRITE_ZERO_LOW 62 // low time of write 0 slot, 60-120. Interrupt latency is added
+#define ONEWIRE_ASYNC_SLOT_RECOVERY 55 // time between the end of a short pulse and the next slot
+#define ONEWIRE_ASYNC_WRITE_ZERO_RECOVERY 10
+
+enum{
+	PHASE_RESET,
+	PHASE_RESET_RELEASE,
+	PHASE_PRESENCE,
+	PHASE_SLOT,
+	PHASE_WRITE_ZERO_RELEASE
+};
+
+OneWireAsync oneWireAsync;
+
+OneWireTransaction * OneWireAsync::head;
+OneWireTransaction * OneWireAsync::tail;
+uint8_t OneWireAsync::phase;
+uint8_t OneWireAsync::bitIndex;
+
+void OneWireAsync::initTransaction(OneWireTransaction * t, uint8_t pin, void (*callback)(void * context), void * context){
+	pinMode(pin, INPUT);
+	t->baseReg = PIN_TO_BASEREG(pin);
+	t->bitmask = PIN_TO_BITMASK(pin);
+	t->txCount = 0;
+	t->rxCount = 0;
+	t->status = ONEWIRE_ASYNC_IDLE;
+	t->callback = callback;
+	t->context = context;
+	t->next = 0;
+}
+
+bool OneWireAsync::start(OneWireTransaction * t){
+	if(t->txCount + t->rxCount > ONEWIRE_ASYNC_BUFFER_SIZE){
+		return false;
+	}
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		if(t->status == ONEWIRE_ASYNC_BUSY){
+			return false;
+		}
+		t->status = ONEWIRE_ASYNC_BUSY;
+		memset(t->buffer + t->txCount, 0, t->rxCount); // received bits are or-ed into the buffer
+		t->next = 0;
+		if(head == 0){
+			head = t;
+			tail = t;
+			begin();
+		}
+		else{
+			tail->next = t;
+			tail = t;
+		}
+	}
+	return true;
+}
+
+void OneWireAsync::begin(void){
+	phase = PHASE_RESET;
+	bitIndex = 0;
+	TCCR1A = 0;
+	TCCR1B = (1<<WGM12) | (1<<CS11); // CTC mode, prescaler 8
+	schedule(10);
+	TIMSK1 |= (1<<OCIE1A);
+}
+
+// Next compare interrupt after the given time
+void OneWireAsync::schedule(uint16_t micros){
+	OCR1A = micros * (F_CPU / 8000000UL) - 1;
+	TCNT1 = 0;
+	TIFR1 = (1<<OCF1A); // clear pending interrupt
+}
+
+void OneWireAsync::timerInterrupt(void){
+	OneWireTransaction * t = head;
+	if(t == 0){
+		TIMSK1 &= ~(1<<OCIE1A);
+		return;
+	}
+	volatile IO_REG_TYPE * reg = t->baseReg;
+	IO_REG_TYPE mask = t->bitmask;
+
+	switch(phase){
+		case PHASE_RESET:
+			DIRECT_WRITE_LOW(reg, mask);
+			DIRECT_MODE_OUTPUT(reg, mask);
+			schedule(ONEWIRE_ASYNC_RESET_LOW);
+			phase = PHASE_RESET_RELEASE;
+			break;
+		case PHASE_RESET_RELEASE:
+			DIRECT_MODE_INPUT(reg, mask);
+			schedule(ONEWIRE_ASYNC_PRESENCE_WAIT);
+			phase = PHASE_PRESENCE;
+			break;
+		case PHASE_PRESENCE:
+			if(DIRECT_READ(reg, mask)){
+				t->status = ONEWIRE_ASYNC_NO_PRESENCE;
+				finish();
+				return;
+			}
+			schedule(ONEWIRE_ASYNC_RESET_RECOVERY);
+			phase = PHASE_SLOT;
+			break;
+		case PHASE_WRITE_ZERO_RELEASE:
+			DIRECT_MODE_INPUT(reg, mask);
+			schedule(ONEWIRE_ASYNC_WRITE_ZERO_RECOVERY);
+			phase = PHASE_SLOT;
+			break;
+		case PHASE_SLOT:
+			nextSlot();
+			break;
+	}
+}
+
+void OneWireAsync::nextSlot(void){
+	OneWireTransaction * t = head;
+	volatile IO_REG_TYPE * reg = t->baseReg;
+	IO_REG_TYPE mask = t->bitmask;
+	uint8_t byteIndex = bitIndex >> 3;
+	uint8_t bitMask = 1 << (bitIndex & 7);
+
+	if(byteIndex < t->txCount){
+		if(t->buffer[byteIndex] & bitMask){
+			DIRECT_WRITE_LOW(reg, mask);
+			DIRECT_MODE_OUTPUT(reg, mask);
+			delayMicroseconds(5);
+			DIRECT_MODE_INPUT(reg, mask);
+			schedule(ONEWIRE_ASYNC_SLOT_RECOVERY + 5);
+		}
+		else{
+			DIRECT_WRITE_LOW(reg, mask);
+			DIRECT_MODE_OUTPUT(reg, mask);
+			schedule(ONEWIRE_ASYNC_WRITE_ZERO_LOW);
+			phase = PHASE_WRITE_ZERO_RELEASE;
+		}
+	}
+	else if(byteIndex < t->txCount + t->rxCount){
+		DIRECT_WRITE_LOW(reg, mask);
+		DIRECT_MODE_OUTPUT(reg, mask);
+		delayMicroseconds(3);
+		DIRECT_MODE_INPUT(reg, mask);
+		delayMicroseconds(10);
+		if(DIRECT_READ(reg, mask)){
+			t->buffer[byteIndex] |= bitMask;
+		}
+		schedule(ONEWIRE_ASYNC_SLOT_RECOVERY);
+	}
+	else{
+		t->status = ONEWIRE_ASYNC_DONE;
+		finish();
+		return;
+	}
+	bitIndex++;
+}
+
+// Remove the finished transaction from the queue, start the next one and call the callback
+void OneWireAsync::finish(void){
+	OneWireTransaction * t = head;
+	TIMSK1 &= ~(1<<OCIE1A);
+	head = t->next;
+	if(head == 0){
+		tail = 0;
+	}
+	else{
+		begin();
+	}
+	if(t->callback){
+		t->callback(t->context);
+	}
+}
+
+#if USE_ONEWIRE_ASYNC
+ISR(TIMER1_COMPA_vect){
+	OneWireAsync::timerInterrupt();
+}
+#endif
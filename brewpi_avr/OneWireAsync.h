@@ -0,0 +1,88 @@
+/*
+ * Copyright 2012 BrewPi/Elco Jacobs.
+ *
+ * This file is part of BrewPi.
+ *
+ * BrewPi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BrewPi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BrewPi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ONEWIREASYNC_H_
+#define ONEWIREASYNC_H_
+
+/* Interrupt driven 1-Wire master.
+ The bit banging OneWire class busy waits for every time slot with interrupts disabled for up to 500 us.
+ This class generates the time slots with the compare interrupt of Timer1, so the bus advances in the background.
+ Only the short parts of a slot (the low pulse of a write 1 and the low pulse and sample of a read) are timed
+ inside the interrupt, interrupts are disabled for at most 15 us.
+
+ A transaction is a reset pulse, followed by txCount bytes from the buffer and rxCount bytes read into the
+ buffer after the transmitted bytes. When the transaction is finished, the callback is called from the interrupt,
+ so keep it short. The callback can start a new transaction.
+ Transactions on different pins are queued and handled one after another, there is only one timer.
+
+ The bus is released between slots instead of driven high, so parasite power is not supported.
+ Timer1 cannot be used for anything else when this class is used.
+ tools/oneWireAsyncSim.cpp checks the slot timing against a simulated sensor on the host.
+*/
+
+#include <inttypes.h>
+#include "OneWire.h"
+
+#define ONEWIRE_ASYNC_BUFFER_SIZE 19 // match rom + address + read scratchpad + 9 bytes scratchpad
+
+enum OneWireAsyncStatus{
+	ONEWIRE_ASYNC_IDLE,
+	ONEWIRE_ASYNC_BUSY,
+	ONEWIRE_ASYNC_DONE, // finished, received bytes are in the buffer
+	ONEWIRE_ASYNC_NO_PRESENCE // no device answered the reset pulse
+};
+
+struct OneWireTransaction{
+	volatile IO_REG_TYPE * baseReg;
+	IO_REG_TYPE bitmask;
+	uint8_t txCount;
+	uint8_t rxCount;
+	uint8_t buffer[ONEWIRE_ASYNC_BUFFER_SIZE];
+	volatile uint8_t status;
+	void (*callback)(void * context);
+	void * context;
+	OneWireTransaction * next;
+};
+
+class OneWireAsync{
+	public:
+	OneWireAsync(){};
+	~OneWireAsync(){};
+
+	static void initTransaction(OneWireTransaction * t, uint8_t pin, void (*callback)(void * context), void * context);
+	// queue a transaction. Returns false when the transaction is still busy or does not fit in the buffer
+	static bool start(OneWireTransaction * t);
+
+	static void timerInterrupt(void); // called from the Timer1 compare interrupt
+
+	private:
+	static void begin(void);
+	static void schedule(uint16_t micros);
+	static void nextSlot(void);
+	static void finish(void);
+
+	static OneWireTransaction * head; // transaction on the bus
+	static OneWireTransaction * tail;
+	static uint8_t phase;
+	static uint8_t bitIndex; // next bit to write or read
+};
+
+extern OneWireAsync oneWireAsync;
+
+#endif /* ONEWIREASYNC_H_ */
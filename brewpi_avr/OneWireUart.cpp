@@ -0,0 +1,194 @@
+/*
+ * Copyright 2012 BrewPi/Elco Jacobs.
+ *
+ * This file is part of BrewPi.
+ *
+ * BrewPi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BrewPi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BrewPi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <Arduino.h>
+#include <util/atomic.h>
+
+#include "OneWireUart.h"
+#include "OneWire.h"
+
+#if ONEWIRE_UART
+
+#if !defined(USBCON)
+#error "ONEWIRE_UART needs USART1, which is only spare on the Leonardo"
+#endif
+
+#define ONEWIRE_UART_UBRR_RESET (F_CPU / 8 / 9600 - 1) // double speed mode
+#define ONEWIRE_UART_UBRR_SLOT (F_CPU / 8 / 115200 - 1)
+#define ONEWIRE_UART_TIMEOUT 10000 // microseconds without an echo before the transfer is given up
+
+OneWireUart oneWireUart;
+
+uint8_t OneWireUart::queue[ONEWIRE_UART_QUEUE_SIZE];
+volatile uint8_t OneWireUart::queueHead;
+volatile uint8_t OneWireUart::queueCount;
+volatile uint8_t OneWireUart::txByte;
+volatile uint8_t OneWireUart::rxByte;
+volatile uint8_t OneWireUart::bitsLeft;
+volatile bool OneWireUart::resetPending;
+volatile uint8_t OneWireUart::echoCount;
+
+void OneWireUart::init(void){
+	UCSR1A = (1<<U2X1);
+	UBRR1 = ONEWIRE_UART_UBRR_SLOT;
+	UCSR1C = (1<<UCSZ11) | (1<<UCSZ10); // 8N1
+	UCSR1B = (1<<RXEN1) | (1<<TXEN1) | (1<<RXCIE1);
+}
+
+uint8_t OneWireUart::reset(void){
+	waitIdle();
+	UBRR1 = ONEWIRE_UART_UBRR_RESET;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		resetPending = true;
+		rxByte = 0xF0;
+		bitsLeft = 1;
+		UDR1 = 0xF0;
+	}
+	waitIdle();
+	UBRR1 = ONEWIRE_UART_UBRR_SLOT;
+	return (rxByte != 0xF0) ? 1 : 0;
+}
+
+bool OneWireUart::write(uint8_t v){
+	EchoTimer timer;
+	startTimer(&timer);
+	while(queueCount >= ONEWIRE_UART_QUEUE_SIZE){
+		// wait for space in the queue
+		if(timedOut(&timer)){
+			abort();
+			return false;
+		}
+	}
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		queue[(queueHead + queueCount) % ONEWIRE_UART_QUEUE_SIZE] = v;
+		queueCount++;
+		if(bitsLeft == 0){
+			startNextByte();
+		}
+	}
+	return true;
+}
+
+uint8_t OneWireUart::read(void){
+	waitIdle();
+	transfer(0xFF, 8);
+	waitIdle();
+	return rxByte;
+}
+
+void OneWireUart::write_bit(uint8_t v){
+	waitIdle();
+	transfer(v ? 0xFF : 0x00, 1);
+}
+
+uint8_t OneWireUart::read_bit(void){
+	waitIdle();
+	transfer(0xFF, 1);
+	waitIdle();
+	return rxByte >> 7;
+}
+
+// start the slots for the given bits. Only call when idle
+void OneWireUart::transfer(uint8_t v, uint8_t bits){
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		txByte = v;
+		rxByte = 0;
+		bitsLeft = bits;
+		UDR1 = (v & 1) ? 0xFF : 0x00;
+	}
+}
+
+// take the next byte from the queue. Only call with interrupts disabled
+void OneWireUart::startNextByte(void){
+	uint8_t v = queue[queueHead];
+	queueHead = (queueHead + 1) % ONEWIRE_UART_QUEUE_SIZE;
+	queueCount--;
+	txByte = v;
+	rxByte = 0;
+	bitsLeft = 8;
+	UDR1 = (v & 1) ? 0xFF : 0x00;
+}
+
+// wait until all queued slots are finished. Gives up when the bus does not echo (no TX to RX connection)
+bool OneWireUart::waitIdle(void){
+	EchoTimer timer;
+	startTimer(&timer);
+	while(bitsLeft != 0 || queueCount != 0){
+		if(timedOut(&timer)){
+			abort();
+			return false;
+		}
+	}
+	return true;
+}
+
+void OneWireUart::startTimer(EchoTimer * timer){
+	timer->echoCount = echoCount;
+	timer->start = micros();
+}
+
+// true when there was no echo for ONEWIRE_UART_TIMEOUT. Every echo restarts the timer,
+// so a full queue can take longer than the timeout on a healthy bus.
+bool OneWireUart::timedOut(EchoTimer * timer){
+	unsigned long now = micros();
+	if(echoCount != timer->echoCount){
+		timer->echoCount = echoCount;
+		timer->start = now;
+		return false;
+	}
+	return now - timer->start > ONEWIRE_UART_TIMEOUT;
+}
+
+// drop the queued slots after a timeout, the next reset starts from a clean state
+void OneWireUart::abort(void){
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		bitsLeft = 0;
+		queueCount = 0;
+		resetPending = false;
+	}
+}
+
+void OneWireUart::receiveInterrupt(void){
+	uint8_t echo = UDR1;
+	echoCount++;
+	if(bitsLeft == 0){
+		return; // unexpected byte
+	}
+	if(resetPending){
+		rxByte = echo;
+		resetPending = false;
+		bitsLeft = 0;
+		return;
+	}
+	rxByte = (rxByte >> 1) | ((echo == 0xFF) ? 0x80 : 0);
+	txByte >>= 1;
+	bitsLeft--;
+	if(bitsLeft != 0){
+		UDR1 = (txByte & 1) ? 0xFF : 0x00;
+	}
+	else if(queueCount != 0){
+		startNextByte();
+	}
+}
+
+ISR(USART1_RX_vect){
+	OneWireUart::receiveInterrupt();
+}
+
+#endif
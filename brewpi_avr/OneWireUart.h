@@ -0,0 +1,84 @@
+/*
+ * Copyright 2012 BrewPi/Elco Jacobs.
+ *
+ * This file is part of BrewPi.
+ *
+ * BrewPi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BrewPi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BrewPi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ONEWIREUART_H_
+#define ONEWIREUART_H_
+
+/* 1-Wire transport over USART1.
+ TX1 drives the bus through an open drain buffer (transistor or diode), RX1 is connected to the bus.
+ Every received byte is the echo of the transmitted byte, with the bits pulled low by devices on the bus.
+	reset:		9600 baud, send 0xF0. A presence pulse changes the echo.
+	time slot:	115200 baud, send 0xFF to write a 1 or read, 0x00 to write a 0. The echo is 0xFF when a 1 was read.
+ The start bit of the UART is the low pulse of the slot, so the hardware does the timing.
+ Each slot is one UART byte handled in the receive interrupt, which transmits the byte for the next slot.
+ Written bytes are queued, so write() only waits when the queue is full. read() waits for its own 8 slots.
+ Interrupts are never disabled for the timing.
+ Every wait gives up after ONEWIRE_UART_TIMEOUT without an echo (bus disconnected or miswired). Each echo restarts
+ the timeout, so waiting for a full queue is not limited. The queued slots are dropped after a timeout, write()
+ returns false and reset() reports no presence.
+ tools/oneWireUartTest.cpp runs this class on the host against a mock USART.
+
+ Only the Leonardo has a spare USART, the Uno uses its only USART for the serial connection to the Pi.
+ There is one bus, so only one of the sensors can use it (see pins.h). The other stays on its own pin.
+*/
+
+#include <inttypes.h>
+
+#define ONEWIRE_UART_QUEUE_SIZE 16 // bytes, enough for a match rom command
+
+class OneWireUart{
+	public:
+	OneWireUart(){};
+	~OneWireUart(){};
+
+	static void init(void);
+	static uint8_t reset(void); // returns 1 when a device answered with a presence pulse
+	static bool write(uint8_t v); // returns false when the queue stays full because the bus does not echo
+	static uint8_t read(void);
+	static void write_bit(uint8_t v);
+	static uint8_t read_bit(void);
+
+	static void receiveInterrupt(void); // called from the USART1 receive interrupt
+
+	private:
+	static void transfer(uint8_t v, uint8_t bits);
+	static bool waitIdle(void);
+	static void abort(void);
+	static void startNextByte(void);
+
+	struct EchoTimer{
+		uint8_t echoCount; // echoes received when the timer was (re)started
+		unsigned long start;
+	};
+	static void startTimer(EchoTimer * timer);
+	static bool timedOut(EchoTimer * timer);
+
+	static uint8_t queue[ONEWIRE_UART_QUEUE_SIZE];
+	static volatile uint8_t queueHead;
+	static volatile uint8_t queueCount;
+	static volatile uint8_t txByte; // bits of current byte still to be sent, LSB first
+	static volatile uint8_t rxByte; // bits read in current byte, shifted in from the MSB
+	static volatile uint8_t bitsLeft; // slots left in current byte
+	static volatile bool resetPending;
+	static volatile uint8_t echoCount; // incremented on every received byte, restarts the timeout of the waits
+};
+
+extern OneWireUart oneWireUart;
+
+#endif /* ONEWIREUART_H_ */
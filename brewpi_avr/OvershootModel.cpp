@@ -0,0 +1,99 @@
+/*
+ * Copyright 2012 BrewPi/Elco Jacobs.
+ *
+ * This file is part of BrewPi.
+ *
+ * BrewPi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BrewPi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BrewPi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <Arduino.h>
+#include <limits.h>
+
+#include "OvershootModel.h"
+#include "temperatureFormats.h"
+
+void OvershootModel::init(void){
+	p[0][0] = OVERSHOOT_MODEL_P_LAG;
+	p[0][1] = 0;
+	p[1][0] = 0;
+	p[1][1] = OVERSHOOT_MODEL_P_GAIN;
+	x[0] = 0;
+	x[1] = 0;
+	offTemp = INT_MIN;
+	predictedOvershoot = 0;
+}
+
+// on time in seconds is converted to hours with 9 fraction bits
+static fixed7_9 onTimeToHours(uint16_t onTime){
+	return ((fixed23_9) onTime << 9) / 3600;
+}
+
+fixed7_9 OvershootModel::predict(fixed7_9 lag, fixed7_9 gain, fixed7_9 slope, uint16_t onTime){
+	fixed23_9 overshoot = ((fixed23_9) lag * slope + (fixed23_9) gain * onTimeToHours(onTime))>>9;
+	return constrain(overshoot, 0, INT_MAX);
+}
+
+void OvershootModel::switchOff(fixed7_9 lag, fixed7_9 gain, fixed7_9 temperature, fixed7_9 slope, uint16_t onTime){
+	x[0] = slope;
+	x[1] = onTimeToHours(onTime);
+	offTemp = temperature;
+	predictedOvershoot = predict(lag, gain, slope, onTime);
+}
+
+fixed7_9 OvershootModel::update(fixed7_9 * lag, fixed7_9 * gain, fixed7_9 overshoot){
+	offTemp = INT_MIN; // each switch off is used only once
+	
+	// Recursive least squares. Products are calculated with 64 bits, this only runs once per detected peak.
+	// P*x, fixed15_17
+	int64_t px0 = ((int64_t) p[0][0] * x[0] + (int64_t) p[0][1] * x[1])>>9;
+	int64_t px1 = ((int64_t) p[1][0] * x[0] + (int64_t) p[1][1] * x[1])>>9;
+	// lambda + x'*P*x, fixed15_17
+	int64_t denominator = OVERSHOOT_MODEL_LAMBDA + (((int64_t) x[0] * px0 + (int64_t) x[1] * px1)>>9);
+	if(denominator <= 0){
+		init(); // covariance matrix is no longer positive definite, start over
+		return 0;
+	}
+	// gain vector k = P*x / (lambda + x'*P*x), fixed15_17
+	int64_t k0 = (px0<<17) / denominator;
+	int64_t k1 = (px1<<17) / denominator;
+
+	fixed23_9 error = overshoot - (((fixed23_9) *lag * x[0] + (fixed23_9) *gain * x[1])>>9);
+
+	fixed23_9 newLag = *lag + ((k0 * error)>>17);
+	fixed23_9 newGain = *gain + ((k1 * error)>>17);
+	*lag = constrain(newLag, 0, OVERSHOOT_MODEL_MAX_LAG); // overshoot cannot be negative
+	*gain = constrain(newGain, 0, INT_MAX);
+
+	// P = (P - k*x'*P) / lambda
+	int64_t p00 = p[0][0] - ((k0 * px0)>>17);
+	int64_t p01 = p[0][1] - ((k0 * px1)>>17);
+	int64_t p11 = p[1][1] - ((k1 * px1)>>17);
+	p00 += p00>>3;
+	p01 += p01>>3;
+	p11 += p11>>3;
+
+	// Limit the covariance to the initial values. Without excitation, it would grow every update (wind-up).
+	p00 = constrain(p00, 1, OVERSHOOT_MODEL_P_LAG);
+	p11 = constrain(p11, 1, OVERSHOOT_MODEL_P_GAIN);
+	// keep the matrix positive definite: p01^2 < p00*p11
+	int64_t p01Max = min(p00, p11)>>1;
+	p01 = constrain(p01, -p01Max, p01Max);
+
+	p[0][0] = p00;
+	p[0][1] = p01;
+	p[1][0] = p01; // keep symmetric
+	p[1][1] = p11;
+
+	return constrain(error, INT_MIN, INT_MAX);
+}
\ No newline at end of file
@@ -0,0 +1,82 @@
+/*
+ * Copyright 2012 BrewPi/Elco Jacobs.
+ *
+ * This file is part of BrewPi.
+ *
+ * BrewPi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BrewPi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BrewPi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OVERSHOOTMODEL_H_
+#define OVERSHOOTMODEL_H_
+
+/* This class predicts the peak in fridge temperature after the heater or compressor is switched off.
+
+ The fridge air is modeled as a first order system with dead time (time constant tau, dead time theta).
+ After switching off, the air temperature keeps following the 'on' trajectory for the dead time:
+	overshoot = (Tsteady - Toff) * (1 - e^(-theta/tau)) = slope * tau * (1 - e^(-theta/tau)) = lag * slope
+ The heat stored in the heater or evaporator during the run adds a part that is proportional to the on time:
+	overshoot = lag * slope + gain * onTime
+ slope is the average slope during the run in degrees per hour. onTime is the time the output was energized in hours,
+ which is shorter than the run when the output is time proportioned.
+ The slope is taken as zero for the first OVERSHOOT_MODEL_MIN_SLOPE_TIME seconds of a run. Over a shorter time,
+ one 1/16 degree step of sensor noise would give a slope of tens of degrees per hour and switch the output off again.
+ gain has the same unit as the old overshoot estimator (degrees overshoot per hour on time).
+
+ lag and gain are fitted with recursive least squares on every detected peak, with forgetting factor 8/9.
+ With only two parameters, this converges within a few heating or cooling cycles.
+ lag and gain are stored in ControlSettings, the covariance matrix is only kept in RAM.
+*/
+
+#include "temperatureFormats.h"
+
+// covariance matrix is stored with 15 signed int bits and 17 fraction bits
+typedef int32_t fixed15_17;
+
+#define OVERSHOOT_MODEL_P_LAG (1L<<17)		// 1.0, initial variance of lag. Slopes are in the order of 10 deg/h.
+#define OVERSHOOT_MODEL_P_GAIN (256L<<17)	// 256, initial variance of gain. On times are in the order of 0.1 h.
+#define OVERSHOOT_MODEL_LAMBDA 116508L		// 8/9 forgetting factor in fixed15_17. Dividing by lambda is P += P>>3
+#define OVERSHOOT_MODEL_MAX_LAG (1<<9)		// 1 hour, maximum lag
+#define OVERSHOOT_MODEL_MIN_SLOPE_TIME 120	// seconds, the run slope is not used before the output has been on this long
+
+class OvershootModel{
+	public:
+	OvershootModel(){};
+	~OvershootModel(){};
+
+	void init(void); // reset covariance matrix, next update will almost completely replace the parameters
+
+	// predict overshoot with the current model parameters. slope in deg/hour, onTime in seconds
+	static fixed7_9 predict(fixed7_9 lag, fixed7_9 gain, fixed7_9 slope, uint16_t onTime);
+
+	// remember the temperature and regressors at the moment of switching off
+	void switchOff(fixed7_9 lag, fixed7_9 gain, fixed7_9 temperature, fixed7_9 slope, uint16_t onTime);
+
+	// update lag and gain with the observed overshoot since the last switch off, returns the prediction error
+	fixed7_9 update(fixed7_9 * lag, fixed7_9 * gain, fixed7_9 overshoot);
+
+	fixed7_9 getOffTemp(void){
+		return offTemp;
+	};
+	fixed7_9 getPredictedOvershoot(void){
+		return predictedOvershoot;
+	};
+
+	private:
+	fixed15_17 p[2][2]; // covariance matrix
+	fixed7_9 x[2]; // regressors: slope and on time when switched off
+	fixed7_9 offTemp; // temperature when switched off
+	fixed7_9 predictedOvershoot; // overshoot predicted when switched off
+};
+
+#endif /* OVERSHOOTMODEL_H_ */
\ No newline at end of file
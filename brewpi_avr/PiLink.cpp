@@ -29,6 +29,11 @@
 #include <limits.h>
 #include <string.h>
 #include "jsonKeys.h"
+#include "RuntimeStats.h"
+#include "Ticks.h"
+#include "EventLog.h"
+
+PiLink piLink;
 
 // create a printf like interface to the Arduino Serial function. Format string stored in PROGMEM
 void PiLink::print_P(const char *fmt, ... ){
@@ -37,7 +42,7 @@ void PiLink::print_P(const char *fmt, ... ){
 	va_start (args, fmt );
 	vsnprintf_P(tmp, 128, fmt, args);
 	va_end (args);
-	Serial.print(tmp);
+	write(tmp);
 }
 
 // create a printf like interface to the Arduino Serial function. Format string stored in RAM
@@ -47,11 +52,83 @@ void PiLink::print(char *fmt, ... ){
 	va_start (args, fmt );
 	vsnprintf(tmp, 128, fmt, args);
 	va_end (args);
-	Serial.print(tmp);
+	write(tmp);
+}
+
+bool PiLink::commitPending = false;
+uptime_t PiLink::lastChangeTime;
+char PiLink::bulkType = 0;
+char PiLink::chunk[PILINK_CHUNK_SIZE];
+uint8_t PiLink::chunkLength;
+
+bool PiLink::chunkFrames = false;
+
+void PiLink::write(const char * text){
+	if(bulkType == 0 || !chunkFrames){
+		Serial.print(text);
+		return;
+	}
+	while(*text != 0){
+		chunk[chunkLength++] = *text++;
+		if(chunkLength == PILINK_CHUNK_SIZE){
+			sendChunk('+');
+			servePriorityRequests();
+		}
+	}
+}
+
+void PiLink::beginBulkFrame(char type){
+	bulkType = type;
+	chunkLength = 0;
+	if(!chunkFrames){
+		// one line, like a control frame
+		Serial.write(type);
+		Serial.write(':');
+	}
 }
 
+void PiLink::endBulkFrame(void){
+	if(chunkFrames){
+		sendChunk(':');
+	}
+	else{
+		Serial.write('\n');
+	}
+	bulkType = 0;
+}
+
+void PiLink::sendChunk(char separator){
+	Serial.write(bulkType);
+	Serial.write(separator);
+	Serial.write((const uint8_t *) chunk, chunkLength);
+	Serial.write('\n');
+	chunkLength = 0;
+}
+
+void PiLink::servePriorityRequests(void){
+	char type = bulkType;
+	bulkType = 0; // control frames are sent directly
+	while(Serial.available() > 0 && Serial.peek() == 't'){
+		Serial.read();
+		printTemperatures();
+	}
+	bulkType = type;
+}
+
+bool PiLink::waitForByte(uptime_t start, uint16_t timeout){
+	while(Serial.available() == 0){
+		if(ticks.timeSince(start) >= timeout){
+			return false;
+		}
+	}
+	return true;
+}
+
+// Execute all commands in the receive buffer, until the time budget runs out. The remaining commands are handled on the next call.
 void PiLink::receive(void){
-	if (Serial.available() > 0){
+	commitSettings();
+	uptime_t start = ticks.millis64();
+	while(Serial.available() > 0 && ticks.timeSince(start) < PILINK_RECEIVE_TIME_BUDGET){
 		char inByte = Serial.read();
 		switch(inByte){
 		case 't': // temperatures requested
@@ -61,12 +138,12 @@ void PiLink::receive(void){
 			tempControl.loadDefaultConstants();
 			display.printStationaryText(); // reprint stationary text to update to right degree unit
 			sendControlConstants(); // update script with new settings
-			debugMessage(PSTR("Default constants loaded."));
+			logInfo(LOG_CONTROL, "Default constants loaded.");
 			break;
 		case 'S': // Set default settings
 			tempControl.loadDefaultSettings();
 			sendControlSettings(); // update script with new settings
-			debugMessage(PSTR("Default settings loaded."));
+			logInfo(LOG_CONTROL, "Default settings loaded.");
 			break;
 		case 's': // Control settings requested
 			sendControlSettings();
@@ -77,105 +154,249 @@ void PiLink::receive(void){
 		case 'v': // Control variables requested
 			sendControlVariables();
 			break;	
+		case 'r': // Runtime statistics requested
+			sendRuntimeStatistics();
+			break;
+		case 'R': // Reset runtime statistics
+			runtimeStats.reset();
+			sendRuntimeStatistics();
+			logInfo(LOG_CONTROL, "Runtime statistics reset.");
+			break;
+		case 'e': // Sensor error counters requested
+			sendSensorErrors();
+			break;
+		case 'g': // Buffered events requested
+			sendEvents();
+			break;
 		case 'l': // Display content requested
-			print_P(PSTR("L:"));
-			char stringBuffer[21];
-			for(uint8_t i=0;i<4;i++){
-				display.lcd.getLine(i, stringBuffer);
-				print_P(PSTR("%s<BR>"), stringBuffer);
-			}				
-			print_P(PSTR("\n"));
+			beginBulkFrame('L');
+			printDisplayContent(false);
+			endBulkFrame();
+			break;
+		case 'm': // Display changes since the last 'l' or 'm' requested
+			beginBulkFrame('M');
+			printDisplayChanges();
+			endBulkFrame();
+			break;
+		case 'b': // Batch of requests, answered in one frame
+			receiveBatch();
 			break;
 		case 'j': // Receive settings as json
 			receiveJson();
 			break;
+		case 'y': // Time synchronization
+			receiveTime();
+			break;
+		case 'p': // Snapshot of settings and constants requested
+			sendSnapshot();
+			break;
+		case 'w': // Restore a snapshot of settings and constants
+			receiveSnapshot();
+			break;
 		default:
-			debugMessage(PSTR("Invalid command Received by Arduino: %c"), inByte);
+			logWarning(LOG_LINK, "Invalid command Received by Arduino: %c", inByte);
 		}
 		//Serial.flush(); Messages can be back to back. Flush should not be necessary.
 		// Functions should not read more than what is meant for that function.
 	}
 }
 
-void PiLink::printTemperaturesJSON(char * beerAnnotation, char * fridgeAnnotation){
+void PiLink::printTemperatures(void){
+	print_P(PSTR("T:"));
+	printTemperaturesObject();
+	print_P(PSTR("\n"));
+}
+
+void PiLink::printTemperaturesObject(void){
 	char tempString[9];
-	print_P(PSTR("T:{\"BeerTemp\":%s,"), tempToString(tempString, tempControl.getBeerTemp(), 2, 9));
+	print_P(PSTR("{\"time\":"));
+	printTime(tempControl.getSampleTime());
+	print_P(PSTR(",\"BeerTemp\":%s,"), tempToString(tempString, tempControl.getBeerTemp(), 2, 9));
 	print_P(PSTR("\"BeerSet\":%s,"), tempToString(tempString, tempControl.getBeerSetting(), 2, 9));
-	if(beerAnnotation == 0){
-		print_P(PSTR("\"BeerAnn\":null,"));
-	}
-	else{
-		print_P(PSTR("\"BeerAnn\":\"%s\","), beerAnnotation);
-	}
 	print_P(PSTR("\"FridgeTemp\":%s,"), tempToString(tempString, tempControl.getFridgeTemp(), 2, 9));
-	print_P(PSTR("\"FridgeSet\":%s,"), tempToString(tempString, tempControl.getFridgeSetting(), 2, 9));
-	if(fridgeAnnotation == 0){
-		print_P(PSTR("\"FridgeAnn\":null}\n"));
+	print_P(PSTR("\"FridgeSet\":%s}"), tempToString(tempString, tempControl.getFridgeSetting(), 2, 9));
+}
+
+// display lines separated by <BR>, without a prefix or newline
+// escaped: as the contents of a JSON string, for the batch. The L: frame keeps the raw text.
+void PiLink::printDisplayContent(bool escaped){
+	char stringBuffer[21];
+	for(uint8_t i=0;i<4;i++){
+		display.lcd.getLine(i, stringBuffer);
+		if(escaped){
+			printJsonEscaped(stringBuffer, strlen(stringBuffer));
+			print_P(PSTR("<BR>"));
+		}
+		else{
+			print_P(PSTR("%s<BR>"), stringBuffer);
+		}
 	}
-	else{
-		print_P(PSTR("\"FridgeAnn\":\"%s\"}\n"), fridgeAnnotation);	
+	display.lcd.resetChanges();
+}
+
+/* Display text as the contents of a JSON string: quotes and backslashes get a backslash,
+ the degree sign (0xB0) and other bytes that are not printable ASCII are sent as \u00XX.
+ The escaped text is written in runs of up to PILINK_ESCAPE_RUN characters.
+*/
+void PiLink::printJsonEscaped(const char * text, uint8_t length){
+	char run[PILINK_ESCAPE_RUN + 1];
+	uint8_t runLength = 0;
+	for(uint8_t i = 0; i < length; i++){
+		uint8_t character = text[i];
+		if(character == '"' || character == '\\'){
+			run[runLength++] = '\\';
+			run[runLength++] = character;
+		}
+		else if(character < 0x20 || character >= 0x7F){
+			uint8_t high = character >> 4;
+			uint8_t low = character & 0xF;
+			run[runLength++] = '\\';
+			run[runLength++] = 'u';
+			run[runLength++] = '0';
+			run[runLength++] = '0';
+			run[runLength++] = high < 10 ? '0' + high : 'a' + high - 10;
+			run[runLength++] = low < 10 ? '0' + low : 'a' + low - 10;
+		}
+		else{
+			run[runLength++] = character;
+		}
+		if(runLength > PILINK_ESCAPE_RUN - 6 || i == length - 1){
+			run[runLength] = 0;
+			write(run);
+			runLength = 0;
+		}
 	}
 }
 
-void PiLink::printTemperatures(void){
-	// print all temperatures with empty annotations
-	printTemperaturesJSON(0, 0);
+/* Display cells that changed since the last 'l' or 'm', as runs of [row,column,"text"]:
+ [[1,12,"20.5"],[3,16,"12"]], or [] when nothing changed.
+ The text is escaped with printJsonEscaped(), so the frame stays valid JSON.
+ Changed cells with up to PILINK_DISPLAY_RUN_GAP unchanged cells between them are sent as one run,
+ because a new run costs more characters than the unchanged cells.
+*/
+void PiLink::printDisplayChanges(void){
+	char line[21];
+	bool first = true;
+	print_P(PSTR("["));
+	for(uint8_t row = 0; row < 4; row++){
+		uint32_t changes = display.lcd.getChanges(row);
+		if(changes == 0){
+			continue;
+		}
+		display.lcd.getLine(row, line);
+		uint8_t col = 0;
+		while(col < 20){
+			if(!(changes & (1UL << col))){
+				col++;
+				continue;
+			}
+			uint8_t end = col + 1; // one past the last changed cell of the run
+			uint8_t gap = 0;
+			for(uint8_t next = end; next < 20 && gap <= PILINK_DISPLAY_RUN_GAP; next++){
+				if(changes & (1UL << next)){
+					end = next + 1;
+					gap = 0;
+				}
+				else{
+					gap++;
+				}
+			}
+			print_P(first ? PSTR("[%u,%u,\"") : PSTR(",[%u,%u,\""), row, col);
+			printJsonEscaped(&line[col], end - col);
+			print_P(PSTR("\"]"));
+			first = false;
+			col = end;
+		}
+	}
+	print_P(PSTR("]"));
+	display.lcd.resetChanges();
 }
 
-void PiLink::printBeerAnnotation(const char * annotation, ...){
-	char tempString[128]; // resulting string limited to 128 chars
-	va_list args;	
-	// Using print_P for the Annotation fails. Arguments are not passed correctly. Use Serial directly as a work around.
-	va_start (args, annotation );
-	vsnprintf_P(tempString, 128, annotation, args);
-	va_end (args);
-	printTemperaturesJSON(tempString, 0);
-	va_end (args);
+// Send the buffered events as G:{"seq":first sequence number,"lost":dropped events,"events":[[time,code,args...],...]}
+// The time is the Unix time when the event was raised.
+// The events are removed from the buffer, the host renders the text from the code.
+void PiLink::sendEvents(void){
+	print_P(PSTR("G:"));
+	printEvents();
+	print_P(PSTR("\n"));
 }
 
-void PiLink::printFridgeAnnotation(const char * annotation, ...){
-	char tempString[128]; // resulting string limited to 128 chars
-	va_list args;	
-	// Using print_P for the Annotation fails. Arguments are not passed correctly. Use Serial directly as a work around.
-	va_start (args, annotation );
-	vsnprintf_P(tempString, 128, annotation, args);
-	va_end (args);
-	printTemperaturesJSON(0, tempString);
-	va_end (args);
-}	  
+void PiLink::printEvents(void){
+	print_P(PSTR("{\"seq\":%u,\"lost\":%u,\"events\":["), eventLog.firstSequence(), eventLog.lost());
+	for(uint8_t i = 0; i < eventLog.count(); i++){
+		const Event & event = eventLog.peek(i);
+		print_P(i == 0 ? PSTR("[") : PSTR(",["));
+		printTime(event.time);
+		print_P(PSTR(",%u"), event.code);
+		for(uint8_t arg = 0; arg < event.numArgs; arg++){
+			print_P(PSTR(",%d"), event.args[arg]);
+		}
+		print_P(PSTR("]"));
+	}
+	print_P(PSTR("]}"));
+	eventLog.clear();
+}
  	  
-void PiLink::debugMessage(const char * message, ...){
-	char tempString[128]; // resulting string limited to 128 chars
+uint8_t PiLink::logLevel = LOG_LEVEL_INFO;
+uint8_t PiLink::logMask = LOG_ALL_MODULES;
+
+static const char logLevelNames[][8] PROGMEM = { "debug", "info", "warning", "error" };
+static const char logModuleNames[][8] PROGMEM = { "sensor", "control", "link", "menu", "eeprom" };
+
+void PiLink::logMessage(uint8_t level, uint8_t module, const char * message, ...){
+	if(level < logLevel || (module & logMask) == 0){
+		return; // filtered before formatting
+	}
+	uint8_t moduleIndex = 0;
+	while((module >>= 1) != 0){
+		moduleIndex++;
+	}
+	char tempString[128]; // prefix and message limited to 128 chars
+	uint8_t length = snprintf_P(tempString, sizeof(tempString), PSTR("D:[%S %S] "), logLevelNames[level], logModuleNames[moduleIndex]);
 	va_list args;
-	
-	//print 'D:' as prefix
-	print_P(PSTR("D:"));
-	
-	// Using print_P for the Annotation fails. Arguments are not passed correctly. Use Serial directly as a work around.
 	va_start (args, message );
-	vsnprintf_P(tempString, 128, message, args);
+	vsnprintf_P(tempString + length, sizeof(tempString) - length, message, args);
 	va_end (args);
-	Serial.print(tempString);
-
-	print_P(PSTR("\n")); // print newline
+	
+	// A log message is a control frame, also when it is raised while a bulk frame is being sent:
+	// the complete line is sent directly, not added to the chunk of the bulk frame.
+	char type = bulkType;
+	bulkType = 0;
+	write(tempString);
+	write("\n");
+	bulkType = type;
 }
 
 // Send settings as JSON string
 void PiLink::sendControlSettings(void){
+	beginBulkFrame('S');
+	printControlSettings();
+	endBulkFrame();
+}
+
+void PiLink::printControlSettings(void){
 	char tempString[12];
-	print_P(PSTR("S:{"));
+	print_P(PSTR("{"));
 	sendJsonPair(jsonKeys.mode, tempControl.cs.mode);
 	sendJsonPair(jsonKeys.beerSetting, tempToString(tempString, tempControl.cs.beerSetting, 2, 12));
 	sendJsonPair(jsonKeys.fridgeSetting, tempToString(tempString, tempControl.cs.fridgeSetting, 2, 12));
 	sendJsonPair(jsonKeys.heatEstimator, fixedPointToString(tempString, tempControl.cs.heatEstimator, 3, 12));
+	sendJsonPair(jsonKeys.coolEstimator, fixedPointToString(tempString, tempControl.cs.coolEstimator, 3, 12));
+	sendJsonPair(jsonKeys.heatLag, fixedPointToString(tempString, tempControl.cs.heatLag, 3, 12));
 	// last one 'manually' to have no trailing comma
-	print_P(PSTR("\"%s\":%s}\n"), jsonKeys.coolEstimator, fixedPointToString(tempString, tempControl.cs.coolEstimator, 3, 12));
+	print_P(PSTR("\"%s\":%s}"), jsonKeys.coolLag, fixedPointToString(tempString, tempControl.cs.coolLag, 3, 12));
 }
 
 // Send control constants as JSON string. Might contain spaces between minus sign and number. Python will have to strip these
 void PiLink::sendControlConstants(void){
+	beginBulkFrame('C');
+	printControlConstants();
+	endBulkFrame();
+}
+
+void PiLink::printControlConstants(void){
 	char tempString[12];
-	print_P(PSTR("C:{"));
+	print_P(PSTR("{"));
 	sendJsonPair(jsonKeys.tempFormat, tempControl.cc.tempFormat);
 	sendJsonPair(jsonKeys.tempSettingMin, tempToString(tempString, tempControl.cc.tempSettingMin, 1, 12));
 	sendJsonPair(jsonKeys.tempSettingMax, tempToString(tempString, tempControl.cc.tempSettingMax, 1, 12));
@@ -201,14 +422,32 @@ void PiLink::sendControlConstants(void){
 	sendJsonPair(jsonKeys.fridgeSlopeFilter, tempControl.cc.fridgeSlopeFilter);
 	sendJsonPair(jsonKeys.beerFastFilter, tempControl.cc.beerFastFilter);
 	sendJsonPair(jsonKeys.beerSlowFilter, tempControl.cc.beerSlowFilter);
+	sendJsonPair(jsonKeys.beerSlopeFilter, tempControl.cc.beerSlopeFilter);
+	
+	sendJsonPair(jsonKeys.pwmGain, fixedPointToString(tempString, tempControl.cc.pwmGain, 3, 12));
+	sendJsonPair(jsonKeys.heatPwmWindow, tempControl.cc.heatPwmWindow);
+	sendJsonPair(jsonKeys.heatMinOn, tempControl.cc.heatMinOn);
+	sendJsonPair(jsonKeys.heatMinOff, tempControl.cc.heatMinOff);
+	sendJsonPair(jsonKeys.coolPwmWindow, tempControl.cc.coolPwmWindow);
+	sendJsonPair(jsonKeys.coolMinOn, tempControl.cc.coolMinOn);
+	sendJsonPair(jsonKeys.coolMinOff, tempControl.cc.coolMinOff);
+	sendJsonPair(jsonKeys.heatPower, tempControl.cc.heatPower);
+	sendJsonPair(jsonKeys.coolPower, tempControl.cc.coolPower);
+	sendJsonPair(jsonKeys.spikeMinDeviation, tempDiffToString(tempString, tempControl.cc.spikeMinDeviation, 3, 12));
 	// last one 'manually' to have no trailing comma
-	print_P(PSTR("\"%s\":%u}\n"), jsonKeys.beerSlopeFilter, tempControl.cc.beerSlopeFilter);
+	print_P(PSTR("\"%s\":%u}"), jsonKeys.spikeMadFactor, tempControl.cc.spikeMadFactor);
 }
 
 // Send all control variables. Useful for debugging and choosing parameters
 void PiLink::sendControlVariables(void){
+	beginBulkFrame('V');
+	printControlVariables();
+	endBulkFrame();
+}
+
+void PiLink::printControlVariables(void){
 	char tempString[12];
-	print_P(PSTR("V:{"));
+	print_P(PSTR("{"));
 	sendJsonPair(jsonKeys.beerDiff, tempDiffToString(tempString, tempControl.cv.beerDiff, 3, 12));
 	sendJsonPair(jsonKeys.diffIntegral, tempDiffToString(tempString, tempControl.cv.diffIntegral, 3, 12));
 	sendJsonPair(jsonKeys.beerSlope, tempDiffToString(tempString, tempControl.cv.beerSlope, 3, 12));
@@ -221,7 +460,239 @@ void PiLink::sendControlVariables(void){
 	sendJsonPair(jsonKeys.negPeakSetting, tempToString(tempString, tempControl.cv.negPeakSetting, 3, 12));
 	sendJsonPair(jsonKeys.posPeakSetting, tempToString(tempString, tempControl.cv.posPeakSetting, 3, 12));
 	sendJsonPair(jsonKeys.negPeak, tempToString(tempString, tempControl.cv.negPeak, 3, 12));
-	print_P(PSTR("\"%s\":%s}\n"), jsonKeys.posPeak, tempToString(tempString, tempControl.cv.posPeak, 3, 12));
+	sendJsonPair(jsonKeys.posPeak, tempToString(tempString, tempControl.cv.posPeak, 3, 12));
+	print_P(PSTR("\"%s\":%s}"), jsonKeys.duty, fixedPointToString(tempString, tempControl.cv.duty, 3, 12));
+}
+
+// Send runtime statistics. Times are in seconds, energy in Wh. The script can calculate starts per hour from the difference between two requests.
+void PiLink::sendRuntimeStatistics(void){
+	beginBulkFrame('R');
+	printRuntimeStatistics();
+	endBulkFrame();
+}
+
+void PiLink::printRuntimeStatistics(void){
+	RuntimeStatistics & rs = runtimeStats.rs;
+	print_P(PSTR("{"));
+	sendJsonPair(jsonKeys.timeCooling, rs.stateTime[COOLING]);
+	sendJsonPair(jsonKeys.timeHeating, rs.stateTime[HEATING]);
+	sendJsonPair(jsonKeys.timeIdle, rs.stateTime[IDLE]);
+	sendJsonPair(jsonKeys.timeDoorOpen, rs.stateTime[DOOR_OPEN]);
+	sendJsonPair(jsonKeys.timeOff, rs.stateTime[STATE_OFF]);
+	sendJsonPair(jsonKeys.countCooling, rs.stateCount[COOLING]);
+	sendJsonPair(jsonKeys.countHeating, rs.stateCount[HEATING]);
+	sendJsonPair(jsonKeys.countIdle, rs.stateCount[IDLE]);
+	sendJsonPair(jsonKeys.countDoorOpen, rs.stateCount[DOOR_OPEN]);
+	sendJsonPair(jsonKeys.countOff, rs.stateCount[STATE_OFF]);
+	sendJsonPair(jsonKeys.heatStarts, rs.heatStarts);
+	sendJsonPair(jsonKeys.coolStarts, rs.coolStarts);
+	sendJsonPair(jsonKeys.heatOnTime, rs.heatOnTime);
+	sendJsonPair(jsonKeys.coolOnTime, rs.coolOnTime);
+	sendJsonPair(jsonKeys.heatEnergy, runtimeStats.heatEnergy());
+	// last one 'manually' to have no trailing comma
+	print_P(PSTR("\"%s\":%lu}"), jsonKeys.coolEnergy, runtimeStats.coolEnergy());
+}
+
+void PiLink::sendSensorErrors(void){
+	beginBulkFrame('E');
+	printSensorErrors();
+	endBulkFrame();
+}
+
+void PiLink::printSensorErrors(void){
+	TempSensorErrors & beer = tempControl.beerSensor.errors;
+	TempSensorErrors & fridge = tempControl.fridgeSensor.errors;
+	print_P(PSTR("{"));
+	sendJsonPair(jsonKeys.beerNoPresence, beer.noPresence);
+	sendJsonPair(jsonKeys.beerCrcErrors, beer.crc);
+	sendJsonPair(jsonKeys.beerPowerOn, beer.powerOn);
+	sendJsonPair(jsonKeys.beerDropped, beer.dropped);
+	sendJsonPair(jsonKeys.beerSpikes, beer.spikes);
+	sendJsonPair(jsonKeys.fridgeNoPresence, fridge.noPresence);
+	sendJsonPair(jsonKeys.fridgeCrcErrors, fridge.crc);
+	sendJsonPair(jsonKeys.fridgePowerOn, fridge.powerOn);
+	sendJsonPair(jsonKeys.fridgeDropped, fridge.dropped);
+	// last one 'manually' to have no trailing comma
+	print_P(PSTR("\"%s\":%u}"), jsonKeys.fridgeSpikes, fridge.spikes);
+}
+
+/* Receive a batch of requests: 'b', the request characters and a newline, for example "btscv\n".
+ The answer is one frame with the reply type as key for each request:
+ B:{"T":{...},"S":{...},"C":{...},"V":{...}}
+ Only the requests that do not change any settings can be batched: t, s, c, v, r, e, g, l and m.
+ The display content of 'l' is sent as a string.
+*/
+void PiLink::receiveBatch(void){
+	char requests[PILINK_MAX_BATCH + 1];
+	uint8_t count = 0;
+	uptime_t start = ticks.millis64();
+	// the rest of the batch can still be underway
+	while(waitForByte(start, PILINK_BATCH_TIMEOUT)){
+		char request = Serial.read();
+		if(request == '\n' || request == '\r'){
+			break;
+		}
+		if(count < PILINK_MAX_BATCH && strchr_P(PSTR("tscvreglm"), request) != NULL){
+			requests[count++] = request;
+		}
+	}
+	requests[count] = 0;
+	
+	beginBulkFrame('B');
+	print_P(PSTR("{"));
+	for(uint8_t i = 0; i < count; i++){
+		if(i > 0){
+			print_P(PSTR(","));
+		}
+		print_P(PSTR("\"%c\":"), requests[i] - 'a' + 'A'); // key is the type of the normal reply
+		switch(requests[i]){
+		case 't':
+			printTemperaturesObject();
+			break;
+		case 's':
+			printControlSettings();
+			break;
+		case 'c':
+			printControlConstants();
+			break;
+		case 'v':
+			printControlVariables();
+			break;
+		case 'r':
+			printRuntimeStatistics();
+			break;
+		case 'e':
+			printSensorErrors();
+			break;
+		case 'g':
+			printEvents();
+			break;
+		case 'l':
+			print_P(PSTR("\""));
+			printDisplayContent(true);
+			print_P(PSTR("\""));
+			break;
+		case 'm':
+			printDisplayChanges();
+			break;
+		}
+	}
+	print_P(PSTR("}"));
+	endBulkFrame();
+}
+
+/* Receive the Unix time of the host: 'y', seconds, optionally a dot and milliseconds, and a newline: "y1356994800.250\n"
+ Without a time ("y\n"), the clock is only read. The answer is the time of the firmware after the update: Y:{"time":1356994800.251}
+ The host can use the round trip time of the answer to estimate the accuracy of the synchronization.
+*/
+void PiLink::receiveTime(void){
+	char buffer[16];
+	uint8_t length = 0;
+	char character = 0;
+	uptime_t start = ticks.millis64();
+	while(waitForByte(start, PILINK_BATCH_TIMEOUT)){
+		character = Serial.read();
+		if(character == '\n' || character == '\r'){
+			break;
+		}
+		if(length < sizeof(buffer) - 1){
+			buffer[length++] = character;
+		}
+	}
+	buffer[length] = 0;
+	if(length > 0 && (character == '\n' || character == '\r')){
+		char * end;
+		uint32_t seconds = strtoul(buffer, &end, 10);
+		uint16_t milliseconds = 0;
+		if(*end == '.'){
+			// the first 3 decimals are milliseconds
+			uint16_t scale = 100;
+			for(char * digit = end + 1; *digit >= '0' && *digit <= '9' && scale > 0; digit++){
+				milliseconds += (*digit - '0') * scale;
+				scale /= 10;
+			}
+		}
+		ticks.setEpoch(seconds, milliseconds);
+	}
+	print_P(PSTR("Y:{\"time\":"));
+	printTime(ticks.millis64());
+	print_P(PSTR("}\n"));
+}
+
+void PiLink::printTime(uptime_t timestamp){
+	uint32_t seconds;
+	uint16_t milliseconds;
+	ticks.toEpoch(timestamp, &seconds, &milliseconds);
+	print_P(PSTR("%lu.%03u"), seconds, milliseconds);
+}
+
+/* Snapshots of settings and constants are sent as hexadecimal text, so they fit in the line based protocol:
+ P:b70659...\n, the bytes of SettingsSnapshot (see TempControl.h). The host stores the text as it is.
+ To restore, the host sends 'w', the same hexadecimal text and a newline: w b70659...\n
+ The answer is W:{"result":0}, with one of the SNAPSHOT_ results. Nothing is changed unless the result is 0 (SNAPSHOT_OK).
+*/
+void PiLink::sendSnapshot(void){
+	SettingsSnapshot snapshot;
+	tempControl.createSnapshot(&snapshot);
+	const uint8_t * bytes = (const uint8_t *) &snapshot;
+	beginBulkFrame('P');
+	for(uint8_t i = 0; i < sizeof(SettingsSnapshot); i++){
+		print_P(PSTR("%02x"), bytes[i]);
+	}
+	endBulkFrame();
+}
+
+static int8_t hexValue(char character){
+	if(character >= '0' && character <= '9'){
+		return character - '0';
+	}
+	if(character >= 'a' && character <= 'f'){
+		return character - 'a' + 10;
+	}
+	if(character >= 'A' && character <= 'F'){
+		return character - 'A' + 10;
+	}
+	return -1;
+}
+
+void PiLink::receiveSnapshot(void){
+	SettingsSnapshot snapshot;
+	uint8_t * bytes = (uint8_t *) &snapshot;
+	uint8_t length = 0; // complete bytes received
+	bool highNibble = true;
+	bool valid = true;
+	char character = 0;
+	uptime_t start = ticks.millis64();
+	while(waitForByte(start, PILINK_SNAPSHOT_TIMEOUT)){
+		character = Serial.read();
+		if(character == '\n' || character == '\r'){
+			break;
+		}
+		int8_t value = hexValue(character);
+		if(value < 0){
+			continue; // skip spaces
+		}
+		if(length >= sizeof(SettingsSnapshot)){
+			valid = false; // too long
+			continue;
+		}
+		if(highNibble){
+			bytes[length] = value << 4;
+		}
+		else{
+			bytes[length++] |= value;
+		}
+		highNibble = !highNibble;
+	}
+	uint8_t result = SNAPSHOT_INVALID;
+	if(valid && length == sizeof(SettingsSnapshot) && highNibble && (character == '\n' || character == '\r')){
+		result = tempControl.restoreSnapshot(&snapshot);
+	}
+	if(result == SNAPSHOT_OK){
+		display.printStationaryText(); // the temperature format can be changed
+		logInfo(LOG_EEPROM, "Settings snapshot restored");
+	}
+	print_P(PSTR("W:{\"result\":%u}\n"), result);
 }
 
 void PiLink::sendJsonPair(const char * name, char * val){
@@ -236,22 +707,46 @@ void PiLink::sendJsonPair(const char * name, uint16_t val){
 	print_P(PSTR("\"%s\":%u,"), name, val);
 }
 
+void PiLink::sendJsonPair(const char * name, uint32_t val){
+	print_P(PSTR("\"%s\":%lu,"), name, val);
+}
+
+/* Receive settings as JSON pairs: {"key":value,"key":value}
+ Without an "id" key, all settings are stored to EEPROM and sent back when the closing brace is received.
+ With an "id" key (a number chosen by the host), the update is a transaction:
+ - the answer is A:{"id":12,"applied":["beerSetting"],"rejected":0} when the update was received completely,
+   or N:{...} with the same content when it was cut off or a key or value was too long.
+   Pairs received before the error have been applied.
+ - settings and constants are not sent back.
+ - the EEPROM is written once, PILINK_COMMIT_DELAY after the last transaction, so a burst of small updates is stored at once.
+*/
 void PiLink::receiveJson(void){
 	char key[30];
 	char val[30];
 	uint8_t index=0;
 	char character=0;
-	delay(1);
-	while(Serial.available() > 0){ // outer while loop can process multiple pairs
+	bool complete = false;
+	bool hasId = false;
+	uint16_t id = 0;
+	uint8_t rejected = 0;
+	uint8_t applied[(NUM_JSON_KEYS + 7) / 8]; // one bit per key in jsonKeys
+	memset(applied, 0, sizeof(applied));
+	
+	// characters that are still underway are waited for, up to PILINK_BYTE_TIMEOUT after the previous one
+	uptime_t lastByteTime = ticks.millis64();
+	while(!complete && waitForByte(lastByteTime, PILINK_BYTE_TIMEOUT)){ // outer while loop can process multiple pairs
 		index=0;
-		while(Serial.available() > 0) // get key
+		while(waitForByte(lastByteTime, PILINK_BYTE_TIMEOUT)) // get key
 		{
-			delay(1);
+			lastByteTime = ticks.millis64();
 			character = Serial.read();
 			if(character == ':'){		
 				// value comes now
 				break;
 			}
+			else if(character == '}' || character == '\n'){
+				break; // end of the update without a value
+			}
 			else if(character == ' ' || character == '{' || character == '"'){
 				;
 			}
@@ -260,14 +755,17 @@ void PiLink::receiveJson(void){
 			}
 			if(index>=29)
 			{
-				return; // value was too long, don't process anything
+				break; // value was too long, don't process anything
 			}
 		}
+		if(index>=29 || character != ':'){
+			break; // key was too long or the update was cut off
+		}
 		key[index]=0; // null terminate string
 		index = 0;
-		while(Serial.available() > 0) // get value
+		while(waitForByte(lastByteTime, PILINK_BYTE_TIMEOUT)) // get value
 		{
-			delay(1);
+			lastByteTime = ticks.millis64();
 			character = Serial.read();
 			if(character == ',' || character == '}'){
 				// end of value
@@ -281,50 +779,112 @@ void PiLink::receiveJson(void){
 			}
 			if(index>=29)
 			{
-				return; // value was too long, don't process anything
+				break; // value was too long, don't process anything
 			}
 		}
+		if(index>=29 || (character != ',' && character != '}')){
+			break;
+		}
 		val[index]=0; // null terminate string
-		processJsonPair(key,val);
 		
-		if(character == '}'){
-			// this was the last pair.
+		if(strcmp_P(key, PSTR("id")) == 0){
+			id = strtoul(val, NULL, 10);
+			hasId = true;
+		}
+		else if(processJsonPair(key,val)){
+			uint8_t keyIndex = jsonKeyIndex(key);
+			applied[keyIndex / 8] |= 1 << (keyIndex % 8);
+		}
+		else{
+			rejected++;
+		}
+		complete = (character == '}'); // this was the last pair
+	}
+	if(!complete && character != '}' && character != '\n'){
+		// skip the rest of the update up to the closing brace or a newline, so it is not executed as commands
+		while(waitForByte(lastByteTime, PILINK_BYTE_TIMEOUT)){
+			lastByteTime = ticks.millis64();
+			character = Serial.read();
+			if(character == '}' || character == '\n'){
+				break;
+			}
+		}
+	}
+	
+	if(!hasId){
+		if(complete){
 			tempControl.storeSettings(); // store new settings to EEPROM
 			tempControl.storeConstants();
 			sendControlSettings(); // update script with new settings
 			sendControlConstants();
-			return;
+		}
+		return;
+	}
+	
+	commitPending = true;
+	lastChangeTime = ticks.millis64();
+	
+	print_P(complete ? PSTR("A:{\"id\":%u,\"applied\":[") : PSTR("N:{\"id\":%u,\"applied\":["), id);
+	bool first = true;
+	const char * const * keys = (const char * const *) &jsonKeys;
+	for(uint8_t i = 0; i < NUM_JSON_KEYS; i++){
+		if(applied[i / 8] & (1 << (i % 8))){
+			print_P(first ? PSTR("\"%s\"") : PSTR(",\"%s\""), keys[i]);
+			first = false;
+		}
+	}
+	print_P(PSTR("],\"rejected\":%u}\n"), rejected);
+}
+
+// position of a key in jsonKeys
+uint8_t PiLink::jsonKeyIndex(const char * key){
+	const char * const * keys = (const char * const *) &jsonKeys;
+	for(uint8_t i = 0; i < NUM_JSON_KEYS; i++){
+		if(strcmp(key, keys[i]) == 0){
+			return i;
 		}
 	}
+	return 0;
 }
 
-void PiLink::processJsonPair(char * key, char * val){
-	debugMessage(PSTR("Received new setting: %s = %s"), key, val);
+// store settings and constants updated by transactions, when no update was received for a while
+void PiLink::commitSettings(void){
+	if(commitPending && ticks.timeSince(lastChangeTime) >= PILINK_COMMIT_DELAY){
+		tempControl.storeSettings();
+		tempControl.storeConstants();
+		commitPending = false;
+	}
+}
+
+bool PiLink::processJsonPair(char * key, char * val){
+	logDebug(LOG_LINK, "Received new setting: %s = %s", key, val);
 	if(strcmp(key,jsonKeys.mode) == 0){
 		tempControl.setMode(val[0]);
-		piLink.printFridgeAnnotation(PSTR("Mode set to %c in web interface"), val[0]);
+		eventLog.add(EVENT_MODE_CHANGED_WEB, val[0]);
 	}
 	else if(strcmp(key,jsonKeys.beerSetting) == 0){ 
 		fixed7_9 newTemp = stringToTemp(val);
 		if(tempControl.cs.mode == 'p'){
 			if(abs(newTemp-tempControl.cs.beerSetting) > 100){ // this excludes gradual updates under 0.2 degrees
-				printBeerAnnotation(PSTR("Beer temperature setting changed to %s by temperature profile."), val);
+				eventLog.add(EVENT_BEER_SETTING_CHANGED_PROFILE, newTemp);
 			}
 		}
 		else{
-			printBeerAnnotation(PSTR("Beer temperature setting changed to %s in web interface."), val);
+			eventLog.add(EVENT_BEER_SETTING_CHANGED_WEB, newTemp);
 		}
 		tempControl.cs.beerSetting = newTemp;
 	}
 	else if(strcmp(key,jsonKeys.fridgeSetting) == 0){
 		fixed7_9 newTemp = stringToTemp(val);
 		if(tempControl.cs.mode == 'f'){
-			printFridgeAnnotation(PSTR("Fridge temperature setting changed to %s in web interface."), val);
+			eventLog.add(EVENT_FRIDGE_SETTING_CHANGED_WEB, newTemp);
 		}
 		tempControl.cs.fridgeSetting = newTemp;
 	}
 	else if(strcmp(key,jsonKeys.heatEstimator) == 0){ tempControl.cs.heatEstimator = stringToFixedPoint(val); }
 	else if(strcmp(key,jsonKeys.coolEstimator) == 0){ tempControl.cs.coolEstimator = stringToFixedPoint(val); }
+	else if(strcmp(key,jsonKeys.heatLag) == 0){ tempControl.cs.heatLag = stringToFixedPoint(val); }
+	else if(strcmp(key,jsonKeys.coolLag) == 0){ tempControl.cs.coolLag = stringToFixedPoint(val); }
 	else if(strcmp(key,jsonKeys.tempFormat) == 0){
 		tempControl.cc.tempFormat = val[0];
 		display.printStationaryText(); // reprint stationary text to update to right degree unit
@@ -375,7 +935,47 @@ void PiLink::processJsonPair(char * key, char * val){
 		tempControl.cc.beerSlopeFilter = strtoul(val, NULL, 10);
 		tempControl.beerSensor.setSlopeFilterCoefficients(tempControl.cc.beerSlopeFilter);
 	}
+	else if(strcmp(key,jsonKeys.pwmGain) == 0){ tempControl.cc.pwmGain = stringToFixedPoint(val); }
+	else if(strcmp(key,jsonKeys.heatPwmWindow) == 0){
+		tempControl.cc.heatPwmWindow = strtoul(val, NULL, 10);
+		tempControl.updateOutputConstraints();
+	}
+	else if(strcmp(key,jsonKeys.heatMinOn) == 0){
+		tempControl.cc.heatMinOn = strtoul(val, NULL, 10);
+		tempControl.updateOutputConstraints();
+	}
+	else if(strcmp(key,jsonKeys.heatMinOff) == 0){
+		tempControl.cc.heatMinOff = strtoul(val, NULL, 10);
+		tempControl.updateOutputConstraints();
+	}
+	else if(strcmp(key,jsonKeys.coolPwmWindow) == 0){
+		tempControl.cc.coolPwmWindow = strtoul(val, NULL, 10);
+		tempControl.updateOutputConstraints();
+	}
+	else if(strcmp(key,jsonKeys.coolMinOn) == 0){
+		tempControl.cc.coolMinOn = strtoul(val, NULL, 10);
+		tempControl.updateOutputConstraints();
+	}
+	else if(strcmp(key,jsonKeys.coolMinOff) == 0){
+		tempControl.cc.coolMinOff = strtoul(val, NULL, 10);
+		tempControl.updateOutputConstraints();
+	}
+	else if(strcmp(key,jsonKeys.heatPower) == 0){ tempControl.cc.heatPower = strtoul(val, NULL, 10); }
+	else if(strcmp(key,jsonKeys.coolPower) == 0){ tempControl.cc.coolPower = strtoul(val, NULL, 10); }
+	else if(strcmp(key,jsonKeys.spikeMinDeviation) == 0){
+		tempControl.cc.spikeMinDeviation = stringToTempDiff(val);
+		tempControl.updateSpikeFilters();
+	}
+	else if(strcmp(key,jsonKeys.spikeMadFactor) == 0){
+		tempControl.cc.spikeMadFactor = constrain(strtoul(val, NULL, 10), 0, 255); // SpikeFilter uses 8 bits
+		tempControl.updateSpikeFilters();
+	}
+	else if(strcmp(key,jsonKeys.logLevel) == 0){ logLevel = constrain(strtoul(val, NULL, 10), LOG_LEVEL_DEBUG, LOG_LEVEL_ERROR); }
+	else if(strcmp(key,jsonKeys.logMask) == 0){ logMask = strtoul(val, NULL, 10) & LOG_ALL_MODULES; }
+	else if(strcmp(key,jsonKeys.chunkFrames) == 0){ chunkFrames = (strtoul(val, NULL, 10) != 0); }
 	else{
-		debugMessage(PSTR("Could not process setting"));
+		logWarning(LOG_LINK, "Could not process setting %s", key);
+		return false;
 	}
+	return true;
 }
\ No newline at end of file
@@ -21,6 +21,78 @@
 #define PILINK_H_
 
 #include "temperatureFormats.h"
+#include "Ticks.h"
+
+#define PILINK_RECEIVE_TIME_BUDGET 50 // milliseconds receive() may spend on commands that are already in the buffer
+#define PILINK_MAX_BATCH 8 // requests in one batch
+#define PILINK_BATCH_TIMEOUT 100 // milliseconds to wait for the end of a batch, or the rest of a time synchronization
+#define PILINK_BYTE_TIMEOUT 10 // milliseconds to wait for the next character of a JSON update
+#define PILINK_COMMIT_DELAY 1000 // milliseconds without settings updates before they are written to EEPROM
+#define PILINK_CHUNK_SIZE 48 // characters of a bulk frame per line, about 8 ms at 57600 baud
+#define PILINK_SNAPSHOT_TIMEOUT 500 // milliseconds to wait for the rest of a settings snapshot
+#define PILINK_ESCAPE_RUN 24 // characters of escaped display text that are buffered before they are written
+#define PILINK_DISPLAY_RUN_GAP 3 // unchanged display cells between two changed cells that are sent in one run
+
+/* Receive time
+ The time budget is checked between commands: receive() starts no new command after PILINK_RECEIVE_TIME_BUDGET.
+ A command that has started is always received completely, because the rest of it cannot be told apart from new
+ commands. Its reader waits for characters that are still underway, up to PILINK_BATCH_TIMEOUT for a batch or a time
+ synchronization, PILINK_SNAPSHOT_TIMEOUT for a snapshot and PILINK_BYTE_TIMEOUT between two characters of a JSON update.
+ Characters that are already in the buffer are read without waiting. So receive() can take the budget,
+ plus the time to receive and answer the last command, plus one of these timeouts when that command was cut off.
+*/
+
+/* Frames and channels
+ Every frame is one line that starts with its type character, which is the channel the host demultiplexes on.
+ Control frames (T, G, Y, A, N, W and D) are short and are always sent as one line: "T:{...}\n".
+ Bulk frames (S, C, V, R, E, L, M, P and B) are also sent as one line, unless the host enables chunks with
+ j{"chunkFrames":1}. Then they are sent in chunks of PILINK_CHUNK_SIZE characters: "C+{...\n" for every chunk
+ but the last, which is sent as "C:...}\n". The host appends the chunks until the line with the colon.
+ Between two chunks, requests for temperatures ('t') that are waiting in the receive buffer are answered,
+ so they preempt the rest of the bulk frame. Their worst case latency is one chunk instead of a complete dump.
+ Chunks are off after a restart, so hosts that do not know them keep working. Like logLevel, the setting is not stored.
+*/
+
+/* Log messages, sent as D:[level module] message
+ Messages below LOG_LEVEL_MIN are removed at compile time, including the format string and the evaluation of the arguments.
+ Set LOG_LEVEL_MIN to LOG_LEVEL_DEBUG in the build to get the debug messages.
+ Above it, messages are filtered at runtime by logLevel and logMask before they are formatted.
+ Both can be set over PiLink: j{"logLevel":0,"logMask":31}. They are not stored in EEPROM.
+ The format string is always stored in PROGMEM, pass it without PSTR().
+*/
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_WARNING 2
+#define LOG_LEVEL_ERROR 3
+
+#ifndef LOG_LEVEL_MIN
+#define LOG_LEVEL_MIN LOG_LEVEL_INFO
+#endif
+
+// modules, one bit each in logMask
+#define LOG_SENSOR 0x01
+#define LOG_CONTROL 0x02
+#define LOG_LINK 0x04
+#define LOG_MENU 0x08
+#define LOG_EEPROM 0x10
+#define LOG_ALL_MODULES 0x1F
+
+#if LOG_LEVEL_MIN <= LOG_LEVEL_DEBUG
+#define logDebug(module, message, ...) PiLink::logMessage(LOG_LEVEL_DEBUG, module, PSTR(message), ##__VA_ARGS__)
+#else
+#define logDebug(module, message, ...)
+#endif
+#if LOG_LEVEL_MIN <= LOG_LEVEL_INFO
+#define logInfo(module, message, ...) PiLink::logMessage(LOG_LEVEL_INFO, module, PSTR(message), ##__VA_ARGS__)
+#else
+#define logInfo(module, message, ...)
+#endif
+#if LOG_LEVEL_MIN <= LOG_LEVEL_WARNING
+#define logWarning(module, message, ...) PiLink::logMessage(LOG_LEVEL_WARNING, module, PSTR(message), ##__VA_ARGS__)
+#else
+#define logWarning(module, message, ...)
+#endif
+#define logError(module, message, ...) PiLink::logMessage(LOG_LEVEL_ERROR, module, PSTR(message), ##__VA_ARGS__)
 
 class PiLink{
 	public:
@@ -32,26 +104,60 @@ class PiLink{
 	static void print_P(const char *fmt, ...); // use when format string is stored in PROGMEM with PSTR("string")
 	
 	static void printTemperatures(void);
-	static void printBeerAnnotation(const char * annotation, ...);
-	static void printFridgeAnnotation(const char * annotation, ...);
-	static void debugMessage(const char * message, ...);
+	static void logMessage(uint8_t level, uint8_t module, const char * message, ...); // use the log macros above
 	
 	static void sendControlSettings(void);
 	static void receiveControlConstants(void);
 	static void sendControlConstants(void);
 	static void sendControlVariables(void);
+	static void sendRuntimeStatistics(void);
+	static void sendSensorErrors(void);
+	static void sendEvents(void);
 	
 	static void receiveJson(void); // receive settings as JSON key:value pairs
+	static void receiveBatch(void); // receive requests that are answered in one frame
+	static void receiveTime(void); // synchronize the clock with the host
+	static void sendSnapshot(void); // settings and constants as one binary snapshot
+	static void receiveSnapshot(void); // restore a snapshot made with sendSnapshot()
 	
 	
 	private:
-	static void printTemperaturesJSON(char * beerAnnotation, char * fridgeAnnotation);
+	// JSON objects of the replies, without prefix and newline, so they can be combined in a batch
+	static void printTemperaturesObject(void);
+	static void printControlSettings(void);
+	static void printControlConstants(void);
+	static void printControlVariables(void);
+	static void printRuntimeStatistics(void);
+	static void printSensorErrors(void);
+	static void printEvents(void);
+	static void printDisplayContent(bool escaped); // escaped for a JSON string
+	static void printDisplayChanges(void);
+	static void printJsonEscaped(const char * text, uint8_t length); // text escaped for a JSON string
+	static void printTime(uptime_t timestamp); // Unix time of an uptime timestamp as seconds with 3 decimals
+	static void write(const char * text); // all output goes through here, to split bulk frames into chunks
+	static void beginBulkFrame(char type);
+	static void endBulkFrame(void);
+	static void sendChunk(char separator);
+	static void servePriorityRequests(void); // answer 't' between chunks of a bulk frame
+	static bool waitForByte(uptime_t start, uint16_t timeout); // false when nothing was received within timeout after start
 	static void sendJsonPair(const char * name, char * val); // send one JSON pair with a string value as name:val,
 	static void sendJsonPair(const char * name, char val); // send one JSON pair with a char value as name:val,
 	static void sendJsonPair(const char * name, uint16_t val); // send one JSON pair with a uint16_t value as name:val,
-	static void processJsonPair(char * key, char * val); // process one pair
+	static void sendJsonPair(const char * name, uint32_t val); // send one JSON pair with a uint32_t value as name:val,
+	static bool processJsonPair(char * key, char * val); // process one pair, returns false for an unknown key
+	static uint8_t jsonKeyIndex(const char * key);
+	static void commitSettings(void); // write settings changed by transactions to EEPROM after PILINK_COMMIT_DELAY
+	
+	static bool commitPending; // settings were changed by a transaction, but not stored yet
+	static uint8_t logLevel; // messages below this level are not sent
+	static uint8_t logMask; // modules that are logged
+	static bool chunkFrames; // send bulk frames in chunks, enabled by the host
+	static char bulkType; // type of the bulk frame that is being sent, 0 when none
+	static char chunk[PILINK_CHUNK_SIZE];
+	static uint8_t chunkLength;
+	static uptime_t lastChangeTime;
 };
 
-static PiLink piLink;
+extern PiLink piLink;
 
 #endif /* PILINK_H_ */
\ No newline at end of file
@@ -0,0 +1,99 @@
+/*
+ * Copyright 2012 BrewPi/Elco Jacobs.
+ *
+ * This file is part of BrewPi.
+ *
+ * BrewPi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BrewPi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BrewPi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <Arduino.h>
+#include <avr/eeprom.h>
+#include <string.h>
+
+#include "RuntimeStats.h"
+#include "TempControl.h"
+
+// array sizes in RuntimeStatistics must match the number of states
+typedef char checkNumControlStates[(NUM_CONTROL_STATES == STATE_OFF + 1) ? 1 : -1];
+
+RuntimeStats runtimeStats;
+
+RuntimeStatistics RuntimeStats::rs;
+uint8_t RuntimeStats::prevState = STARTUP;
+bool RuntimeStats::prevHeating;
+bool RuntimeStats::prevCooling;
+uptime_t RuntimeStats::lastUpdateTime;
+uint16_t RuntimeStats::remainderMillis;
+uint16_t RuntimeStats::secondsSinceStore;
+
+void RuntimeStats::update(uint8_t state, bool heating, bool cooling){
+	uptime_t now = ticks.millis64();
+	uint32_t elapsed = ticks.timeSince(lastUpdateTime) + remainderMillis;
+	lastUpdateTime = now;
+	uint16_t seconds = elapsed / 1000;
+	remainderMillis = elapsed - seconds * 1000UL;
+
+	// time since the last update is added to the previous state and outputs
+	if(prevState < NUM_CONTROL_STATES){
+		rs.stateTime[prevState] += seconds;
+	}
+	if(prevHeating){
+		rs.heatOnTime += seconds;
+	}
+	if(prevCooling){
+		rs.coolOnTime += seconds;
+	}
+
+	if(state != prevState && state < NUM_CONTROL_STATES){
+		rs.stateCount[state]++;
+	}
+	if(heating && !prevHeating){
+		rs.heatStarts++;
+	}
+	if(cooling && !prevCooling){
+		rs.coolStarts++;
+	}
+	prevState = state;
+	prevHeating = heating;
+	prevCooling = cooling;
+
+	secondsSinceStore += seconds;
+	if(secondsSinceStore >= RUNTIME_STATS_STORE_INTERVAL){
+		store();
+	}
+}
+
+void RuntimeStats::load(void){
+	eeprom_read_block((void *) &rs, (void *) EEPROM_RUNTIME_STATS_ADDRESS, sizeof(RuntimeStatistics));
+	lastUpdateTime = ticks.millis64();
+}
+
+// The update function only writes to EEPROM if the value has changed
+void RuntimeStats::store(void){
+	eeprom_update_block((void *) &rs, (void *) EEPROM_RUNTIME_STATS_ADDRESS, sizeof(RuntimeStatistics));
+	secondsSinceStore = 0;
+}
+
+void RuntimeStats::reset(void){
+	memset(&rs, 0, sizeof(RuntimeStatistics));
+	store();
+}
+
+uint32_t RuntimeStats::heatEnergy(void){
+	return ((uint64_t) rs.heatOnTime * tempControl.cc.heatPower) / 3600;
+}
+
+uint32_t RuntimeStats::coolEnergy(void){
+	return ((uint64_t) rs.coolOnTime * tempControl.cc.coolPower) / 3600;
+}
\ No newline at end of file
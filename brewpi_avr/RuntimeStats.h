@@ -0,0 +1,66 @@
+/*
+ * Copyright 2012 BrewPi/Elco Jacobs.
+ *
+ * This file is part of BrewPi.
+ *
+ * BrewPi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BrewPi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BrewPi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RUNTIMESTATS_H_
+#define RUNTIMESTATS_H_
+
+#include <inttypes.h>
+#include "Ticks.h"
+
+#define NUM_CONTROL_STATES 6 // number of states in the TempControl state machine
+#define RUNTIME_STATS_STORE_INTERVAL 3600UL // store statistics to EEPROM every hour (in seconds)
+
+// This struct is stored in and loaded from EEPROM
+struct RuntimeStatistics{
+	uint32_t stateTime[NUM_CONTROL_STATES]; // seconds spent in each state
+	uint32_t stateCount[NUM_CONTROL_STATES]; // number of transitions into each state
+	uint32_t heatStarts; // number of times the heater output was switched on
+	uint32_t coolStarts; // number of times the compressor was switched on
+	uint32_t heatOnTime; // seconds the heater output was on
+	uint32_t coolOnTime; // seconds the compressor was on
+};
+
+// Counts state transitions, relay starts and on times. There is only one object, so everything is static.
+class RuntimeStats{
+	public:
+	RuntimeStats(){};
+	~RuntimeStats(){};
+
+	static void update(uint8_t state, bool heating, bool cooling); // call after updating the outputs
+	static void load(void);
+	static void store(void);
+	static void reset(void); // clear all statistics and store the cleared statistics
+
+	static uint32_t heatEnergy(void); // estimated heater energy in Wh
+	static uint32_t coolEnergy(void); // estimated compressor energy in Wh
+
+	static RuntimeStatistics rs;
+
+	private:
+	static uint8_t prevState;
+	static bool prevHeating;
+	static bool prevCooling;
+	static uptime_t lastUpdateTime;
+	static uint16_t remainderMillis; // milliseconds not yet added to the counters
+	static uint16_t secondsSinceStore;
+};
+
+extern RuntimeStats runtimeStats;
+
+#endif /* RUNTIMESTATS_H_ */
\ No newline at end of file
@@ -0,0 +1,61 @@
+/*
+ * Copyright 2012 BrewPi/Elco Jacobs.
+ *
+ * This file is part of BrewPi.
+ *
+ * BrewPi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BrewPi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BrewPi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "SlopeEstimator.h"
+
+// 12 / (N*(N^2-1)) * 3600 s/h / interval, with 32 fraction bits. The numerator below is twice the one in the header.
+#define SLOPE_ESTIMATOR_SCALE ((int64_t) ((6ULL * 3600ULL << 32) / ((uint32_t) SLOPE_ESTIMATOR_WINDOW * (SLOPE_ESTIMATOR_WINDOW * SLOPE_ESTIMATOR_WINDOW - 1) * SLOPE_ESTIMATOR_INTERVAL)))
+
+void SlopeEstimator::init(fixed7_9 val){
+	for(uint8_t i = 0; i < SLOPE_ESTIMATOR_WINDOW; i++){
+		window[i] = val;
+	}
+	index = 0;
+	sum = (int32_t) val * SLOPE_ESTIMATOR_WINDOW;
+	weightedSum = (int32_t) val * (SLOPE_ESTIMATOR_WINDOW * (SLOPE_ESTIMATOR_WINDOW - 1) / 2);
+}
+
+void SlopeEstimator::add(fixed7_9 val){
+	fixed7_9 oldest = window[index];
+	window[index] = val;
+	index = (index + 1) % SLOPE_ESTIMATOR_WINDOW;
+	
+	// all remaining samples shift one position to the left, which subtracts each of them once from the weighted sum
+	weightedSum -= sum - oldest;
+	weightedSum += (int32_t) val * (SLOPE_ESTIMATOR_WINDOW - 1);
+	sum += (int32_t) val - oldest;
+}
+
+fixed7_25 SlopeEstimator::readSlopeDoublePrecision(void){
+	int32_t numerator = 2 * weightedSum - (int32_t) (SLOPE_ESTIMATOR_WINDOW - 1) * sum; // sum((2k-(N-1))*y_k), fits easily
+	int64_t slope = (numerator * SLOPE_ESTIMATOR_SCALE) >> 16;
+	// saturate instead of wrapping around when the slope does not fit
+	const int64_t maxSlope = 0x7FFFFFFFL;
+	if(slope > maxSlope){
+		return maxSlope;
+	}
+	if(slope < -maxSlope){
+		return -maxSlope;
+	}
+	return (fixed7_25) slope;
+}
+
+fixed7_9 SlopeEstimator::readSlope(void){
+	return readSlopeDoublePrecision() >> 16;
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright 2012 BrewPi/Elco Jacobs.
+ *
+ * This file is part of BrewPi.
+ *
+ * BrewPi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BrewPi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BrewPi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SLOPEESTIMATOR_H_
+#define SLOPEESTIMATOR_H_
+
+/* Least squares slope of the last SLOPE_ESTIMATOR_WINDOW samples, taken SLOPE_ESTIMATOR_INTERVAL seconds apart.
+ For N equally spaced samples y_k, k = 0 (oldest) .. N-1 (newest):
+ 
+	slope = 12 * (sum(k*y_k) - (N-1)/2 * sum(y_k)) / (N*(N^2-1))
+	
+ Both sums are kept as exact integers and updated recursively when a sample enters and the oldest leaves the window,
+ so an update costs the same for any window size and rounding errors cannot accumulate.
+ The estimate is the slope at the center of the window, so it lags (N-1)/2 samples behind the input.
+ For white noise on the input, the standard deviation of the slope is sigma * sqrt(12/(N*(N^2-1))) per sample.
+ tools/slopeCompare.cpp compares the step response and noise with the previous slope calculation.
+*/
+
+#include "temperatureFormats.h"
+
+#define SLOPE_ESTIMATOR_WINDOW 32 // samples, 2 bytes of RAM each
+#define SLOPE_ESTIMATOR_INTERVAL 24 // seconds between samples, the window spans 12.4 minutes
+
+class SlopeEstimator{
+	public:
+	SlopeEstimator(){
+		init(0);
+	};
+	~SlopeEstimator(){};
+	
+	void init(fixed7_9 val);
+	void add(fixed7_9 val);
+	fixed7_25 readSlopeDoublePrecision(void); // in degrees per hour, 16 extra fraction bits
+	fixed7_9 readSlope(void); // in degrees per hour
+	
+	private:
+	fixed7_9 window[SLOPE_ESTIMATOR_WINDOW];
+	uint8_t index; // position of the oldest sample
+	int32_t sum; // sum(y_k)
+	int32_t weightedSum; // sum(k*y_k)
+};
+
+#endif /* SLOPEESTIMATOR_H_ */
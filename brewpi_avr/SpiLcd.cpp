@@ -39,6 +39,7 @@ void SpiLcd::init(uint8_t latchPin)
 			content[i][j]=' '; // initialize on all spaces
 		}
 		content[i][20]='\0'; // NULL terminate string
+		changes[i] = 0xFFFFFUL; // the first mirror update sends everything
 	}
 }
 
@@ -81,6 +82,11 @@ void SpiLcd::begin(uint8_t cols, uint8_t lines) {
 void SpiLcd::clear()
 {
 	command(LCD_CLEARDISPLAY);  // clear display, set cursor position to zero
+	for(uint8_t i = 0; i<4; i++){
+		for(uint8_t j = 0; j<20; j++){
+			setContent(i, j, ' ');
+		}
+	}
 }
 
 void SpiLcd::home()
@@ -182,7 +188,7 @@ inline void SpiLcd::command(uint8_t value) {
 
 inline size_t SpiLcd::write(uint8_t value) {
 	send(value, HIGH);
-	content[_currline][_currpos] = value;
+	setContent(_currline, _currpos, value);
 	_currpos++;
 	waitBusy();
 	return 1;
@@ -262,7 +268,7 @@ void SpiLcd::waitBusy(void) {
 
 void SpiLcd::getLine(uint8_t lineNumber, char * buffer){
 	for(uint8_t i =0;i<20;i++){
-		if(content[lineNumber][i] == 0b11011111){
+		if((uint8_t) content[lineNumber][i] == 0b11011111){ // char is signed
 			buffer[i] = 0xB0; // correct degree sign
 		}
 		else{
@@ -270,4 +276,20 @@ void SpiLcd::getLine(uint8_t lineNumber, char * buffer){
 		}
 	}
 	buffer[20] = '\0'; // NULL terminate string
-}
\ No newline at end of file
+}
+
+void SpiLcd::setContent(uint8_t line, uint8_t pos, char value){
+	if(pos >= 20){
+		return; // past the end of the line, not visible
+	}
+	if(content[line][pos] != value){
+		content[line][pos] = value;
+		changes[line] |= 1UL << pos;
+	}
+}
+
+void SpiLcd::resetChanges(void){
+	for(uint8_t i = 0; i<4; i++){
+		changes[i] = 0;
+	}
+}
@@ -114,6 +114,12 @@ class SpiLcd : public Print {
 	void getLine(uint8_t lineNumber, char * buffer); 
 	
 	void readContent(void); // read the content from the display to the shadow copy buffer
+	
+	// cells that changed since the last resetChanges(), bit n is column n
+	uint32_t getChanges(uint8_t lineNumber){
+		return changes[lineNumber];
+	};
+	void resetChanges(void);
 
 	void command(uint8_t);
 	char readChar(void);
@@ -142,6 +148,9 @@ class SpiLcd : public Print {
 	uint8_t _numlines;
 	
 	char content[4][21]; // always keep a copy of the display content in this variable
+	uint32_t changes[4]; // one bit per cell of content, set when the cell is written with a different character
+	
+	void setContent(uint8_t line, uint8_t pos, char value);
 };
 
 #endif
@@ -0,0 +1,81 @@
+/*
+ * Copyright 2012 BrewPi/Elco Jacobs.
+ *
+ * This file is part of BrewPi.
+ *
+ * BrewPi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BrewPi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BrewPi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <Arduino.h>
+#include <limits.h>
+
+#include "SpikeFilter.h"
+
+void SpikeFilter::init(fixed7_9 val){
+	for(uint8_t i = 0; i < SPIKE_FILTER_WINDOW; i++){
+		window[i] = val;
+	}
+	index = 0;
+	spike = false;
+}
+
+void SpikeFilter::setParameters(fixed7_9 newMinDeviation, uint8_t newMadFactor){
+	minDeviation = newMinDeviation;
+	madFactor = newMadFactor;
+}
+
+fixed7_9 SpikeFilter::add(fixed7_9 val){
+	window[index] = val;
+	index = (index + 1) % SPIKE_FILTER_WINDOW;
+	spike = false;
+	if(minDeviation == 0){
+		return val;
+	}
+
+	fixed7_9 sorted[SPIKE_FILTER_WINDOW];
+	for(uint8_t i = 0; i < SPIKE_FILTER_WINDOW; i++){
+		sorted[i] = window[i];
+	}
+	fixed7_9 med = median(sorted);
+	// reuse sorted for the absolute deviations from the median, limited to the range of fixed7_9
+	for(uint8_t i = 0; i < SPIKE_FILTER_WINDOW; i++){
+		sorted[i] = deviation(window[i], med);
+	}
+	fixed7_9 mad = median(sorted);
+	int32_t threshold = max((int32_t) minDeviation, (int32_t) mad * madFactor);
+	if(deviation(val, med) > threshold){
+		spike = true;
+		return med;
+	}
+	return val;
+}
+
+fixed7_9 SpikeFilter::deviation(fixed7_9 a, fixed7_9 b){
+	int32_t diff = (int32_t) a - b;
+	return constrain(abs(diff), 0, INT_MAX);
+}
+
+// insertion sort, 10 comparisons at most for 5 values
+fixed7_9 SpikeFilter::median(fixed7_9 * values){
+	for(uint8_t i = 1; i < SPIKE_FILTER_WINDOW; i++){
+		fixed7_9 v = values[i];
+		uint8_t j = i;
+		while(j > 0 && values[j-1] > v){
+			values[j] = values[j-1];
+			j--;
+		}
+		values[j] = v;
+	}
+	return values[SPIKE_FILTER_WINDOW/2];
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright 2012 BrewPi/Elco Jacobs.
+ *
+ * This file is part of BrewPi.
+ *
+ * BrewPi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BrewPi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BrewPi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SPIKEFILTER_H_
+#define SPIKEFILTER_H_
+
+/* Hampel identifier to reject spikes before the samples go into the IIR filters.
+ The median of the last 5 samples (including the new one) and the median absolute deviation (MAD) are calculated.
+ When the new sample deviates more than max(minDeviation, madFactor * MAD) from the median, it is replaced by the median.
+ madFactor 5 is about 3.4 standard deviations for gaussian noise (MAD * 1.4826 = standard deviation).
+ A single or double spike is removed completely. A real step passes after 3 samples, other samples are not delayed.
+ The raw samples are kept in the window, so the filter does not lock on an old value.
+*/
+
+#include "temperatureFormats.h"
+
+#define SPIKE_FILTER_WINDOW 5
+
+class SpikeFilter{
+	public:
+	SpikeFilter(){
+		minDeviation = 0;
+		madFactor = 0;
+		index = 0;
+		spike = false;
+	};
+	~SpikeFilter(){};
+
+	void init(fixed7_9 val);
+	// minDeviation 0 disables the filter
+	void setParameters(fixed7_9 newMinDeviation, uint8_t newMadFactor);
+	bool isEnabled(void){
+		return minDeviation != 0;
+	};
+	// returns the new sample, or the median when the new sample is a spike
+	fixed7_9 add(fixed7_9 val);
+	bool lastWasSpike(void){
+		return spike;
+	};
+
+	private:
+	static fixed7_9 median(fixed7_9 * values); // sorts the values
+	static fixed7_9 deviation(fixed7_9 a, fixed7_9 b); // absolute difference, saturated
+	fixed7_9 window[SPIKE_FILTER_WINDOW];
+	uint8_t index;
+	fixed7_9 minDeviation;
+	uint8_t madFactor;
+	bool spike;
+};
+
+#endif /* SPIKEFILTER_H_ */
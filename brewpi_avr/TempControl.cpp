@@ -23,18 +23,35 @@
 #include "pins.h"
 #include <avr/eeprom.h>
 #include <avr/pgmspace.h>
+#include <util/crc16.h>
 #include <limits.h>
+#include <stddef.h>
 
 #include "temperatureFormats.h"
+#include "FixedPoint.h"
 #include "TempControl.h"
+#include "EventLog.h"
 #include "PiLink.h"
 #include "TempSensor.h"
+#include "RuntimeStats.h"
 
 TempControl tempControl;
 
 // Declare static variables
-TempSensor TempControl::beerSensor(beerSensorPin);
-TempSensor TempControl::fridgeSensor(fridgeSensorPin);
+TempSensor TempControl::beerSensor(beerSensorPin, (uint8_t *) EEPROM_BEER_SENSOR_ADDRESS);
+TempSensor TempControl::fridgeSensor(fridgeSensorPin, (uint8_t *) EEPROM_FRIDGE_SENSOR_ADDRESS);
+
+#if ONEWIRE_UART
+// Every sensor uses the first device it finds on its bus, so the sensors cannot share the bus of USART1.
+// The array size is negative and the build fails when both sensor pins are ONEWIRE_UART_PIN.
+typedef char oneSensorOnOneWireUart[(beerSensorPin == ONEWIRE_UART_PIN && fridgeSensorPin == ONEWIRE_UART_PIN) ? -1 : 1];
+#endif
+
+OvershootModel TempControl::heatModel;
+OvershootModel TempControl::coolModel;
+BeerEstimator TempControl::beerEstimator;
+TimeProportionalOutput TempControl::heater;
+TimeProportionalOutput TempControl::cooler;
 	
 // Control parameters
 ControlConstants TempControl::cc;
@@ -50,12 +67,17 @@ bool TempControl::doNegPeakDetect;
 fixed7_9 TempControl::storedBeerSetting;
 	
 	// Timers
-unsigned long TempControl::lastIdleTime;
-unsigned long TempControl::lastHeatTime;
-unsigned long TempControl::lastCoolTime;
+uptime_t TempControl::lastIdleTime;
+uptime_t TempControl::lastHeatTime;
+uptime_t TempControl::lastCoolTime;
+uptime_t TempControl::sampleTime;
+fixed7_9 TempControl::lastIdleTemp;
 
 void TempControl::init(void){
 	state=STARTUP;
+	heatModel.init();
+	coolModel.init();
+	beerEstimator.init();
 	beerSensor.init();
 	fridgeSensor.init();
 	updateTemperatures();
@@ -77,16 +99,34 @@ void TempControl::reset(void){
 }
 
 void TempControl::updateTemperatures(void){
-	beerSensor.update();
-	if(!beerSensor.isConnected() && (cs.mode == MODE_BEER_CONSTANT || cs.mode == MODE_FRIDGE_CONSTANT)){
-		beerSensor.init(); // try to restart the sensor when controlling beer temperature
-	}
+	bool active = (state == COOLING || state == HEATING);
+	beerSensor.setResolution(active ? BEER_SENSOR_RESOLUTION_ACTIVE : BEER_SENSOR_RESOLUTION_IDLE);
+	fridgeSensor.setResolution(active ? FRIDGE_SENSOR_RESOLUTION_ACTIVE : FRIDGE_SENSOR_RESOLUTION_IDLE);
+	
+	beerSensor.update(); // a disconnected sensor is initialized again by update() when it is found
 	fridgeSensor.update();
-	if(!fridgeSensor.isConnected()){
-		fridgeSensor.init(); // always try to restart the fridge sensor
+	sampleTime = ticks.millis64();
+	if(beerSensor.isConnected() && fridgeSensor.isConnected()){
+		beerEstimator.update(beerSensor.read(), fridgeSensor.readFastFiltered(), active);
+	}
+	else{
+		beerEstimator.init(); // start again when both sensors are available
 	}
 }
 
+void TempControl::prepareTemperatures(uint16_t timeUntilUpdate){
+	beerSensor.prepare(timeUntilUpdate);
+	fridgeSensor.prepare(timeUntilUpdate);
+}
+
+// move a PID constant 1/256 of the way to its target: k * 255/256 + target/256.
+// Calculated with 8 extra fraction bits, or the limited precision would stop k up to 255/512 under the target.
+static fixed7_9 approach(fixed7_9 k, fixed7_9 target){
+	typedef FixedPoint<15, 17> Extended;
+	Extended extended = FixedPoint7_9::fromRaw(k).convert<15, 17>() - Extended::fromRaw(k) + Extended::fromRaw(target);
+	return extended.convert<7, 9>().raw;
+}
+
 void TempControl::updatePID(void){
 	static unsigned char integralUpdateCounter = 0;
 	if(cs.mode == MODE_BEER_CONSTANT || cs.mode == MODE_BEER_PROFILE){
@@ -99,7 +139,12 @@ void TempControl::updatePID(void){
 		
 		// fridge setting is calculated with PID algorithm. Beer temperature error is input to PID
 		cv.beerDiff =  cs.beerSetting - beerSensor.readSlowFiltered();
-		cv.beerSlope = beerSensor.readSlope();
+		if(beerEstimator.isInitialized()){
+			cv.beerSlope = beerEstimator.readSlope(); // less delay than the slope filter, uses fridge temperature too
+		}
+		else{
+			cv.beerSlope = beerSensor.readSlope();
+		}
 		if(integralUpdateCounter++ == 60){
 			integralUpdateCounter = 0;
 			if(abs(cv.beerDiff) < cc.iMaxError && cv.beerSlope <= cc.iMaxSlope && cv.beerSlope >= cc.iMinSlope ){
@@ -115,19 +160,27 @@ void TempControl::updatePID(void){
 			}
 		}			
 		if(cv.beerDiff<0){ // slowly go to cool parameters
-			// shift left instead of right or limited precision will cause a limit value 512/(2^8) under the target value.
-			cv.Kp = ((((fixed23_9) cv.Kp)<<8) - cv.Kp + cc.KpCool)>>8;
-			cv.Kd = ((((fixed23_9) cv.Kd)<<8) - cv.Kd + cc.KdCool)>>8;
+			cv.Kp = approach(cv.Kp, cc.KpCool);
+			cv.Kd = approach(cv.Kd, cc.KdCool);
 		}
 		else{ // slowly go to heat parameters
-			cv.Kp = ((((fixed23_9) cv.Kp)<<8) - cv.Kp + cc.KpHeat)>>8;
-			cv.Kd = ((((fixed23_9) cv.Kd)<<8) - cv.Kd + cc.KdHeat)>>8;
+			cv.Kp = approach(cv.Kp, cc.KpHeat);
+			cv.Kd = approach(cv.Kd, cc.KdHeat);
 		}
 		
-		// calculate PID parts. Use fixed23_9 to prevent overflow
-		cv.p = ((fixed23_9) cv.Kp * (fixed23_9) cv.beerDiff)>>9;
-		cv.i = ((fixed23_9) cc.Ki * cv.diffIntegral)>>9;
-		cv.d = ((fixed23_9) cv.Kd * (fixed23_9) cv.beerSlope)>>9;
+		// calculate PID parts. The products are exact and saturate when converted to fixed23_9
+		cv.p = (FixedPoint7_9::fromRaw(cv.Kp) * FixedPoint7_9::fromRaw(cv.beerDiff)).convert<23, 9>().raw;
+		if(cv.diffIntegral == (fixed7_9) cv.diffIntegral){
+			// the integral normally fits in 16 bits, then I is a 16x16 bit product like P and D
+			cv.i = (FixedPoint7_9::fromRaw(cc.Ki) * FixedPoint7_9::fromRaw(cv.diffIntegral)).convert<23, 9>().raw;
+		}
+		else{
+			// limit the integral so the product fits in 32 bits, that only limits I at +-4096 degrees
+			fixed23_9 maxIntegral = 0x7FFFFFFFL / max(labs(cc.Ki), 1L);
+			FixedPoint23_9 integral = FixedPoint23_9::fromRaw(constrain(cv.diffIntegral, -maxIntegral, maxIntegral));
+			cv.i = FixedPoint7_9::fromRaw(cc.Ki).multiplyInto<23, 9>(integral).raw;
+		}
+		cv.d = (FixedPoint7_9::fromRaw(cv.Kd) * FixedPoint7_9::fromRaw(cv.beerSlope)).convert<23, 9>().raw;
 				
 		cs.fridgeSetting = constrain(cs.beerSetting + cv.p + cv.i + cv.d, cc.tempSettingMin, cc.tempSettingMax);
 	}
@@ -141,7 +194,7 @@ void TempControl::updateState(void){
 	//update state
 	if(digitalRead(doorPin) == LOW){
 		if(state!=DOOR_OPEN){
-			piLink.printFridgeAnnotation(PSTR("Fridge door opened"));
+			eventLog.add(EVENT_DOOR_OPENED);
 		}
 		state=DOOR_OPEN;
 		return;
@@ -167,7 +220,10 @@ void TempControl::updateState(void){
 		case IDLE:
 		case STATE_OFF:
 		{
-			lastIdleTime=millis();
+			lastIdleTime=ticks.millis64();
+			heater.resetOnTime();
+			cooler.resetOnTime();
+			lastIdleTemp=fridgeSensor.readFastFiltered();
 			if(	((timeSinceCooling() > 900000UL || doNegPeakDetect==false) && (timeSinceHeating() > 600000UL || doPosPeakDetect==false)) ||
 					state==STARTUP) //if cooling is 15 min ago and heating 10, or I just started
 			{
@@ -207,12 +263,14 @@ void TempControl::updateState(void){
 		case COOLING:
 		{
 			doNegPeakDetect=true;
-			lastCoolTime = millis();
-			int coolTime = min(cc.maxCoolTimeForEstimate, timeSinceIdle()/1000); // cool time in seconds
-			fixed7_9 estimatedOvershoot = ((fixed23_9) cs.coolEstimator * coolTime)/3600; // overshoot estimator is in overshoot per hour
+			lastCoolTime = ticks.millis64();
+			uint16_t coolTime = min(cc.maxCoolTimeForEstimate, cooler.onTime()/1000); // seconds the compressor was on in this run
+			fixed7_9 coolSlope = runSlope(lastIdleTemp - fridgeSensor.readFastFiltered()); // positive when cooling down
+			fixed7_9 estimatedOvershoot = OvershootModel::predict(cs.coolLag, cs.coolEstimator, coolSlope, coolTime);
 			cv.estimatedPeak = fridgeSensor.readFastFiltered() - estimatedOvershoot;
 			if(cv.estimatedPeak <= cs.fridgeSetting + COOLING_TARGET){
 				cv.negPeakSetting = cs.fridgeSetting; // remember temperature when I switch to Idle, to adjust estimator later
+				coolModel.switchOff(cs.coolLag, cs.coolEstimator, fridgeSensor.readFastFiltered(), coolSlope, coolTime);
 				state=IDLE;
 				return;
 			}
@@ -221,12 +279,14 @@ void TempControl::updateState(void){
 		case HEATING:
 		{
 			doPosPeakDetect=true;
-			lastHeatTime=millis();
-			int heatTime = min(cc.maxHeatTimeForEstimate, timeSinceIdle()/1000	); // heat time in seconds
-			fixed7_9 estimatedOvershoot = ((fixed23_9) cs.heatEstimator * heatTime)/3600; // overshoot estimator is in overshoot per hour
+			lastHeatTime=ticks.millis64();
+			uint16_t heatTime = min(cc.maxHeatTimeForEstimate, heater.onTime()/1000); // seconds the heater was on in this run
+			fixed7_9 heatSlope = runSlope(fridgeSensor.readFastFiltered() - lastIdleTemp); // positive when heating up
+			fixed7_9 estimatedOvershoot = OvershootModel::predict(cs.heatLag, cs.heatEstimator, heatSlope, heatTime);
 			cv.estimatedPeak = fridgeSensor.readFastFiltered() + estimatedOvershoot;
 			if(cv.estimatedPeak >= cs.fridgeSetting + HEATING_TARGET){
 				cv.posPeakSetting=cs.fridgeSetting; // remember temperature when I switch to Idle, to adjust estimator later
+				heatModel.switchOff(cs.heatLag, cs.heatEstimator, fridgeSensor.readFastFiltered(), heatSlope, heatTime);
 				state=IDLE;
 				return;
 			}
@@ -235,7 +295,7 @@ void TempControl::updateState(void){
 		case DOOR_OPEN:
 		{
 			if(digitalRead(doorPin) == HIGH){ 
-				piLink.printFridgeAnnotation(PSTR("Fridge door closed"));
+				eventLog.add(EVENT_DOOR_CLOSED);
 				state=IDLE;
 				return;
 			}
@@ -245,170 +305,132 @@ void TempControl::updateState(void){
 }
 
 void TempControl::updateOutputs(void){
-	// Outputs are inverted on the shield by the mosfets!
-	switch (state)
-	{
-		case IDLE:
-		case STARTUP:
-			digitalWrite(coolingPin, HIGH);
-			digitalWrite(heatingPin, HIGH);
-			break;
-		case COOLING:
-			digitalWrite(coolingPin, LOW);
-			digitalWrite(heatingPin, HIGH);
-			break;
-		case HEATING:
-			digitalWrite(coolingPin, HIGH);
-			digitalWrite(heatingPin, LOW);
-			break;
-		case DOOR_OPEN:
-			if(LIGHT_AS_HEATER){
-				digitalWrite(coolingPin, HIGH);
-				digitalWrite(heatingPin, LOW);
-			}
-			else{
-				digitalWrite(coolingPin, HIGH);
-				digitalWrite(heatingPin, HIGH);
-			}			
-			break;
-		default:
-			digitalWrite(coolingPin, HIGH);
-			digitalWrite(heatingPin, HIGH);
-			break;
+	// The duty cycle is proportional to the error of the fridge temperature, positive when it is in the direction of the state.
+	// In beer modes the fridge setting is the output of the beer PID, so this is the inner loop of a cascade:
+	// the PID demand sets the target and the duty only tracks it. In fridge constant mode there is no PID.
+	fixed23_9 fridgeError = (fixed23_9) cs.fridgeSetting - fridgeSensor.readFastFiltered();
+	if(state == COOLING){
+		fridgeError = -fridgeError;
+	}
+	if(cs.fridgeSetting == INT_MIN){
+		fridgeError = 0;
+	}
+	// Only a positive error gives a duty cycle. The error is limited to 64 degrees, which only changes the result
+	// for gains below 1/64 (1.6% per degree) when the fridge is more than 64 degrees off. The product of two 7.9 values
+	// fits in 32 bits and is limited to 100% by the constrain.
+	fixed23_9 duty = 0;
+	if(fridgeError > 0){
+		FixedPoint7_9 error = FixedPoint23_9::fromRaw(fridgeError).convert<7, 9>();
+		duty = (FixedPoint7_9::fromRaw(cc.pwmGain) * error).convert<23, 9>().raw;
+	}
+	cv.duty = constrain(duty, 0, 512);
+	
+	bool heat = heater.update(cv.duty, state == HEATING);
+	bool cool = cooler.update(cv.duty, state == COOLING);
+	if(state == DOOR_OPEN && LIGHT_AS_HEATER){
+		heat = true; // turn on the light when the door is opened
 	}
+	
+	// Outputs are inverted on the shield by the mosfets!
+	digitalWrite(coolingPin, cool ? LOW : HIGH);
+	digitalWrite(heatingPin, heat ? LOW : HIGH);
+	
+	runtimeStats.update(state, heat, cool);
+}
+
+// apply time proportioning constants to the outputs
+void TempControl::updateOutputConstraints(void){
+	heater.setConstraints(cc.heatPwmWindow, cc.heatMinOn, cc.heatMinOff);
+	cooler.setConstraints(cc.coolPwmWindow, cc.coolMinOn, cc.coolMinOff);
+}
+
+// apply spike rejection constants to the sensors
+void TempControl::updateSpikeFilters(void){
+	beerSensor.setSpikeFilterParameters(cc.spikeMinDeviation, cc.spikeMadFactor);
+	fridgeSensor.setSpikeFilterParameters(cc.spikeMinDeviation, cc.spikeMadFactor);
 }
 
 void TempControl::detectPeaks(void){  
-	//detect peaks in fridge temperature to tune overshoot estimators
+	//detect peaks in fridge temperature to tune overshoot models
 	if(doPosPeakDetect && state!=HEATING){
 		bool detected = false;
 		fixed7_9 posPeak = fridgeSensor.detectPosPeak();
 		if(posPeak != INT_MIN){
 			// maximum detected
-			if(posPeak>cv.posPeakSetting+cc.heatingTargetUpper){
-				//should not happen, estimated overshoot was too low, so adjust overshoot estimator
-				fixed7_9 error = posPeak-(cv.posPeakSetting+cc.heatingTargetUpper);
-				increaseEstimator(&cs.heatEstimator, error);
-			}
-			if(posPeak<cv.posPeakSetting+cc.heatingTargetLower){
-				//should not happen, estimated overshoot was too high, so adjust overshoot estimator
-				fixed7_9 error = posPeak-(cv.posPeakSetting+cc.heatingTargetLower); // will be negative
-				decreaseEstimator(&cs.heatEstimator, error);
-			}
-			piLink.debugMessage(PSTR("Positive peak detected."));
+			eventLog.add(EVENT_POS_PEAK_DETECTED, posPeak);
 			detected = true;
 		}
 		else if(timeSinceHeating() > 580000UL && timeSinceCooling() > 880000UL && fridgeSensor.readFastFiltered() < (cv.posPeakSetting+cc.heatingTargetLower)){
 			// heating is almost 10 minutes ago, cooling is almost 15 minutes ago, but still no peak
 			// This is the heat, then drift up too slow (but in the right direction).
-			// estimator is too high
+			// Use the current temperature as peak, the model will lower the estimate
 			posPeak=fridgeSensor.readFastFiltered();
-			fixed7_9 error = posPeak-(cv.posPeakSetting+cc.heatingTargetLower); // will be negative
-			decreaseEstimator(&cs.heatEstimator, error);
-			
-			piLink.debugMessage(PSTR("Drifting up after heating too short."));
+			eventLog.add(EVENT_POS_DRIFT_DETECTED, posPeak);
 			detected = true;
 		}
+		if(detected && heatModel.getOffTemp() != INT_MIN){
+			fixed7_9 estimated = heatModel.getOffTemp() + heatModel.getPredictedOvershoot();
+			heatModel.update(&cs.heatLag, &cs.heatEstimator, posPeak - heatModel.getOffTemp());
+			storeSettings();
+			eventLog.add(EVENT_HEAT_ESTIMATOR_UPDATED, posPeak, estimated, cs.heatEstimator, cs.heatLag);
+		}
 		if(detected){
-			char tempString1[9]; char tempString2[9]; char tempString3[9];
-			piLink.debugMessage(PSTR("Peak: %s Estimated: %s. New estimator: %s"),
-				tempToString(tempString1, posPeak, 3, 9),
-				tempToString(tempString2, cv.posPeakSetting, 3, 9),
-				fixedPointToString(tempString3, cs.heatEstimator, 3, 9));
 			doPosPeakDetect=false;
 			cv.posPeak = posPeak;
-		}			
+		}
 	}		
 	if(doNegPeakDetect && state!=COOLING){
 		fixed7_9 negPeak = fridgeSensor.detectNegPeak();
 		bool detected = false;
 		if(negPeak != INT_MIN){
 			// negative peak detected
-			if(negPeak<cv.negPeakSetting+cc.coolingTargetLower){
-				//should not happen, estimated overshoot was too low, so adjust overshoot estimator
-				fixed7_9 error = negPeak-(cv.negPeakSetting+cc.coolingTargetLower); //positive value
-				increaseEstimator(&cs.coolEstimator, error);
-			}
-			if(negPeak>cv.negPeakSetting+cc.coolingTargetUpper){
-				fixed7_9 error = negPeak-(cv.negPeakSetting+cc.coolingTargetLower); //negative value
-				decreaseEstimator(&cs.coolEstimator, error);
-			}
-			piLink.debugMessage(PSTR("Negative peak detected."));
+			eventLog.add(EVENT_NEG_PEAK_DETECTED, negPeak);
 			detected = true;
 		}
 		else if(timeSinceHeating() > 580000UL && timeSinceCooling() > 880000UL && fridgeSensor.readFastFiltered() > (cv.negPeakSetting+cc.coolingTargetUpper)){
 			// Heating is almost 10 minutes ago, cooling is almost 15 minutes ago, but still no peak
 			// This is the cooling, then drift down too slow (but in the right direction).
-			// estimator is too high
-			fixed7_9 error = negPeak-(cv.negPeakSetting+cc.coolingTargetLower); //negative value
-			decreaseEstimator(&cs.coolEstimator, error);
-			piLink.debugMessage(PSTR("Drifting down after cooling too short."));
+			// Use the current temperature as peak, the model will lower the estimate
+			negPeak=fridgeSensor.readFastFiltered();
+			eventLog.add(EVENT_NEG_DRIFT_DETECTED, negPeak);
 			detected = true;
 		}
+		if(detected && coolModel.getOffTemp() != INT_MIN){
+			fixed7_9 estimated = coolModel.getOffTemp() - coolModel.getPredictedOvershoot();
+			coolModel.update(&cs.coolLag, &cs.coolEstimator, coolModel.getOffTemp() - negPeak);
+			storeSettings();
+			eventLog.add(EVENT_COOL_ESTIMATOR_UPDATED, negPeak, estimated, cs.coolEstimator, cs.coolLag);
+		}
 		if(detected){
-			char tempString1[9]; char tempString2[9]; char tempString3[9];
-			piLink.debugMessage(PSTR("Peak: %s. Estimated: %s. New estimator: %s"),
-				tempToString(tempString1, negPeak, 3, 9),
-				tempToString(tempString2, cv.negPeakSetting, 3, 9),
-				fixedPointToString(tempString3, cs.coolEstimator, 3, 9));
 			doNegPeakDetect=false;
-				cv.negPeak = negPeak;
-		}			
+			cv.negPeak = negPeak;
+		}
 	}		
 }
 
-void TempControl::increaseEstimator(fixed7_9 * estimator, fixed7_9 error){
-	fixed23_9 factor = 614 + (error>>5); // 1.2 + 3.1% of error
-	factor = constrain(factor, 614, 768); // limit between 1.2 and 1.5
-	*estimator = ((fixed23_9) *estimator * factor)>>9;
-	storeSettings();
-}
-
-void TempControl::decreaseEstimator(fixed7_9 * estimator, fixed7_9 error){
-	fixed23_9 factor = 410 + (error>>5); // 0.8 + 3.1% of error
-	factor = constrain(factor, 256, 410); // limit between 0.5 and 0.8
-	*estimator = ((fixed23_9) *estimator * factor)>>9;
-	storeSettings();
+// average slope in degrees per hour since the end of the last idle period
+// Zero at the start of a run, when the temperature difference is still mostly sensor noise.
+// The slope is per hour of the run, also with time proportioning: the lag term of the model is the temperature
+// that keeps changing at this slope after switching off. Only the on time term uses the time the output was on.
+fixed7_9 TempControl::runSlope(fixed7_9 tempDiff){
+	unsigned long runTime = timeSinceIdle()/1000;
+	if(runTime < OVERSHOOT_MODEL_MIN_SLOPE_TIME){
+		return 0;
+	}
+	fixed23_9 slope = ((fixed23_9) tempDiff * 3600) / (fixed23_9) runTime;
+	return constrain(slope, 0, INT_MAX); // slope in the wrong direction does not cause overshoot
 }
 
 unsigned long TempControl::timeSinceCooling(void){
-	unsigned long currentTime = millis();
-	unsigned long timeSinceLastOn;
-	if(currentTime>=lastCoolTime){
-		timeSinceLastOn = currentTime - lastCoolTime;
-	}
-	else{
-		// millis() overflow has occured
-		timeSinceLastOn = (currentTime + 1440000) - (lastCoolTime +1440000); // add a day to both for calculation
-	}
-	return timeSinceLastOn;
+	return ticks.timeSince(lastCoolTime);
 }
 
 unsigned long TempControl::timeSinceHeating(void){
-	unsigned long currentTime = millis();
-	unsigned long timeSinceLastOn;
-	if(currentTime>=lastHeatTime){
-		timeSinceLastOn = currentTime - lastHeatTime;
-	}
-	else{
-		// millis() overflow has occured
-		timeSinceLastOn = (currentTime + 1440000) - (lastHeatTime +1440000); // add a day to both for calculation
-	}
-	return timeSinceLastOn;
+	return ticks.timeSince(lastHeatTime);
 }
 
-
 unsigned long TempControl::timeSinceIdle(void){
-	unsigned long currentTime = millis();
-	unsigned long timeSinceLastOn;
-	if(currentTime>=lastIdleTime){
-		timeSinceLastOn = currentTime - lastIdleTime;
-	}
-	else{
-		// millis() overflow has occured
-		timeSinceLastOn = (currentTime + 1440000) - (lastIdleTime +1440000); // add a day to both for calculation
-	}
-	return timeSinceLastOn;
+	return ticks.timeSince(lastIdleTime);
 }
 
 // write new settings to EEPROM to be able to reload them after a reset
@@ -428,6 +450,8 @@ void TempControl::loadDefaultSettings(void){
 	cs.fridgeSetting = 20<<9;
 	cs.heatEstimator=16; // 0.2*2^9
 	cs.coolEstimator=5<<9;
+	cs.heatLag=0; // lag starts at zero, which is the same as the old estimator
+	cs.coolLag=0;
 	storeSettings();
 }
 
@@ -437,6 +461,18 @@ void TempControl::storeConstants(void){
 
 void TempControl::loadConstants(void){
 	eeprom_read_block((void *) &cc, (void *) EEPROM_CONTROL_CONSTANTS_ADDRESS, sizeof(ControlConstants));
+	applyConstants();
+}
+
+void TempControl::applyConstants(void){
+	fridgeSensor.setFastFilterCoefficients(cc.fridgeFastFilter);
+	fridgeSensor.setSlowFilterCoefficients(cc.fridgeSlowFilter);
+	fridgeSensor.setSlopeFilterCoefficients(cc.fridgeSlopeFilter);
+	beerSensor.setFastFilterCoefficients(cc.beerFastFilter);
+	beerSensor.setSlowFilterCoefficients(cc.beerSlowFilter);
+	beerSensor.setSlopeFilterCoefficients(cc.beerSlopeFilter);
+	updateOutputConstraints();
+	updateSpikeFilters();
 }
 
 void TempControl::loadDefaultConstants(void){
@@ -473,29 +509,110 @@ void TempControl::loadDefaultConstants(void){
 	fridgeSensor.setFastFilterCoefficients(cc.fridgeFastFilter);
 	cc.fridgeSlowFilter = SETTLING_TIME_200_SAMPLES;
 	fridgeSensor.setSlowFilterCoefficients(cc.fridgeSlowFilter);
-	cc.fridgeSlopeFilter = SETTLING_TIME_100_SAMPLES;
+	cc.fridgeSlopeFilter = SETTLING_TIME_25_SAMPLES; // samples are 24 seconds apart
 	fridgeSensor.setSlopeFilterCoefficients(cc.fridgeSlopeFilter);
 	cc.beerFastFilter = SETTLING_TIME_50_SAMPLES;
 	beerSensor.setFastFilterCoefficients(cc.beerFastFilter);
 	cc.beerSlowFilter = SETTLING_TIME_400_SAMPLES;
 	beerSensor.setSlowFilterCoefficients(cc.beerSlowFilter);
-	cc.beerSlopeFilter = SETTLING_TIME_100_SAMPLES;
+	cc.beerSlopeFilter = SETTLING_TIME_25_SAMPLES; // samples are 24 seconds apart
 	beerSensor.setSlopeFilterCoefficients(cc.beerSlopeFilter);
+	
+	// Time proportioning for the heater. The compressor is only switched by the state machine.
+	cc.pwmGain = 512;		// 100% per degree
+	cc.heatPwmWindow = 60;	// 1 minute
+	cc.heatMinOn = 5;
+	cc.heatMinOff = 5;
+	cc.coolPwmWindow = 0;	// no time proportioning
+	cc.coolMinOn = 0;
+	cc.coolMinOff = 0;
+	updateOutputConstraints();
+	
+	cc.heatPower = 100;	// 100W light bulb
+	cc.coolPower = 100;	// small fridge compressor
+	
+	cc.spikeMinDeviation = 256;	// 0.5 deg Celsius
+	cc.spikeMadFactor = 5;
+	updateSpikeFilters();
 	storeConstants();
 }
 
 void TempControl::loadSettingsAndConstants(void){
-	if(eeprom_read_byte((unsigned char *) EEPROM_IS_INITIALIZED_ADDRESS) != 1){
-		// EEPROM is not initialized, use default settings
+	if(eeprom_read_byte((unsigned char *) EEPROM_IS_INITIALIZED_ADDRESS) != EEPROM_FORMAT_VERSION){
+		// EEPROM is not initialized or has an old format, use default settings
+		logInfo(LOG_EEPROM, "EEPROM format %d is not %d, defaults loaded", eeprom_read_byte((unsigned char *) EEPROM_IS_INITIALIZED_ADDRESS), EEPROM_FORMAT_VERSION);
 		loadDefaultSettings();
 		loadDefaultConstants();
-		eeprom_write_byte((unsigned char *) EEPROM_IS_INITIALIZED_ADDRESS, 1);
+		eeprom_write_byte((unsigned char *) EEPROM_IS_INITIALIZED_ADDRESS, EEPROM_FORMAT_VERSION);
 		storeSettings();
 		storeConstants();
+		runtimeStats.reset();
 	}
 	else{
 		loadSettings();
 		loadConstants();
+		runtimeStats.load();
+		recoverSnapshot();
+	}
+}
+
+uint16_t TempControl::snapshotCrc(const SettingsSnapshot * snapshot){
+	const uint8_t * bytes = (const uint8_t *) snapshot;
+	uint16_t crc = 0xFFFF;
+	for(uint8_t i = 0; i < offsetof(SettingsSnapshot, crc); i++){
+		crc = _crc_ccitt_update(crc, bytes[i]);
+	}
+	return crc;
+}
+
+void TempControl::createSnapshot(SettingsSnapshot * snapshot){
+	snapshot->magic = SNAPSHOT_MAGIC;
+	snapshot->version = EEPROM_FORMAT_VERSION;
+	snapshot->length = sizeof(SettingsSnapshot);
+	snapshot->cs = cs;
+	snapshot->cc = cc;
+	snapshot->crc = snapshotCrc(snapshot);
+}
+
+uint8_t TempControl::checkSnapshot(const SettingsSnapshot * snapshot){
+	if(snapshot->magic != SNAPSHOT_MAGIC || snapshot->length != sizeof(SettingsSnapshot)){
+		return SNAPSHOT_INVALID;
+	}
+	if(snapshot->version != EEPROM_FORMAT_VERSION){
+		return SNAPSHOT_WRONG_VERSION;
+	}
+	if(snapshot->crc != snapshotCrc(snapshot)){
+		return SNAPSHOT_CRC_ERROR;
+	}
+	return SNAPSHOT_OK;
+}
+
+/* Settings and constants are restored atomically: the complete snapshot is written to the journal first.
+ When the controller resets while the journal is written, its CRC is wrong and the old settings are still complete.
+ When it resets while the settings are written, the journal is valid and the restore is completed at startup.
+ The journal is invalidated after the settings have been written. Writing a full snapshot takes about 0.6 s.
+*/
+uint8_t TempControl::restoreSnapshot(const SettingsSnapshot * snapshot){
+	uint8_t result = checkSnapshot(snapshot);
+	if(result != SNAPSHOT_OK){
+		return result;
+	}
+	eeprom_update_block((void *) snapshot, (void *) EEPROM_SNAPSHOT_JOURNAL_ADDRESS, sizeof(SettingsSnapshot));
+	cs = snapshot->cs;
+	cc = snapshot->cc;
+	storeSettings();
+	storeConstants();
+	eeprom_write_byte((uint8_t *) EEPROM_SNAPSHOT_JOURNAL_ADDRESS + offsetof(SettingsSnapshot, magic), 0);
+	applyConstants();
+	return SNAPSHOT_OK;
+}
+
+void TempControl::recoverSnapshot(void){
+	SettingsSnapshot journal;
+	eeprom_read_block((void *) &journal, (void *) EEPROM_SNAPSHOT_JOURNAL_ADDRESS, sizeof(SettingsSnapshot));
+	if(checkSnapshot(&journal) == SNAPSHOT_OK){
+		logInfo(LOG_EEPROM, "Completing interrupted settings restore");
+		restoreSnapshot(&journal);
 	}
 }
 
@@ -22,6 +22,10 @@
 #define CONTROLLER_H_
 
 #include "TempSensor.h"
+#include "OvershootModel.h"
+#include "BeerEstimator.h"
+#include "TimeProportionalOutput.h"
+#include "Ticks.h"
 #include "pins.h"
 #include "temperatureFormats.h"
 
@@ -30,8 +34,10 @@ struct ControlSettings{
 	char mode;
 	fixed7_9 beerSetting;
 	fixed7_9 fridgeSetting;
-	fixed7_9 heatEstimator; // updated automatically by self learning algorithm
-	fixed7_9 coolEstimator; // updated automatically by self learning algorithm
+	fixed7_9 heatEstimator; // updated automatically by self learning algorithm, overshoot per hour heating
+	fixed7_9 coolEstimator; // updated automatically by self learning algorithm, overshoot per hour cooling
+	fixed7_9 heatLag; // updated automatically by self learning algorithm, overshoot per deg/h slope
+	fixed7_9 coolLag; // updated automatically by self learning algorithm, overshoot per deg/h slope
 };
 
 struct ControlVariables{
@@ -48,6 +54,7 @@ struct ControlVariables{
 	fixed7_9 posPeakSetting;
 	fixed7_9 negPeak;
 	fixed7_9 posPeak;
+	fixed7_9 duty; // duty cycle of time proportioned heater or cooler, 512 = 100%
 };
 
 struct ControlConstants{
@@ -77,14 +84,66 @@ struct ControlConstants{
 	uint16_t beerFastFilter;	// for display and logging
 	uint16_t beerSlowFilter;	// for on/off control algorithm
 	uint16_t beerSlopeFilter;	// for PID calculation
+	// time proportioning of the outputs. Duty cycle is proportional to the fridge temperature error
+	fixed7_9 pwmGain;			// duty cycle per degree error, 1.0 = 100% per degree
+	uint16_t heatPwmWindow;		// in seconds, 0 = no time proportioning
+	uint16_t heatMinOn;			// in seconds
+	uint16_t heatMinOff;		// in seconds
+	uint16_t coolPwmWindow;		// in seconds, 0 = no time proportioning
+	uint16_t coolMinOn;			// in seconds, protects the compressor
+	uint16_t coolMinOff;		// in seconds, protects the compressor
+	// power of the outputs, for energy statistics
+	uint16_t heatPower;			// in Watt
+	uint16_t coolPower;			// in Watt
+	// spike rejection before the filters of both sensors
+	fixed7_9 spikeMinDeviation;	// deviation from the median that is always accepted, 0 = disabled
+	uint8_t spikeMadFactor;		// deviation from the median is a spike when larger than this times the median absolute deviation
 };
 
 #define COOLING_TARGET ((cc.coolingTargetUpper+cc.coolingTargetLower)/2)
 #define HEATING_TARGET ((cc.heatingTargetUpper+cc.heatingTargetLower)/2)
 
+// Increase the EEPROM format version when the layout of ControlSettings or ControlConstants changes.
+// Defaults will be loaded when the version in EEPROM does not match.
+#define EEPROM_FORMAT_VERSION 7
+
+// Sensor resolution while idle and while heating or cooling.
+// The fridge sensor is read at lower resolution while the compressor or heater runs: the fridge temperature changes fast
+// and the faster conversion gives a fresher reading for the overshoot estimators. The beer sensor needs full resolution for the slope.
+#define BEER_SENSOR_RESOLUTION_IDLE 12
+#define BEER_SENSOR_RESOLUTION_ACTIVE 12
+#define FRIDGE_SENSOR_RESOLUTION_IDLE 12
+#define FRIDGE_SENSOR_RESOLUTION_ACTIVE 10
+
 #define EEPROM_IS_INITIALIZED_ADDRESS 0
 #define EEPROM_CONTROL_SETTINGS_ADDRESS (EEPROM_IS_INITIALIZED_ADDRESS+sizeof(uint8_t))
 #define EEPROM_CONTROL_CONSTANTS_ADDRESS (EEPROM_CONTROL_SETTINGS_ADDRESS+sizeof(ControlSettings))
+#define EEPROM_RUNTIME_STATS_ADDRESS (EEPROM_CONTROL_CONSTANTS_ADDRESS+sizeof(ControlConstants))
+// ROM codes of the sensors are cached to skip the bus search. They are checked before use, so they do not need a format version.
+#define EEPROM_BEER_SENSOR_ADDRESS (EEPROM_RUNTIME_STATS_ADDRESS+sizeof(RuntimeStatistics))
+#define EEPROM_FRIDGE_SENSOR_ADDRESS (EEPROM_BEER_SENSOR_ADDRESS+sizeof(DeviceAddress))
+// A restored snapshot is written here first, see TempControl::restoreSnapshot()
+#define EEPROM_SNAPSHOT_JOURNAL_ADDRESS (EEPROM_FRIDGE_SENSOR_ADDRESS+sizeof(DeviceAddress))
+
+// Snapshot of the settings and constants, including the learned estimators, to back up or clone a controller.
+// The structs have the EEPROM layout, so a snapshot can only be restored by firmware with the same EEPROM_FORMAT_VERSION.
+#define SNAPSHOT_MAGIC 0xB7
+struct SettingsSnapshot{
+	uint8_t magic;
+	uint8_t version;	// EEPROM_FORMAT_VERSION
+	uint8_t length;		// sizeof(SettingsSnapshot)
+	ControlSettings cs;
+	ControlConstants cc;
+	uint16_t crc;		// CRC-CCITT (avr-libc _crc_ccitt_update, start value 0xFFFF) of all bytes before it
+};
+
+// Result of checking or restoring a snapshot
+enum{
+	SNAPSHOT_OK,
+	SNAPSHOT_INVALID,		// wrong magic number or length
+	SNAPSHOT_WRONG_VERSION,	// made by firmware with another EEPROM format
+	SNAPSHOT_CRC_ERROR
+};
 
 #define	MODE_FRIDGE_CONSTANT 'f'
 #define MODE_BEER_CONSTANT 'b'
@@ -115,6 +174,7 @@ class TempControl{
 	static void reset(void);
 	
 	static void updateTemperatures(void);
+	static void prepareTemperatures(uint16_t timeUntilUpdate);
 	static void updatePID(void);
 	static void updateState(void);
 	static void updateOutputs(void);
@@ -129,11 +189,21 @@ class TempControl{
 	static void loadDefaultConstants(void);
 	
 	static void loadSettingsAndConstants(void);
+	static void applyConstants(void); // apply the filter, output and spike filter constants
+	
+	static void createSnapshot(SettingsSnapshot * snapshot);
+	static uint8_t checkSnapshot(const SettingsSnapshot * snapshot); // returns one of the SNAPSHOT_ results
+	static uint8_t restoreSnapshot(const SettingsSnapshot * snapshot); // check, store and apply a snapshot
+	static void updateOutputConstraints(void);
+	static void updateSpikeFilters(void);
 	
 	static unsigned long timeSinceCooling(void);
  	static unsigned long timeSinceHeating(void);
   	static unsigned long timeSinceIdle(void);
 	  
+	static uptime_t getSampleTime(void){ // time of the last temperature update
+		return sampleTime;
+	};
 	static fixed7_9 getBeerTemp(void);
 	static fixed7_9 getBeerSetting(void);
 	static void setBeerTemp(int newTemp);
@@ -151,6 +221,17 @@ class TempControl{
 	static TempSensor beerSensor;
 	static TempSensor fridgeSensor;
 	
+	// Overshoot models for heating and cooling
+	static OvershootModel heatModel;
+	static OvershootModel coolModel;
+	
+	// Kalman filter for beer temperature and slope
+	static BeerEstimator beerEstimator;
+	
+	// Time proportioned outputs
+	static TimeProportionalOutput heater;
+	static TimeProportionalOutput cooler;
+	
 	// Control parameters
 	static ControlConstants cc;
 	static ControlSettings cs;
@@ -159,11 +240,18 @@ class TempControl{
 	private:
 	// keep track of beer setting stored in EEPROM
 	static fixed7_9 storedBeerSetting;
+	
+	static uint16_t snapshotCrc(const SettingsSnapshot * snapshot);
+	static void recoverSnapshot(void); // complete a restore that was interrupted by a reset
 
 	// Timers
-	static unsigned long lastIdleTime;
-	static unsigned long lastHeatTime;
-	static unsigned long lastCoolTime;
+	static uptime_t lastIdleTime;
+	static uptime_t lastHeatTime;
+	static uptime_t lastCoolTime;
+	static uptime_t sampleTime;
+	
+	// fridge temperature at the end of the last idle period, to calculate the slope during heating or cooling
+	static fixed7_9 lastIdleTemp;
 	
 	// State variables
 	static uint8_t state;
@@ -171,8 +259,7 @@ class TempControl{
 	static bool doNegPeakDetect;
 
 	
-	static void increaseEstimator(fixed7_9 * estimator, fixed7_9 error);
-	static void decreaseEstimator(fixed7_9 * estimator, fixed7_9 error);
+	static fixed7_9 runSlope(fixed7_9 tempDiff);
 };
 
 extern TempControl tempControl;
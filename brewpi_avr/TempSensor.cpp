@@ -20,45 +20,67 @@
 #include "TempSensor.h"
 #include "OneWire.h"
 #include "DallasTemperature.h"
+#include "EventLog.h"
 #include "PiLink.h"
+#include "FixedPoint.h"
 #include <limits.h>
+#include <avr/eeprom.h>
+
+#define DS18B20_POWER_ON_VALUE 0x0550 // 85 deg C, the scratchpad value before the first conversion
+#define TEMP_SENSOR_READ_RETRIES 2 // extra attempts after a failed scratchpad read
+#define TEMP_SENSOR_MAX_BAD_SAMPLES 5 // consecutive corrupted samples before the sensor is considered disconnected
 
 void TempSensor::init(void){
 	// give reset pulse to temp sensors
 	oneWire->reset();
 
-	// get sensor address
-	if (!sensor->getAddress(sensorAddress, 0)){
-		// error no sensor found
-		if(millis() < 2000){
-			// only log this debug message at startup
-			piLink.debugMessage(PSTR("Unable to find address for sensor on pin %d"), pinNr);
+	// try the cached address first, only search the bus when the sensor is not found at that address
+	eeprom_read_block((void *) sensorAddress, eepromAddressCache, sizeof(DeviceAddress));
+	if(!sensor->validAddress(sensorAddress) || !sensor->isConnected(sensorAddress)){
+		// get sensor address
+		if (!sensor->getAddress(sensorAddress, 0)){
+			// error no sensor found
+			if(ticks.millis64() < 2000){
+				// only log this event at startup
+				eventLog.add(EVENT_SENSOR_NOT_FOUND, pinNr);
+			}
+			return;
 		}
-		return;
+		eeprom_update_block((void *) sensorAddress, eepromAddressCache, sizeof(DeviceAddress));
 	}
 	sensor->setResolution(sensorAddress, 12);
+	resolution = 12;
 	sensor->setWaitForConversion(false);
 		
 	sensor->requestTemperatures();
-	lastRequestTime = millis();
+	lastRequestTime = ticks.millis64();
 	delay(750); // delay 750ms for conversion time
-	fixed7_9 temperature = DEVICE_DISCONNECTED;
-	while(temperature == DEVICE_DISCONNECTED){
-		temperature = sensor->getTempRaw(sensorAddress);
-		if(millis() - lastRequestTime > 2000){
-			connected = false; // sensor disconnected
-			return;
-		}
+	fixed7_9 temperature;
+	uint8_t status = readTemperature(&temperature);
+	if(status == TEMP_SENSOR_POWER_ON_VALUE){
+		// the conversion did not finish, the sensor still has its power on value. Convert again.
+		sensor->requestTemperatures();
+		delay(750);
+		status = readTemperature(&temperature);
+	}
+	if(status != TEMP_SENSOR_READ_OK){
+		connected = false; // sensor disconnected
+		return;
 	}
-	sensor->requestTemperatures();
-	delay(750);
-	temperature = sensor->getTempRaw(sensorAddress); // read again. First read is not accurate
 	connected = true;
-	temperature = constrain(temperature, ((int) INT_MIN)>>5, ((int) INT_MAX)>>5)<<5; // sensor returns 12 bits with 4 fraction bits. Store with 9 fraction bits
+	badSamples = 0;
+	reconnecting = false;
+	conversionRequested = true; // the first update can read the last conversion without waiting
+	#if USE_ONEWIRE_ASYNC
+	asyncTemperature = temperature;
+	asyncStatus = TEMP_SENSOR_READ_OK;
+	#endif
+	temperature = FixedPoint<12, 4>::fromRaw(temperature).convert<7, 9>().raw; // sensor returns 12 bits with 4 fraction bits. Store with 9 fraction bits
+	spikeFilter.init(temperature);
 	fastFilter.init(temperature);
 	slowFilter.init(temperature);
+	slopeEstimator.init(temperature);
 	slopeFilter.init(0);
-	prevOutputForSlope = slowFilter.readOutputDoublePrecision();
 }
 
 bool TempSensor::isConnected(void){
@@ -66,70 +88,232 @@ bool TempSensor::isConnected(void){
 }
 
 void TempSensor::update(void){
-	if((millis()-lastRequestTime) > 5000){ // if last request is longer than 5 seconds ago, request again and delay
-		sensor->requestTemperatures();
-		lastRequestTime = millis();
-		delay(750); // wait 750 ms (18B20 max conversion time)
+#if USE_ONEWIRE_ASYNC
+	// The temperature was read in the background after the previous update, so it is one update period old.
+	if(transaction.status == ONEWIRE_ASYNC_BUSY){
+		return; // the bus is still busy, skip this update
+	}
+#endif
+	if(!connected){
+		reconnect();
+		return;
+	}
+#if USE_ONEWIRE_ASYNC
+	fixed7_9 temperature = asyncTemperature;
+	uint8_t status = asyncStatus;
+	countError(status);
+#else
+	if(!conversionRequested){
+		startConversion(); // prepare() was not called in time, start the conversion now and wait for it
+	}
+	uint32_t elapsed = ticks.timeSince(lastRequestTime);
+	if(elapsed < conversionTime()){
+		delay(conversionTime() - elapsed);
+	}
+	conversionRequested = false;
+	fixed7_9 temperature; // only valid when the status is TEMP_SENSOR_READ_OK
+	uint8_t status = readTemperature(&temperature);
+#endif
+	if(status == TEMP_SENSOR_POWER_ON_VALUE){
+		resolution = 12; // the sensor was reset and uses the resolution stored in its EEPROM again
+	}
+	if(status != TEMP_SENSOR_READ_OK && status != TEMP_SENSOR_NO_PRESENCE && badSamples < TEMP_SENSOR_MAX_BAD_SAMPLES){
+		// keep corrupted samples out of the filters, they could be detected as a peak
+		errors.dropped++;
+		badSamples++;
+		logDebug(LOG_SENSOR, "Sample of sensor on pin %d dropped, status %d", pinNr, status);
+		#if USE_ONEWIRE_ASYNC
+		startRead();
+		#endif
+		return;
 	}
-	fixed7_9 temperature = sensor->getTempRaw(sensorAddress);
-	if(temperature == DEVICE_DISCONNECTED){
-		// device disconnected. Don't update filters.  Log a debug message.
+	if(status != TEMP_SENSOR_READ_OK){
+		// device disconnected or keeps returning corrupted values. Don't update filters.  Log an event.
+		badSamples = 0;
 		if(connected == true){
-			piLink.debugMessage(PSTR("Temperature sensor on pin %d disconnected"), pinNr);
+			eventLog.add(EVENT_SENSOR_DISCONNECTED, pinNr);
 		}			
 		connected = false;
+		reconnecting = false;
 		return;
 	}
+	badSamples = 0;
+	temperature &= ~((1 << (12 - resolution)) - 1); // bits below the resolution are undefined
+	temperature = FixedPoint<12, 4>::fromRaw(temperature).convert<7, 9>().raw; // sensor returns 12 bits with 4 fraction bits. Store with 9 fraction bits
 	
-	else{
-		if(connected == false){
-			delay(2000); // delay for two seconds to be sure sensor is correctly inserted
-			init(); // was disconnected, initialize again
-			piLink.debugMessage(PSTR("Temperature sensor on pin %d reconnected"), pinNr);
-			temperature = sensor->getTempRaw(sensorAddress); // re-read temperature after proper initialization
-		}
+	temperature = spikeFilter.add(temperature);
+	if(spikeFilter.lastWasSpike()){
+		errors.spikes++;
 	}
-	temperature = constrain(temperature, ((int) INT_MIN)>>5, ((int) INT_MAX)>>5)<<5; // sensor returns 12 bits with 4 fraction bits. Store with 9 fraction bits
 	
-		
 	fastFilter.add(temperature);
 	slowFilter.add(temperature);
 	
-	// update slope filter every 12 samples.
-	// averaged differences will give the slope. Use the slow filter as input
+	// The slope is the least squares fit through the fast filter output over the last 12 minutes,
+	// smoothed by the slope filter. Both are updated every SLOPE_ESTIMATOR_INTERVAL samples.
 	updateCounter--;
-	// initialize first read for slope filter after (255-13) seconds. This prevents an influence for the startup inaccuracy.
-	if(updateCounter == 13){
-		// only happens once after startup.
-		prevOutputForSlope = slowFilter.readOutputDoublePrecision();
-	}
 	if(updateCounter == 0){
-		slopeFilter.addDoublePrecision(slowFilter.readOutputDoublePrecision() - prevOutputForSlope);
-		prevOutputForSlope = slowFilter.readOutputDoublePrecision();
-		updateCounter = 12;
+		slopeEstimator.add(fastFilter.readOutput());
+		slopeFilter.addDoublePrecision(slopeEstimator.readSlopeDoublePrecision());
+		updateCounter = SLOPE_ESTIMATOR_INTERVAL;
 	}
 		
+#if USE_ONEWIRE_ASYNC
 	// already send request for next read
+	startRead();
+#endif
+}
+
+// A disconnected sensor is initialized again when it is found in two consecutive updates, so it is not used
+// while it is being inserted. The sensor is found at its cached address, or by searching the bus.
+// init() reads and checks the first temperature and starts the filters with it.
+void TempSensor::reconnect(void){
+	DeviceAddress address;
+	if(!sensor->isConnected(sensorAddress) && !sensor->getAddress(address, 0)){
+		reconnecting = false;
+		return;
+	}
+	if(!reconnecting){
+		reconnecting = true; // initialize on the next update when the sensor is still there
+		return;
+	}
+	init();
+	if(!connected){
+		return;
+	}
+	eventLog.add(EVENT_SENSOR_RECONNECTED, pinNr);
+	#if USE_ONEWIRE_ASYNC
+	startRead();
+	#endif
+}
+
+void TempSensor::prepare(uint16_t timeUntilUpdate){
+#if !USE_ONEWIRE_ASYNC // the async backend starts the next conversion in the background after each read
+	if(!conversionRequested && timeUntilUpdate <= conversionTime()){
+		startConversion();
+	}
+#endif
+}
+
+void TempSensor::startConversion(void){
+	if(targetResolution != resolution && connected){
+		// only change the scratchpad, to not wear out the EEPROM of the sensor
+		if(sensor->setResolution(sensorAddress, targetResolution, false)){
+			resolution = targetResolution;
+		}
+	}
 	sensor->requestTemperatures();
-	lastRequestTime = millis();
+	lastRequestTime = ticks.millis64();
+	conversionRequested = true;
+}
+
+void TempSensor::setResolution(uint8_t bits){
+	targetResolution = constrain(bits, 9, 12);
+}
+
+uint16_t TempSensor::conversionTime(void){
+	return 750 >> (12 - resolution);
+}
+
+// Read the scratchpad, retry when the sensor does not answer or the CRC is wrong.
+// temperature is only written when the scratchpad is valid
+uint8_t TempSensor::readTemperature(fixed7_9 * temperature){
+	uint8_t status = TEMP_SENSOR_NO_PRESENCE;
+	for(uint8_t attempt = 0; attempt <= TEMP_SENSOR_READ_RETRIES; attempt++){
+		uint8_t scratchPad[9];
+		if(!sensor->readScratchPad(sensorAddress, scratchPad)){ // resets the bus first
+			status = TEMP_SENSOR_NO_PRESENCE;
+		}
+		else{
+			status = checkScratchPad(scratchPad, temperature);
+		}
+		countError(status);
+		if(status == TEMP_SENSOR_READ_OK || status == TEMP_SENSOR_POWER_ON_VALUE){
+			break; // reading the power on value again will not help
+		}
+	}
+	return status;
+}
+
+uint8_t TempSensor::checkScratchPad(uint8_t * scratchPad, fixed7_9 * temperature){
+	if(OneWire::crc8(scratchPad, 8) != scratchPad[SCRATCHPAD_CRC]){
+		return TEMP_SENSOR_CRC_ERROR;
+	}
+	// A bus that is held low reads all zeros, which has a valid CRC. The configuration register always has bits 0-4 set.
+	if(sensorAddress[0] != DS18S20MODEL && (scratchPad[CONFIGURATION] & 0x9F) != 0x1F){
+		return TEMP_SENSOR_CRC_ERROR;
+	}
+	*temperature = (((int16_t) scratchPad[TEMP_MSB]) << 8) | scratchPad[TEMP_LSB];
+	if(*temperature == DS18B20_POWER_ON_VALUE){
+		return TEMP_SENSOR_POWER_ON_VALUE;
+	}
+	return TEMP_SENSOR_READ_OK;
+}
+
+void TempSensor::countError(uint8_t status){
+	switch(status){
+		case TEMP_SENSOR_NO_PRESENCE:
+			errors.noPresence++;
+			break;
+		case TEMP_SENSOR_CRC_ERROR:
+			errors.crc++;
+			break;
+		case TEMP_SENSOR_POWER_ON_VALUE:
+			errors.powerOn++;
+			break;
+	}
+}
+
+#if USE_ONEWIRE_ASYNC
+void TempSensor::startRead(void){
+	transaction.buffer[0] = 0x55; // match rom
+	memcpy(transaction.buffer + 1, sensorAddress, 8);
+	transaction.buffer[9] = READSCRATCH;
+	transaction.txCount = 10;
+	transaction.rxCount = 9;
+	OneWireAsync::start(&transaction);
+}
+
+void TempSensor::transactionComplete(void * tempSensor){
+	TempSensor * s = (TempSensor *) tempSensor;
+	OneWireTransaction * t = &s->transaction;
+	if(t->rxCount == 0){
+		return; // conversion started
+	}
+	if(t->status == ONEWIRE_ASYNC_DONE){
+		fixed7_9 temperature;
+		s->asyncStatus = s->checkScratchPad(t->buffer + t->txCount, &temperature);
+		if(s->asyncStatus == TEMP_SENSOR_READ_OK){
+			s->asyncTemperature = temperature; // keep the last valid temperature otherwise
+		}
+	}
+	else{
+		s->asyncStatus = TEMP_SENSOR_NO_PRESENCE;
+	}
+	// start the conversion for the next update
+	t->buffer[0] = 0xCC; // skip rom
+	t->buffer[1] = STARTCONVO;
+	t->txCount = 2;
+	t->rxCount = 0;
+	OneWireAsync::start(t);
 }
+#endif
 
 fixed7_9 TempSensor::read(void){
 	return fastFilter.readInput(); //return most recent unfiltered value
 }
 
 fixed7_9 TempSensor::readFastFiltered(void){
-	return fastFilter.readOutput(); //return most recent unfiltered value
+	return fastFilter.readOutput();
 }
 
 fixed7_9 TempSensor::readSlowFiltered(void){
-	return slowFilter.readOutput(); //return most recent unfiltered value
+	return slowFilter.readOutput();
 }
 
 fixed7_9 TempSensor::readSlope(void){
-	// return slope per hour. Multiply by 300 (1h/12s), shift to single precision
-	fixed7_25 doublePrecision = slopeFilter.readOutputDoublePrecision();
-	return (doublePrecision*300)>>16;
+	// slope per hour, slope filter output is already scaled
+	return slopeFilter.readOutput();
 }
 
 fixed7_9 TempSensor::detectPosPeak(void){
@@ -150,4 +334,8 @@ void TempSensor::setSlowFilterCoefficients(uint16_t ab){
 
 void TempSensor::setSlopeFilterCoefficients(uint16_t ab){
 	slopeFilter.setCoefficients(ab);
+}
+
+void TempSensor::setSpikeFilterParameters(fixed7_9 minDeviation, uint8_t madFactor){
+	spikeFilter.setParameters(minDeviation, madFactor);
 }
\ No newline at end of file
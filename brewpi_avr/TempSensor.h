@@ -22,20 +22,52 @@
 #define SENSORS_H_
 
 #include "FixedFilter.h"
+#include "SpikeFilter.h"
+#include "SlopeEstimator.h"
 #include "OneWire.h"
 #include "DallasTemperature.h"
+#include "OneWireAsync.h"
 #include "temperatureFormats.h"
 #include "pins.h"
+#include "Ticks.h"
 #include <stdlib.h>
 
+// Result of reading the scratchpad of the sensor
+enum{
+	TEMP_SENSOR_READ_OK,
+	TEMP_SENSOR_NO_PRESENCE, // no device answered the reset pulse
+	TEMP_SENSOR_CRC_ERROR, // scratchpad is corrupted
+	TEMP_SENSOR_POWER_ON_VALUE // 85 deg C: the sensor was reset after the conversion was started
+};
+
+// Number of failed reads per type, including reads that succeeded after a retry. Reported over PiLink
+struct TempSensorErrors{
+	uint16_t noPresence;
+	uint16_t crc;
+	uint16_t powerOn;
+	uint16_t dropped; // samples that were kept out of the filters
+	uint16_t spikes; // samples replaced by the spike filter
+};
+
 class TempSensor{
 	public:
-	TempSensor(const uint8_t pinNumber) : pinNr(pinNumber){
+	TempSensor(const uint8_t pinNumber, uint8_t * const addressCache) : pinNr(pinNumber), eepromAddressCache(addressCache){
 		lastRequestTime = 0;
 		connected = 0;
-		updateCounter = 255; // first update for slope filter after (255-13s)
+		reconnecting = false;
+		conversionRequested = false;
+		badSamples = 0;
+		memset(&errors, 0, sizeof(errors));
+		resolution = 12;
+		targetResolution = 12;
+		updateCounter = SLOPE_ESTIMATOR_INTERVAL;
 		oneWire = new OneWire(pinNr);
 		sensor = new DallasTemperature(oneWire);
+		#if USE_ONEWIRE_ASYNC
+		OneWireAsync::initTransaction(&transaction, pinNr, &transactionComplete, this);
+		asyncTemperature = DEVICE_DISCONNECTED;
+		asyncStatus = TEMP_SENSOR_NO_PRESENCE;
+		#endif
 	};
 		
 	~TempSensor(){
@@ -46,6 +78,13 @@ class TempSensor{
 	void init();
 	bool isConnected(void);
 	void update(void);
+	// start the conversion when the next update is within the conversion time, so the temperature is fresh at the update
+	void prepare(uint16_t timeUntilUpdate);
+	// resolution (9-12 bits) for the next conversions. Lower resolution converts faster (94 ms at 9 bits, 750 ms at 12 bits)
+	void setResolution(uint8_t bits);
+	uint16_t conversionTime(void); // in milliseconds
+	
+	TempSensorErrors errors;
 	fixed7_9 read(void);
 	fixed7_9 readFastFiltered(void);
 	fixed7_9 readSlowFiltered(void);
@@ -55,21 +94,43 @@ class TempSensor{
 	void setFastFilterCoefficients(uint16_t ab);
 	void setSlowFilterCoefficients(uint16_t ab);
 	void setSlopeFilterCoefficients(uint16_t ab);
+	void setSpikeFilterParameters(fixed7_9 minDeviation, uint8_t madFactor);
 			
 	private:
 	const uint8_t pinNr;
+	uint8_t * const eepromAddressCache; // EEPROM location of the cached ROM code
 	bool connected;
-	unsigned long lastRequestTime; // in milliseconds
-	unsigned char updateCounter;
-	fixed7_25 prevOutputForSlope;	
+	bool reconnecting; // disconnected sensor was found, initialize on next update if it is still there
+	bool conversionRequested; // a conversion was started since the last read
+	uint8_t resolution; // resolution of the sensor
+	uint8_t targetResolution; // resolution for the next conversion
+	uint8_t badSamples; // consecutive corrupted samples
+	uptime_t lastRequestTime; // in milliseconds
+	unsigned char updateCounter; // samples until the next sample for the slope estimator
 	
+	SpikeFilter spikeFilter;
 	FixedFilter fastFilter;
 	FixedFilter slowFilter;
+	SlopeEstimator slopeEstimator;
 	FixedFilter slopeFilter;
 	
 	OneWire * oneWire;
 	DallasTemperature * sensor;
 	DeviceAddress sensorAddress;
+	
+	void startConversion(void);
+	void reconnect(void); // called by update() while the sensor is disconnected
+	uint8_t readTemperature(fixed7_9 * temperature); // returns one of the TEMP_SENSOR_ results
+	uint8_t checkScratchPad(uint8_t * scratchPad, fixed7_9 * temperature);
+	void countError(uint8_t status);
+	
+	#if USE_ONEWIRE_ASYNC
+	void startRead(void); // read scratchpad in the background, then start a new conversion
+	static void transactionComplete(void * tempSensor); // called from the timer interrupt
+	OneWireTransaction transaction;
+	volatile fixed7_9 asyncTemperature; // raw temperature received in the background
+	volatile uint8_t asyncStatus;
+	#endif
 };
 
 
@@ -0,0 +1,85 @@
+/*
+ * Copyright 2012 BrewPi/Elco Jacobs.
+ *
+ * This file is part of BrewPi.
+ *
+ * BrewPi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BrewPi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BrewPi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <Arduino.h>
+
+#include "Ticks.h"
+
+Ticks ticks;
+
+uint32_t Ticks::lastMillis;
+uint32_t Ticks::overflows;
+bool Ticks::synchronized;
+uint32_t Ticks::syncSeconds;
+uint16_t Ticks::syncMilliseconds;
+uptime_t Ticks::syncUptime;
+
+uptime_t Ticks::millis64(void){
+	uint32_t now = millis();
+	if(now < lastMillis){
+		overflows++; // millis() has overflowed since the last call
+	}
+	lastMillis = now;
+	return ((uptime_t) overflows << 32) | now;
+}
+
+uint32_t Ticks::timeSince(uptime_t timestamp){
+	uptime_t elapsed = millis64() - timestamp;
+	if(elapsed > 0xFFFFFFFFUL){
+		return 0xFFFFFFFFUL; // longer than 49.7 days ago
+	}
+	return elapsed;
+}
+
+void Ticks::setEpoch(uint32_t seconds, uint16_t milliseconds){
+	syncUptime = millis64();
+	syncSeconds = seconds;
+	syncMilliseconds = milliseconds;
+	synchronized = true;
+}
+
+// Divides milliseconds by 1000 with 32 bit divisions, a 64 bit division is a large library function on the AVR.
+// The quotient has to fit in 32 bits, which holds for 136 years.
+static uint32_t millisecondsToSeconds(uptime_t ms, uint16_t * remainder){
+	uint32_t part = ((uint32_t) (ms >> 32) << 16) | ((uint32_t) ms >> 16); // upper 48 bits, fit because the quotient fits
+	uint32_t upper = part / 1000;
+	part = ((part % 1000) << 16) | ((uint32_t) ms & 0xFFFF);
+	*remainder = part % 1000;
+	return (upper << 16) | (part / 1000);
+}
+
+void Ticks::toEpoch(uptime_t timestamp, uint32_t * seconds, uint16_t * milliseconds){
+	if(!synchronized){
+		*seconds = millisecondsToSeconds(timestamp, milliseconds);
+		return;
+	}
+	// milliseconds since the start of Unix second syncSeconds. The timestamp can be before it,
+	// for events that were waiting to be sent, so the difference is calculated without overflow.
+	if(timestamp + syncMilliseconds >= syncUptime){
+		*seconds = syncSeconds + millisecondsToSeconds(timestamp + syncMilliseconds - syncUptime, milliseconds);
+		return;
+	}
+	uint16_t remainder;
+	*seconds = syncSeconds - millisecondsToSeconds(syncUptime - syncMilliseconds - timestamp, &remainder);
+	*milliseconds = 0;
+	if(remainder > 0){ // round towards minus infinity
+		(*seconds)--;
+		*milliseconds = 1000 - remainder;
+	}
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright 2012 BrewPi/Elco Jacobs.
+ *
+ * This file is part of BrewPi.
+ *
+ * BrewPi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BrewPi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BrewPi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TICKS_H_
+#define TICKS_H_
+
+#include <inttypes.h>
+
+/* Monotonic time base for all timers.
+ millis() overflows after 49.7 days. Ticks extends it to 64 bits by counting the overflows.
+ The overflow interrupt of Timer0 is owned by the Arduino core, so overflows are detected in software:
+ every call compares millis() with the previous value. This only works if millis64() is called at least once
+ every 49.7 days, loop() calls it every second. tools/ticksTest.cpp checks this across the overflow on the host.
+ Only call these functions from the main loop, not from an interrupt.
+
+ The host sends its clock (Unix time) with the 'y' command. The difference with the uptime is stored,
+ so every uptime timestamp can be converted to Unix time. Until the first synchronization, the converted time
+ is the uptime in seconds. The conversion uses the full 64 bit uptime, so timestamps can be any time before or after
+ the last synchronization. The host synchronizes regularly anyway, which corrects the drift of the crystal.
+*/
+
+typedef uint64_t uptime_t; // milliseconds since startup, never overflows
+
+class Ticks{
+	public:
+	Ticks(){};
+	~Ticks(){};
+
+	static uptime_t millis64(void); // milliseconds since startup
+
+	// milliseconds since timestamp, limited to 32 bits (49.7 days).
+	// A timer that was never set (timestamp 0) returns the time since startup.
+	static uint32_t timeSince(uptime_t timestamp);
+
+	static void setEpoch(uint32_t seconds, uint16_t milliseconds); // Unix time of the host now
+	static void toEpoch(uptime_t timestamp, uint32_t * seconds, uint16_t * milliseconds); // Unix time of a timestamp
+	static bool isSynchronized(void){
+		return synchronized;
+	};
+
+	private:
+	static uint32_t lastMillis;
+	static uint32_t overflows;
+	static bool synchronized;
+	static uint32_t syncSeconds; // Unix time at syncUptime
+	static uint16_t syncMilliseconds;
+	static uptime_t syncUptime; // uptime at the last synchronization
+};
+
+extern Ticks ticks;
+
+#endif /* TICKS_H_ */
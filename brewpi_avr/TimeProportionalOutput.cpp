@@ -0,0 +1,101 @@
+/*
+ * Copyright 2012 BrewPi/Elco Jacobs.
+ *
+ * This file is part of BrewPi.
+ *
+ * BrewPi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BrewPi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BrewPi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <Arduino.h>
+
+#include "TimeProportionalOutput.h"
+
+void TimeProportionalOutput::setConstraints(uint16_t newWindow, uint16_t newMinOn, uint16_t newMinOff){
+	window = newWindow;
+	minOn = newMinOn;
+	minOff = newMinOff;
+	windowOnTime = 0;
+	carry = 0;
+	windowStartTime = ticks.millis64() - (unsigned long) window * 1000; // start a new window on next update
+}
+
+bool TimeProportionalOutput::update(fixed7_9 duty, bool enabled){
+	uptime_t now = ticks.millis64();
+	bool wantOn;
+
+	if(!enabled){
+		carry = 0;
+		if(on){
+			// switch off at once, minimum on time only applies to the window
+			switchTo(false, now);
+		}
+		return on;
+	}
+	if(window == 0){
+		wantOn = true;
+	}
+	else{
+		if(now - windowStartTime >= (uptime_t) window * 1000){
+			// start a new window, calculate on time for this window
+			windowStartTime = now;
+			duty = constrain(duty, 0, 512);
+			uint16_t onTime = (((uint32_t) duty * window)>>9) + carry;
+			carry = 0;
+			if(onTime < minOn){
+				carry = onTime; // too short to switch on, add it to the next window
+				onTime = 0;
+			}
+			else if(onTime + minOff > window){
+				onTime = window; // off time would be too short, stay on
+			}
+			windowOnTime = onTime;
+		}
+		wantOn = (now - windowStartTime) < (uptime_t) windowOnTime * 1000;
+	}
+
+	uint32_t timeSinceSwitch = ticks.timeSince(lastSwitchTime);
+	if(on && !wantOn && timeSinceSwitch < (unsigned long) minOn * 1000){
+		wantOn = true; // respect minimum on time
+	}
+	if(!on && wantOn && timeSinceSwitch < (unsigned long) minOff * 1000){
+		wantOn = false; // respect minimum off time
+	}
+	if(wantOn != on){
+		switchTo(wantOn, now);
+	}
+	return on;
+}
+
+void TimeProportionalOutput::switchTo(bool newOn, uptime_t now){
+	if(newOn){
+		onSince = now;
+	}
+	else{
+		accumulatedOnTime += now - onSince;
+	}
+	on = newOn;
+	lastSwitchTime = now;
+}
+
+uint32_t TimeProportionalOutput::onTime(void){
+	if(on){
+		return accumulatedOnTime + (ticks.millis64() - onSince);
+	}
+	return accumulatedOnTime;
+}
+
+void TimeProportionalOutput::resetOnTime(void){
+	accumulatedOnTime = 0;
+	onSince = ticks.millis64();
+}
\ No newline at end of file
@@ -0,0 +1,82 @@
+/*
+ * Copyright 2012 BrewPi/Elco Jacobs.
+ *
+ * This file is part of BrewPi.
+ *
+ * BrewPi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BrewPi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BrewPi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TIMEPROPORTIONALOUTPUT_H_
+#define TIMEPROPORTIONALOUTPUT_H_
+
+/* Slow PWM for a relay output (heater or compressor).
+ Each window, the output is on for duty * window seconds and off for the rest of the window.
+ On times shorter than minOn are carried over to the next window instead of switching the relay.
+ When the off time would be shorter than minOff, the output stays on for the whole window.
+ The window does not switch the output off within minOn seconds after switching on, and the output is never switched on
+ within minOff seconds after switching off.
+ Disabling the output switches it off at once, minOn does not apply: the state machine has its own timers for the compressor.
+ A window of 0 disables time proportioning: the output is fully on when enabled.
+ The time the output was on is accumulated, so the overshoot models can use the energized time of a run instead of its duration.
+*/
+
+#include "temperatureFormats.h"
+#include "Ticks.h"
+
+class TimeProportionalOutput{
+	public:
+	TimeProportionalOutput(){
+		window = 0;
+		minOn = 0;
+		minOff = 0;
+		on = false;
+		lastSwitchTime = 0;
+		windowStartTime = 0;
+		windowOnTime = 0;
+		carry = 0;
+		accumulatedOnTime = 0;
+		onSince = 0;
+	};
+	~TimeProportionalOutput(){};
+
+	// window, minimum on time and minimum off time in seconds
+	void setConstraints(uint16_t newWindow, uint16_t newMinOn, uint16_t newMinOff);
+
+	// duty is a fraction in fixed7_9 format (512 = 100%). Returns whether the output should be on
+	bool update(fixed7_9 duty, bool enabled);
+
+	bool isOn(void){
+		return on;
+	};
+
+	// milliseconds the output was on since the last call of resetOnTime()
+	uint32_t onTime(void);
+	void resetOnTime(void);
+
+	private:
+	void switchTo(bool newOn, uptime_t now);
+
+	uint16_t window;
+	uint16_t minOn;
+	uint16_t minOff;
+	bool on;
+	uptime_t lastSwitchTime; // time of last switch
+	uptime_t windowStartTime; // start of current window
+	uint16_t windowOnTime; // on time in current window in seconds
+	uint16_t carry; // requested on time that was too short to switch on, in seconds
+	uint32_t accumulatedOnTime; // milliseconds on since resetOnTime(), without the current on period
+	uptime_t onSince; // start of the current on period, or the time of resetOnTime() when that is later
+};
+
+#endif /* TIMEPROPORTIONALOUTPUT_H_ */
\ No newline at end of file
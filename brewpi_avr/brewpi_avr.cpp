@@ -34,6 +34,8 @@
 #include "pins.h"
 #include "RotaryEncoder.h"
 #include "Buzzer.h"
+#include "Ticks.h"
+#include "EventLog.h"
 
 // global class opbjects static and defined in class cpp and h files
 
@@ -71,7 +73,7 @@ void setup()
 	
 	rotaryEncoder.init();
 	
-	piLink.printFridgeAnnotation(PSTR("Arduino restarted!"));
+	eventLog.add(EVENT_RESTARTED);
 	buzzer.init();
 	buzzer.beep(2, 500);
 }
@@ -96,9 +98,10 @@ void main(void)
 
 void loop(void)
 {
-	static unsigned long lastUpdate;
-	if(millis() - lastUpdate > 1000){ //update settings every second
-		lastUpdate=millis();
+	static uptime_t lastUpdate;
+	uint32_t timeSinceUpdate = ticks.timeSince(lastUpdate);
+	if(timeSinceUpdate > 1000){ //update settings every second
+		lastUpdate=ticks.millis64();
 		
 		tempControl.updateTemperatures();		
 		tempControl.detectPeaks();
@@ -110,6 +113,10 @@ void loop(void)
 		display.printAllTemperatures();
 		display.printMode();
 	}
+	else{
+		// start temperature conversions so they finish just before the next update
+		tempControl.prepareTemperatures(1000 - timeSinceUpdate);
+	}
 	if(rotaryEncoder.pushed()){
 		rotaryEncoder.resetPushed();
 		menu.pickSettingToChange();		
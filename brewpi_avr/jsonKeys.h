@@ -30,6 +30,8 @@ struct jsonKeysContainer{
 	const char * fridgeSetting;
 	const char * heatEstimator;
 	const char * coolEstimator;
+	const char * heatLag;
+	const char * coolLag;
 	// constants
 	const char * tempFormat;
 	const char * tempSettingMin;
@@ -58,6 +60,17 @@ struct jsonKeysContainer{
 	const char * beerFastFilter;
 	const char * beerSlowFilter;
 	const char * beerSlopeFilter;
+	const char * pwmGain;
+	const char * heatPwmWindow;
+	const char * heatMinOn;
+	const char * heatMinOff;
+	const char * coolPwmWindow;
+	const char * coolMinOn;
+	const char * coolMinOff;
+	const char * heatPower;
+	const char * coolPower;
+	const char * spikeMinDeviation;
+	const char * spikeMadFactor;
 	// variables
 	const char * beerDiff;
 	const char * diffIntegral;
@@ -72,10 +85,46 @@ struct jsonKeysContainer{
 	const char * posPeakSetting;
 	const char * negPeak;
 	const char * posPeak;
+	const char * duty;
+	// runtime statistics
+	const char * timeCooling;
+	const char * timeHeating;
+	const char * timeIdle;
+	const char * timeDoorOpen;
+	const char * timeOff;
+	const char * countCooling;
+	const char * countHeating;
+	const char * countIdle;
+	const char * countDoorOpen;
+	const char * countOff;
+	const char * heatStarts;
+	const char * coolStarts;
+	const char * heatOnTime;
+	const char * coolOnTime;
+	const char * heatEnergy;
+	const char * coolEnergy;
+	// sensor errors
+	const char * beerNoPresence;
+	const char * beerCrcErrors;
+	const char * beerPowerOn;
+	const char * beerDropped;
+	const char * beerSpikes;
+	const char * fridgeNoPresence;
+	const char * fridgeCrcErrors;
+	const char * fridgePowerOn;
+	const char * fridgeDropped;
+	const char * fridgeSpikes;
+	// logging
+	const char * logLevel;
+	const char * logMask;
+	// link
+	const char * chunkFrames;
 };
 
 // These will be placed in data memory, but there's plenty left.
 // By defining them in this struct, the only have to be stored once.
+#define NUM_JSON_KEYS (sizeof(jsonKeysContainer) / sizeof(const char *))
+
 const jsonKeysContainer jsonKeys = {
 	// settings
 	"mode",
@@ -83,6 +132,8 @@ const jsonKeysContainer jsonKeys = {
 	"fridgeSetting",
 	"heatEstimator",
 	"coolEstimator",
+	"heatLag",
+	"coolLag",
 	// constants
 	"tempFormat",
 	"tempSettingMin",
@@ -111,6 +162,17 @@ const jsonKeysContainer jsonKeys = {
 	"beerFastFilter",
 	"beerSlowFilter",
 	"beerSlopeFilter",
+	"pwmGain",
+	"heatPwmWindow",
+	"heatMinOn",
+	"heatMinOff",
+	"coolPwmWindow",
+	"coolMinOn",
+	"coolMinOff",
+	"heatPower",
+	"coolPower",
+	"spikeMinDeviation",
+	"spikeMadFactor",
 	// variables
 	"beerDiff",
 	"diffIntegral",
@@ -124,7 +186,41 @@ const jsonKeysContainer jsonKeys = {
 	"negPeakSetting",
 	"posPeakSetting",
 	"negPeak",
-	"posPeak"
+	"posPeak",
+	"duty",
+	// runtime statistics
+	"timeCooling",
+	"timeHeating",
+	"timeIdle",
+	"timeDoorOpen",
+	"timeOff",
+	"countCooling",
+	"countHeating",
+	"countIdle",
+	"countDoorOpen",
+	"countOff",
+	"heatStarts",
+	"coolStarts",
+	"heatOnTime",
+	"coolOnTime",
+	"heatEnergy",
+	"coolEnergy",
+	// sensor errors
+	"beerNoPresence",
+	"beerCrcErrors",
+	"beerPowerOn",
+	"beerDropped",
+	"beerSpikes",
+	"fridgeNoPresence",
+	"fridgeCrcErrors",
+	"fridgePowerOn",
+	"fridgeDropped",
+	"fridgeSpikes",
+	// logging
+	"logLevel",
+	"logMask",
+	// link
+	"chunkFrames"
 };
 
 #endif /* JSON_H_ */
\ No newline at end of file
@@ -25,6 +25,9 @@
 
 #define beerSensorPin    A5 // OneWire 1
 #define fridgeSensorPin  A4 // OneWire 2
+// With ONEWIRE_UART (OneWire.h), the bus on RX1/TX1 can replace A4 or A5: define that sensor pin as ONEWIRE_UART_PIN.
+// Only one sensor can be on that bus, each sensor uses the first device on its bus. The build fails when both are.
+// RX1 and TX1 are then taken by the 1-Wire bus, see OneWireUart.h for the wiring.
 
 #define coolingPin	6
 #define heatingPin	5
@@ -42,5 +45,8 @@
 // If you are using the light bulb of your fridge as a heater, set this define to true
 // It will turn on the light when the door is opened
 #define LIGHT_AS_HEATER true
+// Read the temperature sensors in the background, with Timer1 interrupts generating the 1-Wire time slots.
+// When false, the sensors are read by bit banging and busy waiting. Parasite power is not supported when true.
+#define USE_ONEWIRE_ASYNC false
 
 #endif /* PINS_H_ */
\ No newline at end of file
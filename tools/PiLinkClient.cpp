@@ -0,0 +1,692 @@
+/*
+ * Copyright 2012 BrewPi/Elco Jacobs.
+ *
+ * This file is part of BrewPi.
+ *
+ * BrewPi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BrewPi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BrewPi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "PiLinkClient.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+static uint64_t milliseconds(void){
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return (uint64_t) now.tv_sec * 1000 + now.tv_usec / 1000;
+}
+
+PiLinkClient::PiLinkClient(){
+	fd = -1;
+	timeout = 2000;
+	bytesSent = 0;
+	bytesReceived = 0;
+	chunksReceived = 0;
+}
+
+PiLinkClient::~PiLinkClient(){
+	close();
+}
+
+bool PiLinkClient::open(const char * device){
+	close();
+	fd = ::open(device, O_RDWR | O_NOCTTY);
+	if(fd < 0){
+		return false;
+	}
+	struct termios tty;
+	if(tcgetattr(fd, &tty) == 0){ // fails for pipes and sockets, which do not need it
+		cfmakeraw(&tty);
+		cfsetispeed(&tty, B57600);
+		cfsetospeed(&tty, B57600);
+		tty.c_cflag |= CLOCAL | CREAD;
+		tcsetattr(fd, TCSANOW, &tty);
+	}
+	rxBuffer.clear();
+	queue.clear();
+	partialFrames.clear();
+	bytesSent = 0;
+	bytesReceived = 0;
+	chunksReceived = 0;
+	return true;
+}
+
+void PiLinkClient::close(void){
+	if(fd >= 0){
+		::close(fd);
+		fd = -1;
+	}
+}
+
+bool PiLinkClient::sendCommand(char command){
+	if(write(fd, &command, 1) != 1){
+		return false;
+	}
+	bytesSent++;
+	return true;
+}
+
+bool PiLinkClient::sendText(const std::string & text){
+	if(write(fd, text.data(), text.size()) != (ssize_t) text.size()){
+		return false;
+	}
+	bytesSent += text.size();
+	return true;
+}
+
+// "j{" followed by the pairs and the closing brace. first is put before the settings, for example the id of a transaction
+static std::string jsonUpdate(const std::string & first, const PiLinkJson & settings){
+	std::string message = "j{" + first;
+	for(PiLinkJson::const_iterator it = settings.begin(); it != settings.end(); ++it){
+		if(it != settings.begin() || !first.empty()){
+			message += ",";
+		}
+		message += "\"" + it->first + "\":" + it->second;
+	}
+	message += "}";
+	return message;
+}
+
+bool PiLinkClient::sendSettings(const PiLinkJson & settings){
+	if(!sendText(jsonUpdate("", settings))){
+		return false;
+	}
+	PiLinkReply reply;
+	return waitForReply('S', &reply) && waitForReply('C', &reply);
+}
+
+bool PiLinkClient::sendTransaction(uint16_t id, const PiLinkJson & settings, PiLinkTransaction * result){
+	char idPair[16];
+	snprintf(idPair, sizeof(idPair), "\"id\":%u", id);
+	PiLinkReply reply;
+	if(!sendText(jsonUpdate(idPair, settings)) || !waitForReply("AN", &reply) || !parse(reply.payload, result)){
+		return false;
+	}
+	result->complete = (reply.type == 'A');
+	return result->id == id;
+}
+
+bool PiLinkClient::requestBatch(const std::string & requests, PiLinkBatch * result){
+	PiLinkReply reply;
+	return sendText("b" + requests + "\n") && waitForReply('B', &reply) && parse(reply.payload, result);
+}
+
+bool PiLinkClient::enableChunks(bool enable){
+	PiLinkJson settings;
+	settings["chunkFrames"] = enable ? "1" : "0";
+	return sendSettings(settings);
+}
+
+bool PiLinkClient::synchronizeTime(double * roundTrip, double * offset){
+	char message[32];
+	uint64_t sent = milliseconds();
+	int length = snprintf(message, sizeof(message), "y%llu.%03llu\n",
+		(unsigned long long) (sent / 1000), (unsigned long long) (sent % 1000));
+	if(!sendText(std::string(message, length))){
+		return false;
+	}
+	PiLinkReply reply;
+	PiLinkJson json;
+	if(!waitForReply('Y', &reply) || !parseJson(reply.payload, &json) || !json.count("time")){
+		return false;
+	}
+	uint64_t received = milliseconds();
+	*roundTrip = (received - sent) / 1000.0;
+	*offset = strtod(json["time"].c_str(), NULL) - (sent + received) / 2000.0;
+	return true;
+}
+
+bool PiLinkClient::requestSnapshot(std::string * snapshot){
+	PiLinkReply reply;
+	if(!sendCommand('p') || !waitForReply('P', &reply) || !checkSnapshot(reply.payload)){
+		return false;
+	}
+	*snapshot = reply.payload;
+	return true;
+}
+
+bool PiLinkClient::restoreSnapshot(const std::string & snapshot, int * result){
+	if(!sendText("w" + snapshot + "\n")){
+		return false;
+	}
+	PiLinkReply reply;
+	PiLinkJson json;
+	if(!waitForReply('W', &reply) || !parseJson(reply.payload, &json) || !json.count("result")){
+		return false;
+	}
+	*result = atoi(json["result"].c_str());
+	return true;
+}
+
+// same as _crc_ccitt_update of avr-libc
+static uint16_t crcCcittUpdate(uint16_t crc, uint8_t data){
+	data ^= crc & 0xFF;
+	data ^= data << 4;
+	return ((((uint16_t) data << 8) | (crc >> 8)) ^ (uint8_t) (data >> 4) ^ ((uint16_t) data << 3));
+}
+
+// the last 2 bytes are the CRC of the bytes before it, little endian
+bool PiLinkClient::checkSnapshot(const std::string & snapshot){
+	if(snapshot.size() < 10 || snapshot.size() % 2 != 0){
+		return false;
+	}
+	std::vector<uint8_t> bytes;
+	for(size_t i = 0; i < snapshot.size(); i += 2){
+		char * end;
+		std::string digits = snapshot.substr(i, 2);
+		bytes.push_back((uint8_t) strtoul(digits.c_str(), &end, 16));
+		if(*end != 0){
+			return false;
+		}
+	}
+	if(bytes[2] != bytes.size()){
+		return false; // length field
+	}
+	uint16_t crc = 0xFFFF;
+	for(size_t i = 0; i < bytes.size() - 2; i++){
+		crc = crcCcittUpdate(crc, bytes[i]);
+	}
+	return crc == (bytes[bytes.size() - 2] | (bytes[bytes.size() - 1] << 8));
+}
+
+// reads until a complete line is available or the timeout expires
+bool PiLinkClient::readLine(std::string * line){
+	uint64_t deadline = milliseconds() + timeout;
+	while(true){
+		size_t end = rxBuffer.find('\n');
+		if(end != std::string::npos){
+			*line = rxBuffer.substr(0, end);
+			rxBuffer.erase(0, end + 1);
+			if(!line->empty() && (*line)[line->size() - 1] == '\r'){
+				line->erase(line->size() - 1);
+			}
+			return true;
+		}
+		uint64_t now = milliseconds();
+		if(now >= deadline){
+			return false;
+		}
+		struct pollfd pfd;
+		pfd.fd = fd;
+		pfd.events = POLLIN;
+		if(poll(&pfd, 1, (int) (deadline - now)) <= 0){
+			return false;
+		}
+		char buffer[256];
+		ssize_t count = read(fd, buffer, sizeof(buffer));
+		if(count <= 0){
+			return false;
+		}
+		bytesReceived += count;
+		rxBuffer.append(buffer, count);
+	}
+}
+
+bool PiLinkClient::readFrame(PiLinkReply * reply){
+	std::string line;
+	while(readLine(&line)){
+		if(line.size() < 2 || (line[1] != ':' && line[1] != '+')){
+			continue; // not a reply, for example output of the bootloader. Skip it.
+		}
+		char type = line[0];
+		if(line[1] == '+'){
+			partialFrames[type] += line.substr(2); // more chunks follow
+			chunksReceived++;
+			continue;
+		}
+		reply->type = type;
+		reply->payload = partialFrames[type] + line.substr(2);
+		partialFrames.erase(type);
+		return true;
+	}
+	return false;
+}
+
+bool PiLinkClient::readReply(PiLinkReply * reply){
+	if(!queue.empty()){
+		*reply = queue.front();
+		queue.erase(queue.begin());
+		return true;
+	}
+	return readFrame(reply);
+}
+
+bool PiLinkClient::waitForReply(char type, PiLinkReply * reply){
+	char types[2] = { type, 0 };
+	return waitForReply(types, reply);
+}
+
+bool PiLinkClient::waitForReply(const char * types, PiLinkReply * reply){
+	for(size_t i = 0; i < queue.size(); i++){
+		if(strchr(types, queue[i].type) != NULL){
+			*reply = queue[i];
+			queue.erase(queue.begin() + i);
+			return true;
+		}
+	}
+	PiLinkReply received;
+	while(readFrame(&received)){
+		if(strchr(types, received.type) != NULL){
+			*reply = received;
+			return true;
+		}
+		queue.push_back(received);
+	}
+	return false;
+}
+
+template<class T> bool PiLinkClient::request(char command, char type, T * result){
+	PiLinkReply reply;
+	return sendCommand(command) && waitForReply(type, &reply) && parse(reply.payload, result);
+}
+
+bool PiLinkClient::requestTemperatures(PiLinkTemperatures * result){ return request('t', 'T', result); }
+bool PiLinkClient::requestSettings(PiLinkSettings * result){ return request('s', 'S', result); }
+bool PiLinkClient::requestConstants(PiLinkConstants * result){ return request('c', 'C', result); }
+bool PiLinkClient::requestVariables(PiLinkVariables * result){ return request('v', 'V', result); }
+bool PiLinkClient::requestRuntimeStatistics(PiLinkRuntimeStatistics * result){ return request('r', 'R', result); }
+bool PiLinkClient::requestSensorErrors(PiLinkSensorErrors * result){ return request('e', 'E', result); }
+bool PiLinkClient::requestDisplay(PiLinkDisplay * result){ return request('l', 'L', result); }
+bool PiLinkClient::requestDisplayChanges(PiLinkDisplay * display){
+	PiLinkReply reply;
+	return sendCommand('m') && waitForReply('M', &reply) && applyDisplayChanges(reply.payload, display);
+}
+bool PiLinkClient::requestEvents(PiLinkEvents * result){ return request('g', 'G', result); }
+
+// Parses a flat JSON object. Quotes are removed from string values.
+// Spaces outside strings are removed, the firmware can send a space between a minus sign and the number.
+bool PiLinkClient::parseJson(const std::string & text, PiLinkJson * result){
+	result->clear();
+	size_t pos = text.find('{');
+	if(pos == std::string::npos){
+		return false;
+	}
+	pos++;
+	while(pos < text.size()){
+		// key
+		size_t keyStart = text.find('"', pos);
+		if(keyStart == std::string::npos){
+			break;
+		}
+		size_t keyEnd = text.find('"', keyStart + 1);
+		size_t colon = text.find(':', keyEnd);
+		if(keyEnd == std::string::npos || colon == std::string::npos){
+			return false;
+		}
+		std::string key = text.substr(keyStart + 1, keyEnd - keyStart - 1);
+		// value
+		pos = colon + 1;
+		std::string value;
+		bool quoted = false;
+		while(pos < text.size()){
+			char c = text[pos];
+			if(c == '"'){
+				quoted = !quoted;
+			}
+			else if(!quoted && (c == ',' || c == '}')){
+				break;
+			}
+			else if(quoted || c != ' '){
+				value += c;
+			}
+			pos++;
+		}
+		if(pos >= text.size()){
+			return false; // no closing brace
+		}
+		(*result)[key] = value;
+		if(text[pos] == '}'){
+			return true;
+		}
+		pos++;
+	}
+	return false;
+}
+
+static void convert(const std::string & text, double * field){
+	*field = (text.empty() || text == "null") ? NAN : strtod(text.c_str(), NULL);
+}
+static void convert(const std::string & text, uint32_t * field){
+	*field = strtoul(text.c_str(), NULL, 10);
+}
+static void convert(const std::string & text, char * field){
+	*field = text.empty() ? 0 : text[0];
+}
+
+// missing keys keep a default (NaN or 0), so older firmware without new keys can still be parsed
+static void initialize(double * field){ *field = NAN; }
+static void initialize(uint32_t * field){ *field = 0; }
+static void initialize(char * field){ *field = 0; }
+
+#define PILINK_PARSE_FIELD(type, name) \
+	initialize(&result->name); \
+	if(json.count(#name)){ convert(json[#name], &result->name); }
+
+#define PILINK_DEFINE_PARSER(structType, fields) \
+	bool PiLinkClient::parse(const std::string & payload, structType * result){ \
+		PiLinkJson json; \
+		if(!parseJson(payload, &json)){ \
+			return false; \
+		} \
+		fields(PILINK_PARSE_FIELD) \
+		return true; \
+	}
+
+PILINK_DEFINE_PARSER(PiLinkTemperatures, PILINK_TEMPERATURES_FIELDS)
+PILINK_DEFINE_PARSER(PiLinkSettings, PILINK_SETTINGS_FIELDS)
+PILINK_DEFINE_PARSER(PiLinkConstants, PILINK_CONSTANTS_FIELDS)
+PILINK_DEFINE_PARSER(PiLinkVariables, PILINK_VARIABLES_FIELDS)
+PILINK_DEFINE_PARSER(PiLinkRuntimeStatistics, PILINK_RUNTIME_STATISTICS_FIELDS)
+PILINK_DEFINE_PARSER(PiLinkSensorErrors, PILINK_SENSOR_ERRORS_FIELDS)
+
+// display content is 4 lines separated by <BR>
+bool PiLinkClient::parse(const std::string & payload, PiLinkDisplay * result){
+	size_t pos = 0;
+	for(int i = 0; i < 4; i++){
+		size_t end = payload.find("<BR>", pos);
+		if(end == std::string::npos){
+			return false;
+		}
+		result->lines[i] = payload.substr(pos, end - pos);
+		pos = end + 4;
+	}
+	return true;
+}
+
+// Contents of a JSON string from the display text that starts at pos, up to the closing quote.
+// \u00XX gives the byte XX, so the degree sign is 0xB0 again, like in the L: frame.
+// pos is left at the closing quote. False when the string does not end.
+static bool unescapeDisplayText(const char *& pos, std::string * text){
+	for(; *pos != '"'; pos++){
+		if(*pos == 0){
+			return false;
+		}
+		if(*pos == '\\' && pos[1] == 'u'){
+			char * end;
+			char hex[5] = {0};
+			strncpy(hex, pos + 2, 4);
+			unsigned long code = strtoul(hex, &end, 16);
+			if(end != hex + 4 || code > 0xFF){
+				return false;
+			}
+			*text += (char) code;
+			pos += 5;
+			continue;
+		}
+		if(*pos == '\\' && pos[1] != 0){
+			pos++;
+		}
+		*text += *pos;
+	}
+	return true;
+}
+
+// runs of changed cells: [[row,col,"text"],...], the text is escaped like a JSON string
+bool PiLinkClient::applyDisplayChanges(const std::string & payload, PiLinkDisplay * display){
+	const char * pos = payload.c_str();
+	if(*pos != '['){
+		return false;
+	}
+	pos++;
+	while(*pos == '['){
+		char * end;
+		unsigned long row = strtoul(pos + 1, &end, 10);
+		if(*end != ','){
+			return false;
+		}
+		unsigned long col = strtoul(end + 1, &end, 10);
+		if(end[0] != ',' || end[1] != '"' || row >= 4){
+			return false;
+		}
+		std::string text;
+		pos = end + 2;
+		if(!unescapeDisplayText(pos, &text)){
+			return false;
+		}
+		std::string & line = display->lines[row];
+		if(line.size() < col + text.size()){
+			line.resize(col + text.size(), ' ');
+		}
+		line.replace(col, text.size(), text);
+		pos++; // closing quote
+		if(*pos != ']'){
+			return false;
+		}
+		pos++;
+		if(*pos == ','){
+			pos++;
+		}
+	}
+	return *pos == ']';
+}
+
+// {"seq":first sequence number,"lost":n,"events":[[time,code,args...],...]}
+bool PiLinkClient::parse(const std::string & payload, PiLinkEvents * result){
+	result->events.clear();
+	size_t seqPos = payload.find("\"seq\":");
+	size_t lostPos = payload.find("\"lost\":");
+	size_t listPos = payload.find("\"events\":[");
+	if(seqPos == std::string::npos || lostPos == std::string::npos || listPos == std::string::npos){
+		return false;
+	}
+	uint16_t sequence = strtoul(payload.c_str() + seqPos + 6, NULL, 10);
+	result->lost = strtoul(payload.c_str() + lostPos + 7, NULL, 10);
+	const char * pos = payload.c_str() + listPos + 9; // opening bracket of the list
+	while(*pos == '[' || *pos == ','){
+		pos++;
+		if(*pos != '['){
+			break; // end of the list
+		}
+		pos++;
+		std::vector<double> values; // time with decimals, then integers
+		while(true){
+			char * end;
+			double value = strtod(pos, &end);
+			if(end == pos){
+				return false;
+			}
+			values.push_back(value);
+			pos = end;
+			if(*pos == ']'){
+				pos++;
+				break;
+			}
+			if(*pos != ','){
+				return false;
+			}
+			pos++;
+		}
+		if(values.size() < 2){
+			return false;
+		}
+		PiLinkEvent event;
+		event.sequence = sequence++;
+		event.time = values[0];
+		event.code = (uint8_t) values[1];
+		event.args.assign(values.begin() + 2, values.end());
+		result->events.push_back(event);
+	}
+	return *pos == ']';
+}
+
+// {"id":12,"applied":["beerSetting","fridgeSetting"],"rejected":0}
+bool PiLinkClient::parse(const std::string & payload, PiLinkTransaction * result){
+	size_t idPos = payload.find("\"id\":");
+	size_t listPos = payload.find("\"applied\":[");
+	size_t rejectedPos = payload.find("\"rejected\":");
+	if(idPos == std::string::npos || listPos == std::string::npos || rejectedPos == std::string::npos){
+		return false;
+	}
+	result->id = strtoul(payload.c_str() + idPos + 5, NULL, 10);
+	result->rejected = strtoul(payload.c_str() + rejectedPos + 11, NULL, 10);
+	result->complete = true;
+	result->applied.clear();
+	size_t pos = listPos + 11;
+	while(pos < payload.size() && payload[pos] != ']'){
+		if(payload[pos] != '"'){
+			pos++; // comma
+			continue;
+		}
+		size_t end = payload.find('"', pos + 1);
+		if(end == std::string::npos){
+			return false;
+		}
+		result->applied.push_back(payload.substr(pos + 1, end - pos - 1));
+		pos = end + 1;
+	}
+	return pos < payload.size();
+}
+
+// position after the JSON value that starts at pos: an object, list, string or number. npos when it is not complete.
+static size_t valueEnd(const std::string & text, size_t pos){
+	int depth = 0;
+	bool quoted = false;
+	for(; pos < text.size(); pos++){
+		char c = text[pos];
+		if(quoted){
+			if(c == '\\'){
+				pos++;
+			}
+			else if(c == '"'){
+				quoted = false;
+				if(depth == 0){
+					return pos + 1;
+				}
+			}
+		}
+		else if(c == '"'){
+			quoted = true;
+		}
+		else if(c == '{' || c == '['){
+			depth++;
+		}
+		else if(c == '}' || c == ']'){
+			if(depth == 0){
+				return pos; // end of the enclosing object, after a number
+			}
+			depth--;
+			if(depth == 0){
+				return pos + 1;
+			}
+		}
+		else if(c == ',' && depth == 0){
+			return pos;
+		}
+	}
+	return std::string::npos;
+}
+
+// {"T":{...},"L":"...","M":[...]}. The display content is a string, it is unescaped like the L: frame.
+bool PiLinkClient::parse(const std::string & payload, PiLinkBatch * result){
+	result->clear();
+	size_t pos = payload.find('{');
+	if(pos == std::string::npos){
+		return false;
+	}
+	pos++;
+	while(pos < payload.size() && payload[pos] != '}'){
+		if(payload[pos] == ','){
+			pos++;
+		}
+		if(payload.compare(pos, 1, "\"") != 0 || payload.compare(pos + 2, 2, "\":") != 0){
+			return false;
+		}
+		char type = payload[pos + 1];
+		size_t start = pos + 4;
+		size_t end = valueEnd(payload, start);
+		if(end == std::string::npos){
+			return false;
+		}
+		std::string value = payload.substr(start, end - start);
+		if(value[0] == '"'){
+			const char * text = value.c_str() + 1;
+			std::string unescaped;
+			if(!unescapeDisplayText(text, &unescaped)){
+				return false;
+			}
+			value = unescaped;
+		}
+		(*result)[type] = value;
+		pos = end;
+	}
+	return pos < payload.size();
+}
+
+// Text per event code, %T is a temperature, %F a fixed point number, %c a character and %d an integer.
+// The index is the EVENT_ code of EventLog.h.
+static const char * const eventFormats[] = {
+	"",
+	"Arduino restarted!",
+	"Fridge door opened",
+	"Fridge door closed",
+	"Mode set to %c in web interface",
+	"Mode set to %c in menu",
+	"Beer temperature setting changed to %T in web interface.",
+	"Beer temperature setting changed to %T by temperature profile.",
+	"Beer temperature setting changed to %T in Menu.",
+	"Fridge temperature setting changed to %T in web interface.",
+	"Fridge temperature setting changed to %T in Menu.",
+	"Positive peak detected at %T.",
+	"Drifting up after heating too short, peak %T.",
+	"Negative peak detected at %T.",
+	"Drifting down after cooling too short, peak %T.",
+	"Peak: %T Estimated: %T. New heat estimator: %F, lag: %F",
+	"Peak: %T Estimated: %T. New cool estimator: %F, lag: %F",
+	"Unable to find address for sensor on pin %d",
+	"Temperature sensor on pin %d disconnected",
+	"Temperature sensor on pin %d reconnected",
+};
+#define NUM_EVENT_FORMATS (sizeof(eventFormats) / sizeof(eventFormats[0]))
+
+std::string PiLinkClient::eventText(const PiLinkEvent & event){
+	char buffer[32];
+	if(event.code >= NUM_EVENT_FORMATS){
+		snprintf(buffer, sizeof(buffer), "Unknown event %u", event.code);
+		return buffer;
+	}
+	std::string text;
+	size_t arg = 0;
+	for(const char * format = eventFormats[event.code]; *format != 0; format++){
+		if(*format != '%' || format[1] == 0){
+			text += *format;
+			continue;
+		}
+		format++;
+		int16_t value = (arg < event.args.size()) ? event.args[arg] : 0;
+		arg++;
+		switch(*format){
+		case 'T': // temperatures in Celsius
+			snprintf(buffer, sizeof(buffer), "%.1f", value / 512.0);
+			break;
+		case 'F':
+			snprintf(buffer, sizeof(buffer), "%.3f", value / 512.0);
+			break;
+		case 'c':
+			snprintf(buffer, sizeof(buffer), "%c", (char) value);
+			break;
+		default:
+			snprintf(buffer, sizeof(buffer), "%d", value);
+		}
+		text += buffer;
+	}
+	return text;
+}
@@ -0,0 +1,194 @@
+/*
+ * Copyright 2012 BrewPi/Elco Jacobs.
+ *
+ * This file is part of BrewPi.
+ *
+ * BrewPi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BrewPi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BrewPi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PILINKCLIENT_H_
+#define PILINKCLIENT_H_
+
+/* Host side client for the PiLink serial protocol of the BrewPi AVR firmware (Linux).
+ Requests are single characters, every reply is a frame: a type character, a colon and a JSON object or text.
+ Bulk frames are one line, unless chunks are enabled with enableChunks(). Then they arrive in chunks
+ ("C+..." lines followed by the last "C:..." line) and are reassembled here. Temperatures can arrive between the chunks.
+ The replies are parsed into the structs below. Temperatures that the firmware sends as null are NaN.
+ Debug messages (D:) can arrive at any time, they are queued while waiting for a reply.
+ Settings transactions (j with an "id") are answered with A: when the update was complete and N: when it was cut off.
+ A batch of requests (b) is answered with one B: frame that holds the object of every request.
+ Events are sent as numeric codes (G:), eventText() renders them as text. Keep it in sync with EventLog.h.
+
+ The field lists are X-macros, so the structs and the parsers cannot get out of sync.
+ Keep them in sync with jsonKeys.h and PiLink.cpp of the firmware.
+*/
+
+#include <string>
+#include <vector>
+#include <map>
+#include <inttypes.h>
+
+#define PILINK_TEMPERATURES_FIELDS(FIELD) \
+	FIELD(double, time) FIELD(double, BeerTemp) FIELD(double, BeerSet) FIELD(double, FridgeTemp) FIELD(double, FridgeSet)
+
+#define PILINK_SETTINGS_FIELDS(FIELD) \
+	FIELD(char, mode) FIELD(double, beerSetting) FIELD(double, fridgeSetting) \
+	FIELD(double, heatEstimator) FIELD(double, coolEstimator) FIELD(double, heatLag) FIELD(double, coolLag)
+
+#define PILINK_CONSTANTS_FIELDS(FIELD) \
+	FIELD(char, tempFormat) FIELD(double, tempSettingMin) FIELD(double, tempSettingMax) \
+	FIELD(double, KpHeat) FIELD(double, KpCool) FIELD(double, Ki) FIELD(double, KdCool) FIELD(double, KdHeat) \
+	FIELD(double, iMaxError) FIELD(double, iMaxSlope) FIELD(double, iMinSlope) \
+	FIELD(double, idleRangeHigh) FIELD(double, idleRangeLow) \
+	FIELD(double, heatingTargetUpper) FIELD(double, heatingTargetLower) \
+	FIELD(double, coolingTargetUpper) FIELD(double, coolingTargetLower) \
+	FIELD(uint32_t, maxHeatTimeForEstimate) FIELD(uint32_t, maxCoolTimeForEstimate) \
+	FIELD(uint32_t, fridgeFastFilter) FIELD(uint32_t, fridgeSlowFilter) FIELD(uint32_t, fridgeSlopeFilter) \
+	FIELD(uint32_t, beerFastFilter) FIELD(uint32_t, beerSlowFilter) FIELD(uint32_t, beerSlopeFilter) \
+	FIELD(double, pwmGain) FIELD(uint32_t, heatPwmWindow) FIELD(uint32_t, heatMinOn) FIELD(uint32_t, heatMinOff) \
+	FIELD(uint32_t, coolPwmWindow) FIELD(uint32_t, coolMinOn) FIELD(uint32_t, coolMinOff) \
+	FIELD(uint32_t, heatPower) FIELD(uint32_t, coolPower) \
+	FIELD(double, spikeMinDeviation) FIELD(uint32_t, spikeMadFactor)
+
+#define PILINK_VARIABLES_FIELDS(FIELD) \
+	FIELD(double, beerDiff) FIELD(double, diffIntegral) FIELD(double, beerSlope) \
+	FIELD(double, p) FIELD(double, i) FIELD(double, d) FIELD(double, Kp) FIELD(double, Kd) \
+	FIELD(double, estimatedPeak) FIELD(double, negPeakSetting) FIELD(double, posPeakSetting) \
+	FIELD(double, negPeak) FIELD(double, posPeak) FIELD(double, duty)
+
+#define PILINK_RUNTIME_STATISTICS_FIELDS(FIELD) \
+	FIELD(uint32_t, timeCooling) FIELD(uint32_t, timeHeating) FIELD(uint32_t, timeIdle) \
+	FIELD(uint32_t, timeDoorOpen) FIELD(uint32_t, timeOff) \
+	FIELD(uint32_t, countCooling) FIELD(uint32_t, countHeating) FIELD(uint32_t, countIdle) \
+	FIELD(uint32_t, countDoorOpen) FIELD(uint32_t, countOff) \
+	FIELD(uint32_t, heatStarts) FIELD(uint32_t, coolStarts) FIELD(uint32_t, heatOnTime) FIELD(uint32_t, coolOnTime) \
+	FIELD(uint32_t, heatEnergy) FIELD(uint32_t, coolEnergy)
+
+#define PILINK_SENSOR_ERRORS_FIELDS(FIELD) \
+	FIELD(uint32_t, beerNoPresence) FIELD(uint32_t, beerCrcErrors) FIELD(uint32_t, beerPowerOn) \
+	FIELD(uint32_t, beerDropped) FIELD(uint32_t, beerSpikes) \
+	FIELD(uint32_t, fridgeNoPresence) FIELD(uint32_t, fridgeCrcErrors) FIELD(uint32_t, fridgePowerOn) \
+	FIELD(uint32_t, fridgeDropped) FIELD(uint32_t, fridgeSpikes)
+
+#define PILINK_DECLARE_FIELD(type, name) type name;
+
+struct PiLinkTemperatures{ PILINK_TEMPERATURES_FIELDS(PILINK_DECLARE_FIELD) };
+struct PiLinkSettings{ PILINK_SETTINGS_FIELDS(PILINK_DECLARE_FIELD) };
+struct PiLinkConstants{ PILINK_CONSTANTS_FIELDS(PILINK_DECLARE_FIELD) };
+struct PiLinkVariables{ PILINK_VARIABLES_FIELDS(PILINK_DECLARE_FIELD) };
+struct PiLinkRuntimeStatistics{ PILINK_RUNTIME_STATISTICS_FIELDS(PILINK_DECLARE_FIELD) };
+struct PiLinkSensorErrors{ PILINK_SENSOR_ERRORS_FIELDS(PILINK_DECLARE_FIELD) };
+struct PiLinkDisplay{ std::string lines[4]; };
+
+struct PiLinkEvent{
+	uint16_t sequence;
+	double time; // Unix time, or seconds since startup when the firmware clock was not synchronized
+	uint8_t code; // EVENT_ code of EventLog.h
+	std::vector<int16_t> args; // fixed7_9: divide by 512
+};
+struct PiLinkEvents{
+	uint16_t lost; // events dropped by the firmware because its buffer was full
+	std::vector<PiLinkEvent> events;
+};
+
+// answer to a settings transaction: A:{"id":12,"applied":["beerSetting"],"rejected":0}, or N:{...} when it was cut off
+struct PiLinkTransaction{
+	uint16_t id;
+	bool complete; // A:, false for N:. The pairs in applied were applied in both cases
+	std::vector<std::string> applied; // keys of the pairs that were applied
+	uint32_t rejected; // pairs with an unknown key
+};
+
+// answer to a batch of requests: B:{"T":{...},"S":{...},"L":"..."}
+// Per reply type the payload of the normal reply, parse it with the parse() for that type.
+typedef std::map<char, std::string> PiLinkBatch;
+
+// one line received from the firmware
+struct PiLinkReply{
+	char type; // 'T', 'S', 'C', 'V', 'R', 'E', 'G', 'L', 'M', 'P', 'W', 'Y', 'A', 'N', 'B', 'D'
+	std::string payload; // everything after "X:"
+};
+
+typedef std::map<std::string, std::string> PiLinkJson; // flat JSON object, values without quotes
+
+class PiLinkClient{
+	public:
+	PiLinkClient();
+	~PiLinkClient();
+
+	bool open(const char * device); // serial port or pty, 57600 baud, raw
+	void close(void);
+	int fileDescriptor(void){ return fd; };
+	uint32_t timeout; // milliseconds to wait for a reply
+
+	// requests, return false on a timeout or a reply that could not be parsed
+	bool requestTemperatures(PiLinkTemperatures * result);		// 't'
+	bool requestSettings(PiLinkSettings * result);				// 's'
+	bool requestConstants(PiLinkConstants * result);				// 'c'
+	bool requestVariables(PiLinkVariables * result);				// 'v'
+	bool requestRuntimeStatistics(PiLinkRuntimeStatistics * result);	// 'r'
+	bool requestSensorErrors(PiLinkSensorErrors * result);		// 'e'
+	bool requestDisplay(PiLinkDisplay * result);					// 'l'
+	bool requestDisplayChanges(PiLinkDisplay * display);			// 'm', updates a display received with requestDisplay()
+	bool requestEvents(PiLinkEvents * result);					// 'g', removes the events from the firmware buffer
+	bool sendSettings(const PiLinkJson & settings);				// 'j', the firmware answers with S: and C:
+	bool sendTransaction(uint16_t id, const PiLinkJson & settings, PiLinkTransaction * result); // 'j' with an id, A: or N:
+	bool requestBatch(const std::string & requests, PiLinkBatch * result); // 'b', requests like "tscv", see PiLink.cpp
+	bool enableChunks(bool enable); // j{"chunkFrames":1}, lets temperatures through during bulk frames. Off after a restart.
+	// 'y', sets the firmware clock to the clock of the host.
+	// roundTrip is the time until the answer, offset the firmware time minus the host time at the middle of the round trip.
+	bool synchronizeTime(double * roundTrip, double * offset);
+	// 'p' and 'w': backup and restore of settings and constants as one hexadecimal snapshot.
+	// result is one of the SNAPSHOT_ results of TempControl.h, 0 is success.
+	bool requestSnapshot(std::string * snapshot);
+	bool restoreSnapshot(const std::string & snapshot, int * result);
+
+	bool sendCommand(char command);
+	bool sendText(const std::string & text); // command with arguments, for example a JSON update
+	bool waitForReply(char type, PiLinkReply * reply); // other replies are queued
+	bool waitForReply(const char * types, PiLinkReply * reply); // first reply of one of the types
+	bool readReply(PiLinkReply * reply); // next reply, from the queue first
+
+	// bytes sent and received since open(), for throughput measurements
+	uint64_t bytesSent;
+	uint64_t bytesReceived;
+	uint64_t chunksReceived; // "X+" lines, stays 0 unless chunks are enabled
+
+	// parsers, usable without a connection
+	static bool parseJson(const std::string & text, PiLinkJson * result);
+	static bool parse(const std::string & payload, PiLinkTemperatures * result);
+	static bool parse(const std::string & payload, PiLinkSettings * result);
+	static bool parse(const std::string & payload, PiLinkConstants * result);
+	static bool parse(const std::string & payload, PiLinkVariables * result);
+	static bool parse(const std::string & payload, PiLinkRuntimeStatistics * result);
+	static bool parse(const std::string & payload, PiLinkSensorErrors * result);
+	static bool parse(const std::string & payload, PiLinkDisplay * result);
+	static bool applyDisplayChanges(const std::string & payload, PiLinkDisplay * display); // [[row,col,"text"],...]
+	static bool parse(const std::string & payload, PiLinkEvents * result);
+	static bool parse(const std::string & payload, PiLinkTransaction * result); // sets complete, correct it for N:
+	static bool parse(const std::string & payload, PiLinkBatch * result);
+	static bool checkSnapshot(const std::string & snapshot); // hexadecimal text and CRC are valid, the version is not checked
+	static std::string eventText(const PiLinkEvent & event); // the message the firmware used to send as annotation or debug message
+
+	private:
+	int fd;
+	std::string rxBuffer; // received bytes that are not a complete line yet
+	std::vector<PiLinkReply> queue;
+	std::map<char, std::string> partialFrames; // chunks of bulk frames received so far, per type
+	bool readLine(std::string * line);
+	bool readFrame(PiLinkReply * reply); // next complete frame from the serial port
+	template<class T> bool request(char command, char type, T * result);
+};
+
+#endif /* PILINKCLIENT_H_ */
@@ -0,0 +1,314 @@
+/*
+ * Copyright 2012 BrewPi/Elco Jacobs.
+ *
+ * This file is part of BrewPi.
+ *
+ * BrewPi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BrewPi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BrewPi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Cycle counts on the AVR of the FixedPoint code against the hand written code it replaced.
+ Every kernel is a function that is not inlined. It is timed with Timer1 running at the CPU clock: TCNT1 is read
+ before and after the call, and the time of an empty kernel is subtracted. The kernels read their inputs from
+ volatile variables and store the result in one, so the compiler cannot fold them. That load and store is part
+ of the count, it is the same for the old and the new code. Every kernel runs for all inputs of its table, the
+ minimum and maximum cycle counts are printed.
+ The old code is copied from the tree before FixedPoint.h was added: TempControl.cpp for the PID terms and the
+ first version of the duty cycle, FixedFilter.cpp for the filter. The new code is copied from TempControl.cpp,
+ the filter is FixedFilter.cpp itself.
+ The last line compares FILTER_BANK_CHANNELS separate FixedFilter objects (old) with FilterBank (new), in cycles
+ per channel per sample. Build it for 2, 8 and 16 channels.
+
+ Build for the ATmega32U4 of the Leonardo, with the options of the firmware build, and run it in simavr.
+ From this directory:
+	for n in 2 8 16; do
+		avr-g++ -Os -funsigned-char -funsigned-bitfields -fpack-struct -fshort-enums -mmcu=atmega32u4 -DF_CPU=16000000UL \
+			-DFILTER_BANK_CHANNELS=$n -I../brewpi_avr -o avrCycleBench.elf avrCycleBench.cpp \
+			../brewpi_avr/FixedFilter.cpp ../brewpi_avr/FilterBank.cpp && simavr -m atmega32u4 -f 16000000 avrCycleBench.elf
+	done
+ The results are written to USART1, which simavr prints. It stops by sleeping with interrupts disabled,
+ which ends simavr. On a Leonardo, read the results at 57600 baud on TX1.
+*/
+
+#include <stdlib.h>
+#include <limits.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include "temperatureFormats.h"
+#include "FixedPoint.h"
+#include "FixedFilter.h"
+#include "FilterBank.h"
+
+#define constrain(amt,low,high) ((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
+#define max(a,b) ((a)>(b)?(a):(b))
+
+#define KERNEL __attribute__((noinline))
+
+static volatile fixed7_9 inA;
+static volatile fixed7_9 inB;
+static volatile fixed23_9 inLong;
+static volatile fixed23_9 outLong;
+static volatile fixed7_9 out;
+
+static FixedFilter filter;
+
+// FixedFilter before FixedPoint.h, the coefficients are the same
+class HandFilter{
+	public:
+	uint8_t a;
+	uint8_t b;
+	fixed7_25 xv[3];
+	fixed7_25 yv[3];
+
+	fixed7_9 add(fixed7_9 val){
+		fixed7_25 returnVal = addDoublePrecision(((fixed7_25) val) << 16);
+		return returnVal>>16;
+	}
+
+	fixed7_25 addDoublePrecision(fixed7_25 val){
+		xv[2] = xv[1];
+		xv[1] = xv[0];
+		xv[0] = val;
+		yv[2] = yv[1];
+		yv[1] = yv[0];
+		yv[0] = ((yv[1] - yv[2]) + yv[1])
+		- (yv[1]>>b) + (yv[2]>>b) +
+		+ (xv[0]>>a) + (xv[1]>>(a-1)) + (xv[2]>>a)
+		- (yv[2]>>(a-2));
+		return yv[0];
+	}
+};
+
+static HandFilter handFilter;
+
+KERNEL static void empty(void){
+}
+
+// P and D: cv.p = Kp * beerDiff, cv.d = Kd * beerSlope
+KERNEL static void productOld(void){
+	outLong = ((fixed23_9) inA * (fixed23_9) inB)>>9;
+}
+
+KERNEL static void productNew(void){
+	outLong = (FixedPoint7_9::fromRaw(inA) * FixedPoint7_9::fromRaw(inB)).convert<23, 9>().raw;
+}
+
+// I: cv.i = Ki * diffIntegral. The old product overflowed for a large integral
+KERNEL static void integralOld(void){
+	outLong = ((fixed23_9) inA * inLong)>>9;
+}
+
+KERNEL static void integralNew(void){
+	fixed7_9 Ki = inA;
+	fixed23_9 diffIntegral = inLong;
+	if(diffIntegral == (fixed7_9) diffIntegral){
+		outLong = (FixedPoint7_9::fromRaw(Ki) * FixedPoint7_9::fromRaw(diffIntegral)).convert<23, 9>().raw;
+	}
+	else{
+		fixed23_9 maxIntegral = 0x7FFFFFFFL / max(labs(Ki), 1L);
+		FixedPoint23_9 integral = FixedPoint23_9::fromRaw(constrain(diffIntegral, -maxIntegral, maxIntegral));
+		outLong = FixedPoint7_9::fromRaw(Ki).multiplyInto<23, 9>(integral).raw;
+	}
+}
+
+// slow change of Kp and Kd to the heat or cool values
+KERNEL static void slewOld(void){
+	out = ((((fixed23_9) inA)<<8) - inA + inB)>>8;
+}
+
+KERNEL static void slewNew(void){
+	typedef FixedPoint<15, 17> Extended;
+	fixed7_9 k = inA;
+	Extended extended = FixedPoint7_9::fromRaw(k).convert<15, 17>() - Extended::fromRaw(k) + Extended::fromRaw(inB);
+	out = extended.convert<7, 9>().raw;
+}
+
+// duty cycle from pwmGain and the fridge error. The old product overflowed for a large gain and error
+KERNEL static void dutyOld(void){
+	fixed23_9 fridgeError = inLong;
+	out = constrain((inA * fridgeError)>>9, 0, 512);
+}
+
+KERNEL static void dutyNew(void){
+	fixed23_9 fridgeError = inLong;
+	fixed23_9 duty = 0;
+	if(fridgeError > 0){
+		FixedPoint7_9 error = FixedPoint23_9::fromRaw(fridgeError).convert<7, 9>();
+		duty = (FixedPoint7_9::fromRaw(inA) * error).convert<23, 9>().raw;
+	}
+	out = constrain(duty, 0, 512);
+}
+
+KERNEL static void filterOld(void){
+	out = handFilter.add(inA);
+}
+
+KERNEL static void filterNew(void){
+	out = filter.add(inA);
+}
+
+static FixedFilter filters[FILTER_BANK_CHANNELS];
+static uint8_t channels[FILTER_BANK_CHANNELS];
+
+KERNEL static void separateFilters(void){
+	fixed7_9 val = inA;
+	for(uint8_t i = 0; i < FILTER_BANK_CHANNELS; i++){
+		filters[i].add(val + i);
+	}
+	out = filters[0].readOutput();
+}
+
+KERNEL static void filterBank(void){
+	fixed7_9 val = inA;
+	for(uint8_t i = 0; i < FILTER_BANK_CHANNELS; i++){
+		FilterBank::setInput(channels[i], val + i);
+	}
+	FilterBank::update();
+	out = FilterBank::readOutput(channels[0]);
+}
+
+static void uartWrite(char c){
+	while(!(UCSR1A & (1<<UDRE1))){
+	}
+	UDR1 = c;
+}
+
+static void print(const char * text){
+	while(*text){
+		uartWrite(*text++);
+	}
+}
+
+static void printNumber(uint16_t value, uint8_t width){
+	char digits[6];
+	uint8_t n = 0;
+	do{
+		digits[n++] = '0' + value % 10;
+		value /= 10;
+	} while(value != 0);
+	while(width-- > n){
+		uartWrite(' ');
+	}
+	while(n != 0){
+		uartWrite(digits[--n]);
+	}
+}
+
+static uint16_t countCycles(void (*kernel)(void)){
+	uint16_t start = TCNT1;
+	kernel();
+	return TCNT1 - start;
+}
+
+static uint16_t overhead;
+
+struct Input{
+	fixed7_9 a;
+	fixed7_9 b;
+	fixed23_9 value;
+};
+
+// Kp, Kd or Ki; beerDiff or beerSlope; diffIntegral or fridge error
+static const Input inputs[] = {
+	{ 5 << 9, 1 << 8, 0 },
+	{ 5 << 9, -(3 << 9), 100 },
+	{ -(3 << 9), 75, -2000 },
+	{ 154, -260, 26 << 9 },
+	{ 512, 32767, 70000L },
+	{ 32767, -32768, -1000000L },
+	{ -32768, 32767, 0x7FFFFFFFL },
+	{ 0, 0, -0x7FFFFFFFL },
+};
+#define NUM_INPUTS (sizeof(inputs) / sizeof(inputs[0]))
+
+// cycles of the kernel for every input, minus the call overhead
+static void measure(void (*kernel)(void), uint16_t * minimum, uint16_t * maximum){
+	*minimum = 0xFFFF;
+	*maximum = 0;
+	for(uint8_t i = 0; i < NUM_INPUTS; i++){
+		inA = inputs[i].a;
+		inB = inputs[i].b;
+		inLong = inputs[i].value;
+		uint16_t cycles = countCycles(kernel) - overhead;
+		if(cycles < *minimum){
+			*minimum = cycles;
+		}
+		if(cycles > *maximum){
+			*maximum = cycles;
+		}
+	}
+}
+
+// prints the cycles of both kernels, divided by the number of channels they filter
+static void compare(const char * name, void (*oldKernel)(void), void (*newKernel)(void), uint8_t channelCount){
+	uint16_t oldMin, oldMax, newMin, newMax;
+	measure(oldKernel, &oldMin, &oldMax);
+	measure(newKernel, &newMin, &newMax);
+	oldMin /= channelCount;
+	oldMax /= channelCount;
+	newMin /= channelCount;
+	newMax /= channelCount;
+	print(name);
+	printNumber(oldMin, 8);
+	printNumber(oldMax, 8);
+	printNumber(newMin, 8);
+	printNumber(newMax, 8);
+	print("\r\n");
+}
+
+int main(void){
+	TCCR1A = 0;
+	TCCR1B = (1<<CS10); // count CPU cycles
+	UCSR1A = (1<<U2X1);
+	UBRR1 = F_CPU / 8 / 57600 - 1;
+	UCSR1B = (1<<TXEN1);
+
+	overhead = 0xFFFF;
+	for(uint8_t i = 0; i < 4; i++){
+		uint16_t cycles = countCycles(empty);
+		if(cycles < overhead){
+			overhead = cycles;
+		}
+	}
+
+	filter.setCoefficients(SETTLING_TIME_50_SAMPLES);
+	handFilter.a = filter.a;
+	handFilter.b = filter.b;
+	filter.init(20 << 9);
+	for(uint8_t i = 0; i < 3; i++){
+		handFilter.xv[i] = (fixed7_25) 20 << 25;
+		handFilter.yv[i] = (fixed7_25) 20 << 25;
+	}
+	for(uint8_t i = 0; i < FILTER_BANK_CHANNELS; i++){
+		channels[i] = FilterBank::addChannel();
+		filters[i].init(20 << 9);
+		FilterBank::init(channels[i], 20 << 9);
+	}
+
+	print("AVR cycles    old min old max new min new max\r\n");
+	compare("P and D      ", productOld, productNew, 1);
+	compare("I            ", integralOld, integralNew, 1);
+	compare("Kp/Kd slew   ", slewOld, slewNew, 1);
+	compare("duty         ", dutyOld, dutyNew, 1);
+	compare("filter add   ", filterOld, filterNew, 1);
+	print("filter bank with ");
+	printNumber(FILTER_BANK_CHANNELS, 2);
+	print(" channels, cycles per channel: separate FixedFilters (old), FilterBank (new)\r\n");
+	compare("filter bank  ", separateFilters, filterBank, FILTER_BANK_CHANNELS);
+
+	cli();
+	sleep_enable();
+	sleep_cpu();
+	return 0;
+}
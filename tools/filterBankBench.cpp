@@ -0,0 +1,127 @@
+/*
+ * Copyright 2012 BrewPi/Elco Jacobs.
+ *
+ * This file is part of BrewPi.
+ *
+ * BrewPi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BrewPi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BrewPi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host check and benchmark of FilterBank against separate FixedFilter objects.
+ Every channel gets the same random temperatures as its FixedFilter, with a different filter setting per channel.
+ Each channel skips about 1 in 8 samples, like a sensor that is busy or returned a bad read:
+ the FixedFilter is then not updated and the bank channel gets no input.
+ Inputs, outputs and peaks must be bit identical after every update.
+ Then both are timed per channel per sample.
+
+ The number of channels is set at compile time. Build and run from this directory for 2, 8 and 16 channels:
+	for n in 2 8 16; do
+		g++ -O2 -DFILTER_BANK_CHANNELS=$n -I../brewpi_avr -o filterBankBench filterBankBench.cpp \
+			../brewpi_avr/FilterBank.cpp ../brewpi_avr/FixedFilter.cpp && ./filterBankBench
+	done
+ It exits with 1 when an output differs. The times are host times; the AVR has no barrel shifter and
+ 8 bit registers, so the ratio on the AVR can be different. avrCycleBench.cpp counts the cycles on the AVR.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "FilterBank.h"
+#include "FixedFilter.h"
+
+static const uint16_t settings[] = {
+	SETTLING_TIME_25_SAMPLES, SETTLING_TIME_50_SAMPLES, SETTLING_TIME_100_SAMPLES,
+	SETTLING_TIME_200_SAMPLES, SETTLING_TIME_400_SAMPLES, SETTLING_TIME_800_SAMPLES
+};
+
+static FixedFilter filters[FILTER_BANK_CHANNELS];
+static uint8_t channels[FILTER_BANK_CHANNELS];
+static fixed7_9 temperature[FILTER_BANK_CHANNELS];
+
+// random walk around 20 degrees with noise, in 7.9
+static fixed7_9 nextTemperature(uint8_t i){
+	temperature[i] += (rand() % 65) - 32;
+	if(temperature[i] < 5 * 512 || temperature[i] > 35 * 512){
+		temperature[i] = 20 * 512;
+	}
+	return temperature[i] + (rand() % 17) - 8;
+}
+
+int main(void){
+	for(uint8_t i = 0; i < FILTER_BANK_CHANNELS; i++){
+		temperature[i] = 20 * 512;
+		channels[i] = FilterBank::addChannel();
+		uint16_t ab = settings[i % (sizeof(settings) / sizeof(settings[0]))];
+		filters[i].setCoefficients(ab);
+		FilterBank::setCoefficients(channels[i], ab);
+		filters[i].init(temperature[i]);
+		FilterBank::init(channels[i], temperature[i]);
+	}
+
+	const long samples = 20000;
+	long mismatches = 0;
+	srand(1);
+	for(long n = 0; n < samples; n++){
+		for(uint8_t i = 0; i < FILTER_BANK_CHANNELS; i++){
+			fixed7_9 val = nextTemperature(i);
+			if(rand() % 8 == 0){
+				continue; // sensor skipped this sample
+			}
+			filters[i].add(val);
+			FilterBank::setInput(channels[i], val);
+		}
+		FilterBank::update();
+		for(uint8_t i = 0; i < FILTER_BANK_CHANNELS; i++){
+			uint8_t c = channels[i];
+			mismatches += FilterBank::readInput(c) != filters[i].readInput();
+			mismatches += FilterBank::readOutputDoublePrecision(c) != filters[i].readOutputDoublePrecision();
+			mismatches += FilterBank::detectPosPeak(c) != filters[i].detectPosPeak();
+			mismatches += FilterBank::detectNegPeak(c) != filters[i].detectNegPeak();
+		}
+	}
+	printf("%s %d channels, %ld samples with skipped samples: %ld mismatch(es)\n",
+		mismatches ? "FAIL" : "PASS", FILTER_BANK_CHANNELS, samples, mismatches);
+
+	// timing without skipped samples, the inputs are prepared so only the filters are timed
+	static fixed7_9 inputs[256][FILTER_BANK_CHANNELS];
+	for(int n = 0; n < 256; n++){
+		for(uint8_t i = 0; i < FILTER_BANK_CHANNELS; i++){
+			inputs[n][i] = nextTemperature(i);
+		}
+	}
+	const long repetitions = 4000000 / FILTER_BANK_CHANNELS;
+	volatile fixed7_25 sink = 0;
+	clock_t start = clock();
+	for(long n = 0; n < repetitions; n++){
+		for(uint8_t i = 0; i < FILTER_BANK_CHANNELS; i++){
+			filters[i].add(inputs[n & 255][i]);
+		}
+		sink = filters[0].readOutputDoublePrecision();
+	}
+	clock_t separate = clock() - start;
+	start = clock();
+	for(long n = 0; n < repetitions; n++){
+		for(uint8_t i = 0; i < FILTER_BANK_CHANNELS; i++){
+			FilterBank::setInput(channels[i], inputs[n & 255][i]);
+		}
+		FilterBank::update();
+		sink = FilterBank::readOutputDoublePrecision(channels[0]);
+	}
+	clock_t bank = clock() - start;
+	(void) sink;
+	double perChannel = 1e9 / CLOCKS_PER_SEC / repetitions / FILTER_BANK_CHANNELS;
+	printf("%d channels, per channel per sample on the host: separate filters %.1f ns, filter bank %.1f ns\n",
+		FILTER_BANK_CHANNELS, separate * perChannel, bank * perChannel);
+
+	return mismatches ? 1 : 0;
+}
@@ -0,0 +1,198 @@
+/*
+ * Copyright 2012 BrewPi/Elco Jacobs.
+ *
+ * This file is part of BrewPi.
+ *
+ * BrewPi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BrewPi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BrewPi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host tool to choose the a and b coefficients of FixedFilter.
+ It runs the firmware's FixedFilter for every (a,b) pair and prints the packed uint16_t code that goes into
+ the filter settings (fridgeFastFilter, beerSlowFilter etc.), with:
+ - settling time: samples until the step response stays within 2% of the step
+ - overshoot of the step response
+ - group delay at DC: the delay of a slow ramp through the filter
+ - noise gain: output standard deviation for white noise on the input with standard deviation 1
+ - quantization error: RMS difference with the same filter in floating point, for a noisy 20 degree input, in 1/512 degree
+
+ Build and run from this directory:
+	g++ -O2 -I../brewpi_avr -o filterDesign filterDesign.cpp ../brewpi_avr/FixedFilter.cpp
+	./filterDesign			lists all pairs with real poles
+	./filterDesign 0 all	lists all pairs, including the ones with complex poles that overshoot
+	./filterDesign 300		recommends a setting with a settling time of 300 samples
+	./filterDesign 300 all	also considers pairs that overshoot
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "FixedFilter.h"
+
+#define MAX_B 10
+#define MAX_A 28
+#define SIMULATION_LENGTH 40000 // samples
+#define SETTLING_BAND 0.02
+
+struct FilterProperties{
+	uint8_t a;
+	uint8_t b;
+	bool realPoles;
+	long settlingTime;
+	double overshoot; // in percent of the step
+	double groupDelay; // in samples
+	double noiseGain;
+	double quantizationError; // RMS, in units of 1/512 degree
+};
+
+// Same difference equation as FixedFilter::addDoublePrecision, in floating point
+class ReferenceFilter{
+	public:
+	ReferenceFilter(uint8_t a, uint8_t b, double val){
+		ka = ldexp(1.0, -a);
+		kb = ldexp(1.0, -b);
+		for(int i = 0; i < 3; i++){
+			xv[i] = val;
+			yv[i] = val;
+		}
+	}
+	double add(double val){
+		xv[2] = xv[1];
+		xv[1] = xv[0];
+		xv[0] = val;
+		yv[2] = yv[1];
+		yv[1] = yv[0];
+		yv[0] = (2.0 - kb) * yv[1] - (1.0 - kb + 4.0 * ka) * yv[2] + ka * (xv[0] + 2.0 * xv[1] + xv[2]);
+		return yv[0];
+	}
+	private:
+	double ka;
+	double kb;
+	double xv[3];
+	double yv[3];
+};
+
+// uniform random numbers with a fixed seed, so results are repeatable
+static double noise(void){
+	return (double) rand() / RAND_MAX - 0.5;
+}
+
+static void analyze(FilterProperties * p){
+	FixedFilter filter;
+	filter.setCoefficients(p->a, p->b);
+
+	// the same shift trick as FixedFilter: 16 extra fraction bits
+	const double step = 10.0 * 512 * 65536; // 10 degrees, in fixed7_25
+	filter.init(0);
+	double previous = 0;
+	double maxOutput = 0;
+	double sumH = 0;
+	double sumNH = 0;
+	double sumH2 = 0;
+	p->settlingTime = -1;
+	for(long n = 0; n < SIMULATION_LENGTH; n++){
+		double out = filter.addDoublePrecision((fixed7_25) step);
+		double h = (out - previous) / step; // impulse response is the derivative of the step response
+		previous = out;
+		sumH += h;
+		sumNH += n * h;
+		sumH2 += h * h;
+		if(out > maxOutput){
+			maxOutput = out;
+		}
+		if(fabs(out - step) > SETTLING_BAND * step){
+			p->settlingTime = -1;
+		}
+		else if(p->settlingTime < 0){
+			p->settlingTime = n;
+		}
+	}
+	p->overshoot = 100.0 * (maxOutput - step) / step;
+	p->groupDelay = sumNH / sumH;
+	p->noiseGain = sqrt(sumH2);
+
+	filter.init(20 * 512);
+	ReferenceFilter reference(p->a, p->b, 20.0 * 512);
+	srand(1);
+	double sumError2 = 0;
+	for(long n = 0; n < SIMULATION_LENGTH; n++){
+		fixed7_9 in = 20 * 512 + (fixed7_9) (noise() * 64); // +-1/16 degree, one DS18B20 step
+		double error = filter.add(in) - reference.add(in);
+		sumError2 += error * error;
+	}
+	p->quantizationError = sqrt(sumError2 / SIMULATION_LENGTH);
+}
+
+static void printHeader(void){
+	printf("  code    a  b  settling  overshoot  delay  noise gain  quant. error\n");
+}
+
+static void printProperties(FilterProperties * p){
+	char settling[21];
+	if(p->settlingTime < 0){
+		strcpy(settling, ">max");
+	}
+	else{
+		sprintf(settling, "%ld", p->settlingTime);
+	}
+	printf("  0x%02X%02X %2d %2d  %8s  %8.2f%%  %5.0f  %10.4f  %12.2f%s\n", p->a, p->b, p->a, p->b, settling,
+		p->overshoot, p->groupDelay, p->noiseGain, p->quantizationError, p->realPoles ? "" : "  complex poles");
+}
+
+int main(int argc, char * argv[]){
+	long target = (argc > 1) ? strtol(argv[1], NULL, 10) : 0;
+	bool all = (argc > 2) && strcmp(argv[2], "all") == 0;
+
+	FilterProperties best;
+	bool found = false;
+	if(target <= 0){
+		printHeader();
+	}
+	for(uint8_t b = 0; b <= MAX_B; b++){
+		// a >= 2 because the filter shifts by a-2. a >= 2b+4 for real poles, a = 2b+4 settles fastest without overshoot
+		for(uint8_t a = 2; a <= MAX_A; a++){
+			FilterProperties p;
+			p.a = a;
+			p.b = b;
+			p.realPoles = (a >= 2 * b + 4);
+			if(!p.realPoles && !all){
+				continue;
+			}
+			analyze(&p);
+			if(p.settlingTime < 0 || p.settlingTime > SIMULATION_LENGTH / 4){
+				continue; // too slow to analyze, or unstable
+			}
+			if(target <= 0){
+				printProperties(&p);
+				continue;
+			}
+			// closest settling time, the lowest noise gain when equally close
+			if(!found || labs(p.settlingTime - target) < labs(best.settlingTime - target)
+				|| (labs(p.settlingTime - target) == labs(best.settlingTime - target) && p.noiseGain < best.noiseGain)){
+				best = p;
+				found = true;
+			}
+		}
+	}
+	if(target > 0){
+		if(!found){
+			printf("No setting found\n");
+			return 1;
+		}
+		printf("Recommended setting for a settling time of %ld samples:\n", target);
+		printHeader();
+		printProperties(&best);
+	}
+	return 0;
+}
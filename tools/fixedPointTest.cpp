@@ -0,0 +1,185 @@
+/*
+ * Copyright 2012 BrewPi/Elco Jacobs.
+ *
+ * This file is part of BrewPi.
+ *
+ * BrewPi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BrewPi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BrewPi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host test of FixedPoint.h and of the PID calculations in TempControl::updatePID() that use it.
+ The calculations are copied from TempControl.cpp and compared with the hand written shifts they replaced:
+ - the slow change of Kp and Kd to the heat or cool values must give exactly the same result,
+ - the P and I products must give the exact product where the old code did and saturate where it overflowed,
+ - convert() is instantiated for formats where the shift is larger than the source type, which must not warn.
+ It also times the I term on the host, the old 64 bit product against the 32 bit product.
+ Host timing only shows the relative cost of the multiply. avrCycleBench.cpp counts the cycles on the AVR.
+
+ Build and run from this directory:
+	g++ -O2 -Wall -Wextra -Werror -I../brewpi_avr -o fixedPointTest fixedPointTest.cpp
+	./fixedPointTest
+ It prints every check and exits with 1 if one of them fails.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "FixedPoint.h"
+
+typedef int16_t fixed7_9;
+typedef int32_t fixed23_9;
+
+#define max(a,b) ((a)>(b)?(a):(b))
+#define constrain(amt,low,high) ((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
+
+static int failures;
+
+static void check(const char * description, long long mismatches){
+	bool ok = (mismatches == 0);
+	printf("%s %-72s %lld mismatch(es)\n", ok ? "PASS" : "FAIL", description, mismatches);
+	if(!ok){
+		failures++;
+	}
+}
+
+// copied from TempControl.cpp
+static fixed7_9 approach(fixed7_9 k, fixed7_9 target){
+	typedef FixedPoint<15, 17> Extended;
+	Extended extended = FixedPoint7_9::fromRaw(k).convert<15, 17>() - Extended::fromRaw(k) + Extended::fromRaw(target);
+	return extended.convert<7, 9>().raw;
+}
+
+// the hand written version it replaced
+static fixed7_9 approachShifted(fixed7_9 k, fixed7_9 target){
+	return ((((fixed23_9) k)<<8) - k + target)>>8;
+}
+
+// copied from TempControl.cpp
+static fixed23_9 integralPart(fixed7_9 Ki, fixed23_9 diffIntegral){
+	if(diffIntegral == (fixed7_9) diffIntegral){
+		return (FixedPoint7_9::fromRaw(Ki) * FixedPoint7_9::fromRaw(diffIntegral)).convert<23, 9>().raw;
+	}
+	else{
+		fixed23_9 maxIntegral = 0x7FFFFFFFL / max(labs(Ki), 1L);
+		FixedPoint23_9 integral = FixedPoint23_9::fromRaw(constrain(diffIntegral, -maxIntegral, maxIntegral));
+		return FixedPoint7_9::fromRaw(Ki).multiplyInto<23, 9>(integral).raw;
+	}
+}
+
+// the hand written limited product it replaced
+static fixed23_9 integralPartShifted(fixed7_9 Ki, fixed23_9 diffIntegral){
+	fixed23_9 maxIntegral = 0x7FFFFFFFL / max(labs(Ki), 1L);
+	return ((fixed23_9) Ki * constrain(diffIntegral, -maxIntegral, maxIntegral))>>9;
+}
+
+// copied from TempControl::updateOutputs()
+static fixed7_9 duty(fixed7_9 pwmGain, fixed23_9 fridgeError){
+	fixed23_9 duty = 0;
+	if(fridgeError > 0){
+		FixedPoint7_9 error = FixedPoint23_9::fromRaw(fridgeError).convert<7, 9>();
+		duty = (FixedPoint7_9::fromRaw(pwmGain) * error).convert<23, 9>().raw;
+	}
+	return constrain(duty, 0, 512);
+}
+
+// the 7.9 x 23.9 product with a 64 bit multiply, the version that pulled in __muldi3
+static fixed23_9 integralPart64(fixed7_9 Ki, fixed23_9 diffIntegral){
+	return (FixedPoint7_9::fromRaw(Ki) * FixedPoint23_9::fromRaw(diffIntegral)).convert<23, 9>().raw;
+}
+
+// 7.9 random value, the generator is seeded so every run checks the same values
+static fixed7_9 random7_9(void){
+	return (fixed7_9) (rand() & 0xFFFF);
+}
+
+int main(void){
+	long long mismatches = 0;
+	for(int32_t k = -32768; k <= 32767; k++){
+		for(int32_t target = -32768; target <= 32767; target += 97){
+			mismatches += approach(k, target) != approachShifted(k, target);
+		}
+	}
+	check("Kp/Kd slew equals the hand written shifts", mismatches);
+
+	mismatches = 0;
+	for(int32_t a = -32768; a <= 32767; a++){
+		for(int32_t b = -32768; b <= 32767; b += 89){
+			fixed23_9 p = (FixedPoint7_9::fromRaw(a) * FixedPoint7_9::fromRaw(b)).convert<23, 9>().raw;
+			mismatches += p != (((fixed23_9) a * b)>>9);
+		}
+	}
+	check("P product equals the 32 bit product", mismatches);
+
+	mismatches = 0;
+	srand(1);
+	for(long n = 0; n < 10000000; n++){
+		fixed7_9 Ki = random7_9();
+		fixed23_9 diffIntegral = (fixed23_9) (((uint32_t) rand() << 16) ^ (uint32_t) rand()) >> (rand() % 24);
+		int64_t exact = ((int64_t) Ki * diffIntegral) >> 9;
+		fixed23_9 i = integralPart(Ki, diffIntegral);
+		if(exact > -(1LL << 22) && exact < (1LL << 22)){
+			mismatches += i != exact; // below 4096 degrees the product is exact
+		}
+		else{
+			// limited: the sign is right and the value is at least 4095 degrees
+			mismatches += (exact < 0) ? (i > -(4095L << 9)) : (i < (4095L << 9));
+		}
+		mismatches += (integralPart64(Ki, diffIntegral) != i) && exact > -(1LL << 22) && exact < (1LL << 22);
+		mismatches += (diffIntegral != (fixed7_9) diffIntegral) && i != integralPartShifted(Ki, diffIntegral);
+	}
+	check("I product is exact up to 4096 degrees and limited above", mismatches);
+
+	// the fridge error is the difference of two 7.9 temperatures, so it has 8 integer bits. Above 64 degrees it is limited.
+	mismatches = 0;
+	for(int32_t gain = -32768; gain <= 32767; gain += 7){
+		for(int32_t error = -65536; error <= 65535; error += 61){
+			int64_t exact = (error > 0) ? ((int64_t) gain * constrain(error, 0, 32767)) >> 9 : 0;
+			mismatches += duty(gain, error) != constrain(exact, 0, 512);
+		}
+	}
+	check("duty cycle is the exact product limited to 0-100%, with the error limited at 64 degrees", mismatches);
+
+	// shifts larger than the source type: these instantiations warned before convert() used FixedPointRescale
+	mismatches = FixedPoint7_9::fromRaw(1).convert<7, 41>().raw != (1LL << 32);
+	mismatches += FixedPoint7_9::fromRaw(-1).convert<7, 25>().raw != -(1L << 16);
+	mismatches += FixedPoint<7, 41>::fromRaw(1LL << 32).convert<7, 9>().raw != 1;
+	mismatches += FixedPoint<23, 9>::fromRaw(0x7FFFFFFF).convert<7, 9>().raw != 0x7FFF;
+	check("convert() across large shifts, compiled without warnings", mismatches);
+
+	// relative speed of the I term on the host
+	const long repetitions = 20000000;
+	volatile fixed23_9 sink = 0;
+	fixed23_9 integrals[256];
+	fixed7_9 gains[256];
+	srand(2);
+	for(int n = 0; n < 256; n++){
+		integrals[n] = random7_9(); // the integral normally fits in 16 bits
+		gains[n] = random7_9();
+	}
+	clock_t start = clock();
+	for(long n = 0; n < repetitions; n++){
+		sink = integralPart64(gains[n & 255], integrals[(n >> 8) & 255]);
+	}
+	clock_t time64 = clock() - start;
+	start = clock();
+	for(long n = 0; n < repetitions; n++){
+		sink = integralPart(gains[n & 255], integrals[(n >> 8) & 255]);
+	}
+	clock_t time32 = clock() - start;
+	(void) sink;
+	printf("I term on the host: 64 bit product %.1f ns, 32 bit product %.1f ns\n",
+		1e9 * time64 / CLOCKS_PER_SEC / repetitions, 1e9 * time32 / CLOCKS_PER_SEC / repetitions);
+
+	printf("%d check(s) failed\n", failures);
+	return failures ? 1 : 0;
+}
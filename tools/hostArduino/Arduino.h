@@ -0,0 +1,89 @@
+/*
+ * Copyright 2012 BrewPi/Elco Jacobs.
+ *
+ * This file is part of BrewPi.
+ *
+ * BrewPi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BrewPi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BrewPi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Minimal Arduino core for building firmware sources on the host, for the test programs in tools/.
+ It only declares what the linked sources use. Each test program defines these functions itself,
+ so it controls what the firmware sees, for example the value of millis() or the bytes Serial receives.
+*/
+
+#ifndef ARDUINO_H_
+#define ARDUINO_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include "Print.h"
+
+typedef uint8_t boolean;
+typedef uint8_t byte;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+
+#define A4 18
+#define A5 19
+#define SS 17
+#define SCK 15
+#define MOSI 16
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+#define bitSet(value, bit) ((value) |= (1UL << (bit)))
+#define bitClear(value, bit) ((value) &= ~(1UL << (bit)))
+#define _BV(bit) (1 << (bit))
+#define interrupts() // the host has no interrupts
+#define noInterrupts()
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+
+// every pin has its own port, the test decides what the port registers are
+#define digitalPinToPort(pin) (pin)
+#define digitalPinToBitMask(pin) ((uint8_t) 1)
+volatile uint8_t * portInputRegister(uint8_t port);
+
+// the USB serial port of the Leonardo
+class HostSerial : public Print{
+	public:
+	void begin(unsigned long baud);
+	int available(void);
+	int peek(void);
+	int read(void);
+	void flush(void);
+	virtual size_t write(uint8_t value);
+	virtual size_t write(const uint8_t * buffer, size_t size);
+	using Print::write;
+};
+extern HostSerial Serial;
+
+#endif /* ARDUINO_H_ */
@@ -0,0 +1,54 @@
+/*
+ * Copyright 2012 BrewPi/Elco Jacobs.
+ *
+ * This file is part of BrewPi.
+ *
+ * BrewPi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BrewPi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BrewPi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The part of the Arduino Print class that the firmware uses, for host builds.
+ A derived class only implements write(uint8_t), like on the Arduino.
+*/
+
+#ifndef PRINT_H_
+#define PRINT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <avr/pgmspace.h> // included through WString.h on the Arduino
+
+class Print{
+	public:
+	virtual ~Print(){};
+	virtual size_t write(uint8_t value) = 0;
+	virtual size_t write(const uint8_t * buffer, size_t size){
+		size_t n = 0;
+		while(size--){
+			n += write(*buffer++);
+		}
+		return n;
+	};
+	size_t write(const char * str){
+		return write((const uint8_t *) str, strlen(str));
+	};
+	size_t print(const char * str){
+		return write(str);
+	};
+	size_t print(char c){
+		return write((uint8_t) c);
+	};
+};
+
+#endif /* PRINT_H_ */
@@ -0,0 +1,35 @@
+/*
+ * Copyright 2012 BrewPi/Elco Jacobs.
+ *
+ * This file is part of BrewPi.
+ *
+ * BrewPi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BrewPi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BrewPi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* EEPROM access for host builds. The test program defines these, for example on an array it can inspect. */
+
+#ifndef AVR_EEPROM_H_
+#define AVR_EEPROM_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+uint8_t eeprom_read_byte(const uint8_t * address);
+void eeprom_write_byte(uint8_t * address, uint8_t value);
+void eeprom_update_byte(uint8_t * address, uint8_t value);
+void eeprom_read_block(void * destination, const void * source, size_t size);
+void eeprom_write_block(const void * source, void * destination, size_t size);
+void eeprom_update_block(const void * source, void * destination, size_t size);
+
+#endif /* AVR_EEPROM_H_ */
@@ -0,0 +1,27 @@
+/*
+ * Copyright 2012 BrewPi/Elco Jacobs.
+ *
+ * This file is part of BrewPi.
+ *
+ * BrewPi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BrewPi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BrewPi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The host has no interrupts: an interrupt vector is a plain function the test program can call. */
+
+#ifndef AVR_INTERRUPT_H_
+#define AVR_INTERRUPT_H_
+
+#define ISR(vector) extern "C" void vector(void); extern "C" void vector(void)
+
+#endif /* AVR_INTERRUPT_H_ */
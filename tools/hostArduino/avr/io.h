@@ -0,0 +1,70 @@
+/*
+ * Copyright 2012 BrewPi/Elco Jacobs.
+ *
+ * This file is part of BrewPi.
+ *
+ * BrewPi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BrewPi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BrewPi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Registers of the ATmega32U4 used by the firmware, for host builds. The test program that links a
+ firmware source using them defines them, so it can see what the firmware writes.
+*/
+
+#ifndef AVR_IO_H_
+#define AVR_IO_H_
+
+#include <stdint.h>
+
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+
+// Timer1
+extern volatile uint8_t TCCR1A, TCCR1B, TIMSK1, TIFR1;
+extern volatile uint16_t OCR1A, TCNT1;
+#define WGM12 3
+#define CS10 0
+#define CS11 1
+#define OCIE1A 1
+#define OCF1A 1
+
+// SPI, for the LCD
+extern volatile uint8_t SPCR, SPSR, SPDR;
+#define SPR0 0
+#define SPR1 1
+#define CPHA 2
+#define CPOL 3
+#define MSTR 4
+#define DORD 5
+#define SPE 6
+#define SPIF 7
+
+// USART1. The test sees every write and read of the data register
+class HostDataRegister{
+	public:
+	void operator=(uint8_t value); // transmit
+	operator uint8_t(); // read the received byte
+};
+extern volatile uint8_t UCSR1A, UCSR1B, UCSR1C;
+extern volatile uint16_t UBRR1;
+extern HostDataRegister UDR1;
+#define U2X1 1
+#define UCSZ10 1
+#define UCSZ11 2
+#define TXEN1 3
+#define RXEN1 4
+#define UDRE1 5
+#define RXCIE1 7
+
+#endif /* AVR_IO_H_ */
@@ -0,0 +1,91 @@
+/*
+ * Copyright 2012 BrewPi/Elco Jacobs.
+ *
+ * This file is part of BrewPi.
+ *
+ * BrewPi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BrewPi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BrewPi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The host has one address space: PROGMEM data is in RAM and the _P functions are the normal ones.
+ The printf functions translate the format of avr-libc: %S is a string in PROGMEM and long is 32 bits, like int on the host.
+*/
+
+#ifndef AVR_PGMSPACE_H_
+#define AVR_PGMSPACE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte(address) (*(const uint8_t *) (address))
+#define pgm_read_word(address) (*(const uint16_t *) (address))
+#define pgm_read_dword(address) (*(const uint32_t *) (address))
+
+#define strchr_P strchr
+#define strcmp_P strcmp
+#define strcpy_P strcpy
+#define strlen_P strlen
+#define memcpy_P memcpy
+
+// copies an avr-libc format: %S becomes %s and the l of %lu, %ld and %lx is removed
+static inline void hostFormat(char * destination, size_t size, const char * format){
+	size_t n = 0;
+	bool conversion = false;
+	for(; *format != 0 && n < size - 1; format++){
+		char c = *format;
+		if(conversion && c == 'l'){
+			continue;
+		}
+		if(conversion && c == 'S'){
+			c = 's';
+		}
+		if(c == '%'){
+			conversion = !conversion;
+		}
+		else if(conversion && strchr("diouxXcsp", c) != NULL){
+			conversion = false;
+		}
+		destination[n++] = c;
+	}
+	destination[n] = 0;
+}
+
+static inline int vsnprintf_P(char * str, size_t size, const char * format, va_list args){
+	char hostFormatString[256];
+	hostFormat(hostFormatString, sizeof(hostFormatString), format);
+	return vsnprintf(str, size, hostFormatString, args);
+}
+
+static inline int snprintf_P(char * str, size_t size, const char * format, ...){
+	va_list args;
+	va_start(args, format);
+	int length = vsnprintf_P(str, size, format, args);
+	va_end(args);
+	return length;
+}
+
+static inline size_t strlcpy_P(char * destination, const char * source, size_t size){
+	size_t length = strlen(source);
+	if(size > 0){
+		size_t n = (length < size) ? length : size - 1;
+		memcpy(destination, source, n);
+		destination[n] = '\0';
+	}
+	return length;
+}
+
+#endif /* AVR_PGMSPACE_H_ */
@@ -0,0 +1,36 @@
+/*
+ * Copyright 2012 BrewPi/Elco Jacobs.
+ *
+ * This file is part of BrewPi.
+ *
+ * BrewPi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BrewPi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BrewPi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* int is 16 bits with avr-gcc. The firmware stores INT_MIN in fixed7_9 variables as "undefined" and limits 16 bit
+ values with INT_MIN and INT_MAX, so on the host they have the values of the AVR. Everything else is from the host.
+*/
+
+#ifndef HOST_LIMITS_H_
+#define HOST_LIMITS_H_
+
+#include_next <limits.h>
+
+#undef INT_MAX
+#undef INT_MIN
+#undef UINT_MAX
+#define INT_MAX 32767
+#define INT_MIN (-INT_MAX - 1)
+#define UINT_MAX 65535U
+
+#endif /* HOST_LIMITS_H_ */
@@ -0,0 +1,392 @@
+/*
+ * Copyright 2012 BrewPi/Elco Jacobs.
+ *
+ * This file is part of BrewPi.
+ *
+ * BrewPi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BrewPi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BrewPi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host simulation of OneWireAsync with a simulated DS18B20 on the bus.
+ OneWire.h calls the simulation for every access to the pin (ONEWIRE_HOST), delayMicroseconds() advances
+ a simulated clock, and the Timer1 registers written by OneWireAsync decide when the next compare interrupt
+ runs OneWireAsync::timerInterrupt(). An interrupt latency can be added to every interrupt.
+
+ The simulated sensor decodes the slots like a DS18B20 and checks the timing against the datasheet:
+ - reset low time at least 480 us, presence sampled 60-75 us after the reset (all sensors answer then),
+   first time slot at least 480 us after the reset
+ - write 1 low time 1-15 us, write 0 low time 60-120 us, time slots at least 60 us, recovery at least 1 us
+ - read slots sampled within 15 us after the falling edge, with the bus released by the master
+ It answers match ROM (0x55), skip ROM (0xCC) and read scratchpad (0xBE).
+
+ Build and run from this directory:
+	g++ -O2 -DARDUINO=100 -DONEWIRE_HOST -IhostArduino -I../brewpi_avr -o oneWireAsyncSim oneWireAsyncSim.cpp ../brewpi_avr/OneWireAsync.cpp
+	./oneWireAsyncSim
+ For a range of interrupt latencies it prints the timing violations, whether the scratchpad arrived intact,
+ the longest time spent in one interrupt and the duration of the transaction.
+ It exits with 1 if a transaction fails at a latency of up to 10 us.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "OneWireAsync.h"
+
+volatile uint8_t TCCR1A, TCCR1B, TIMSK1, TIFR1;
+volatile uint16_t OCR1A, TCNT1;
+
+static double now; // simulated time in microseconds
+
+static void noteTimer(void);
+
+class SimulatedSensor{
+	public:
+	void init(bool connected, const uint8_t * rom, const uint8_t * scratchpad){
+		present = connected;
+		memcpy(this->rom, rom, 8);
+		memcpy(this->scratchpad, scratchpad, 9);
+		masterLow = false;
+		lowUntil = -1;
+		presenceFrom = -1;
+		lastFall = -1000;
+		lastRise = -1000;
+		state = WAIT_RESET;
+		violations = 0;
+	}
+
+	// the master starts or stops pulling the bus low
+	void masterDrive(bool low){
+		if(low == masterLow){
+			return;
+		}
+		masterLow = low;
+		if(low){
+			fall();
+		}
+		else{
+			rise();
+		}
+	}
+
+	bool busLevel(void){
+		bool slaveLow = present && ((now >= presenceFrom && now < presenceFrom + 120) || now < lowUntil);
+		return !(masterLow || slaveLow);
+	}
+
+	// the master samples the bus
+	bool sample(void){
+		if(masterLow){
+			violation("bus sampled while the master pulls it low");
+		}
+		if(state == PRESENCE){
+			double offset = now - lastRise;
+			if(offset < 60 || offset > 75){
+				violation("presence sampled %.1f us after the reset, should be 60-75 us", offset);
+			}
+		}
+		else if(state == TRANSMIT){
+			double offset = now - lastFall;
+			if(offset > 15){
+				violation("read slot sampled %.1f us after the falling edge, should be within 15 us", offset);
+			}
+		}
+		return busLevel();
+	}
+
+	int violations;
+
+	private:
+	enum { WAIT_RESET, PRESENCE, ROM_COMMAND, MATCH_ROM, FUNCTION_COMMAND, TRANSMIT, SILENT };
+
+	// print the first few violations of a transaction
+	void violation(const char * format, double value = 0){
+		if(violations++ < 3){
+			printf("    ");
+			printf(format, value);
+			printf("\n");
+		}
+	}
+
+	void fall(void){
+		double recovery = now - lastRise;
+		double slot = now - lastFall;
+		if(state == PRESENCE && recovery < 480){
+			violation("first time slot %.1f us after the reset, should be at least 480 us", recovery);
+		}
+		if(state != WAIT_RESET && state != PRESENCE){
+			if(recovery < 1){
+				violation("recovery time %.1f us, should be at least 1 us", recovery);
+			}
+			if(slot < 60){
+				violation("time slot of %.1f us, should be at least 60 us", slot);
+			}
+		}
+		lastFall = now;
+		if(state == TRANSMIT){
+			// the sensor holds the bus low for a 0 bit. 15 us is the shortest time the data is valid
+			if(!nextBit()){
+				lowUntil = now + 15;
+			}
+		}
+	}
+
+	void rise(void){
+		double low = now - lastFall;
+		lastRise = now;
+		if(low >= 480){
+			state = PRESENCE;
+			presenceFrom = now + 30; // typical DS18B20: 15-60 us wait, 60-240 us presence pulse
+			bitCount = 0;
+			received = 0;
+			return;
+		}
+		if(state == WAIT_RESET || state == SILENT){
+			return; // the sensor ignores the bus until the next reset
+		}
+		if(state == PRESENCE){
+			state = ROM_COMMAND;
+		}
+		if(state == TRANSMIT){
+			if(low > 15){
+				violation("read slot low time %.1f us, should be 1-15 us", low);
+			}
+			return;
+		}
+		bool bit;
+		if(low >= 1 && low <= 15){
+			bit = true;
+		}
+		else if(low >= 60 && low <= 120){
+			bit = false;
+		}
+		else{
+			violation("write slot low time %.1f us, should be 1-15 us or 60-120 us", low);
+			bit = (low < 37); // what a DS18B20 sampling at 37 us would see
+		}
+		receiveBit(bit);
+	}
+
+	void receiveBit(bool bit){
+		received |= (bit ? 1 : 0) << bitCount;
+		if(++bitCount < 8){
+			return;
+		}
+		uint8_t value = received;
+		bitCount = 0;
+		received = 0;
+		switch(state){
+			case ROM_COMMAND:
+				if(value == 0x55){
+					state = MATCH_ROM;
+					romIndex = 0;
+				}
+				else{
+					state = (value == 0xCC) ? FUNCTION_COMMAND : SILENT;
+				}
+				break;
+			case MATCH_ROM:
+				if(value != rom[romIndex]){
+					state = SILENT; // another sensor is addressed
+				}
+				else if(++romIndex == 8){
+					state = FUNCTION_COMMAND;
+				}
+				break;
+			case FUNCTION_COMMAND:
+				if(value == 0xBE){
+					state = TRANSMIT;
+					transmitIndex = 0;
+				}
+				else{
+					state = SILENT;
+				}
+				break;
+		}
+	}
+
+	bool nextBit(void){
+		if(transmitIndex >= 72){
+			return true; // bus pulled up after the scratchpad
+		}
+		bool bit = (scratchpad[transmitIndex >> 3] >> (transmitIndex & 7)) & 1;
+		transmitIndex++;
+		return bit;
+	}
+
+	bool present;
+	uint8_t rom[8];
+	uint8_t scratchpad[9];
+	bool masterLow;
+	double lowUntil;
+	double presenceFrom;
+	double lastFall;
+	double lastRise;
+	uint8_t state;
+	uint8_t bitCount;
+	uint8_t received;
+	uint8_t romIndex;
+	uint8_t transmitIndex;
+};
+
+static SimulatedSensor sensor;
+static bool pinOutput;
+static bool pinHigh;
+static volatile uint8_t pinRegister;
+
+static void updateBus(void){
+	sensor.masterDrive(pinOutput && !pinHigh);
+}
+
+uint8_t oneWireHostRead(volatile uint8_t * base, uint8_t mask){
+	noteTimer();
+	return sensor.sample() ? 1 : 0;
+}
+
+void oneWireHostMode(volatile uint8_t * base, uint8_t mask, bool output){
+	noteTimer();
+	pinOutput = output;
+	updateBus();
+}
+
+void oneWireHostWrite(volatile uint8_t * base, uint8_t mask, bool high){
+	noteTimer();
+	pinHigh = high;
+	updateBus();
+}
+
+volatile uint8_t * portInputRegister(uint8_t port){
+	return &pinRegister;
+}
+
+void pinMode(uint8_t pin, uint8_t mode){
+	pinOutput = (mode == OUTPUT);
+	pinHigh = (mode == INPUT_PULLUP);
+	updateBus();
+}
+
+void delayMicroseconds(unsigned int us){
+	noteTimer();
+	now += us;
+}
+
+// Timer1 in CTC mode with prescaler 8: the compare interrupt runs (OCR1A + 1) / 2 us after TCNT1 was cleared
+static double timerStart;
+
+static void noteTimer(void){
+	if(TCNT1 == 0){
+		timerStart = now;
+		TCNT1 = 1; // mark that this start of the timer has been seen
+	}
+}
+
+static double nextInterrupt(void){
+	return timerStart + (OCR1A + 1) / (F_CPU / 1000000.0 / 8);
+}
+
+static bool complete;
+
+static void transactionComplete(void * context){
+	complete = true;
+}
+
+struct Result{
+	uint8_t status;
+	bool dataOk;
+	bool rxPulledUp; // all received bits are 1, nobody answered
+	double maxInterruptTime;
+	double duration;
+};
+
+// Run one transaction: match ROM, read scratchpad, 9 bytes received
+static Result run(bool connected, const uint8_t * busRom, const uint8_t * addressedRom, double latency){
+	static const uint8_t scratchpad[9] = { 0x50, 0x05, 0x4B, 0x46, 0x7F, 0xFF, 0x0C, 0x10, 0x1C };
+	Result result;
+	OneWireTransaction t;
+	sensor.init(connected, busRom, scratchpad);
+	now = 0;
+	complete = false;
+	OneWireAsync::initTransaction(&t, A5, transactionComplete, 0);
+	t.buffer[0] = 0x55;
+	memcpy(t.buffer + 1, addressedRom, 8);
+	t.buffer[9] = 0xBE;
+	t.txCount = 10;
+	t.rxCount = 9;
+	OneWireAsync::start(&t);
+	noteTimer();
+	result.maxInterruptTime = 0;
+	while(!complete && now < 100000){
+		if(!(TIMSK1 & (1<<OCIE1A))){
+			printf("    timer interrupt disabled while the transaction is busy\n");
+			break;
+		}
+		now = nextInterrupt() + latency;
+		double interruptStart = now;
+		OneWireAsync::timerInterrupt();
+		noteTimer();
+		if(now - interruptStart > result.maxInterruptTime){
+			result.maxInterruptTime = now - interruptStart;
+		}
+	}
+	result.status = t.status;
+	result.dataOk = (t.status == ONEWIRE_ASYNC_DONE) && memcmp(t.buffer + 10, scratchpad, 9) == 0;
+	result.rxPulledUp = (t.status == ONEWIRE_ASYNC_DONE);
+	for(uint8_t i = 0; i < 9; i++){
+		if(t.buffer[10 + i] != 0xFF){
+			result.rxPulledUp = false;
+		}
+	}
+	result.duration = now;
+	return result;
+}
+
+static const char * statusText(uint8_t status){
+	switch(status){
+		case ONEWIRE_ASYNC_IDLE: return "idle";
+		case ONEWIRE_ASYNC_BUSY: return "busy";
+		case ONEWIRE_ASYNC_DONE: return "done";
+		case ONEWIRE_ASYNC_NO_PRESENCE: return "no presence";
+	}
+	return "?";
+}
+
+int main(void){
+	static const uint8_t rom[8] = { 0x28, 0x1F, 0x73, 0x5B, 0x04, 0x00, 0x00, 0x2E };
+	static const uint8_t otherRom[8] = { 0x28, 0x99, 0x73, 0x5B, 0x04, 0x00, 0x00, 0x10 };
+	static const double latencies[] = { 0, 2, 5, 10, 20, 40, 60 };
+	int failures = 0;
+
+	printf("latency  violations  status       data  max. in interrupt  duration\n");
+	for(unsigned i = 0; i < sizeof(latencies) / sizeof(latencies[0]); i++){
+		Result r = run(true, rom, rom, latencies[i]);
+		printf("%5.0f us  %10d  %-11s  %-4s  %14.0f us  %6.0f us\n", latencies[i], sensor.violations,
+			statusText(r.status), r.dataOk ? "ok" : "bad", r.maxInterruptTime, r.duration);
+		if(latencies[i] <= 10 && (!r.dataOk || sensor.violations)){
+			failures++;
+		}
+	}
+
+	Result r = run(false, rom, rom, 0);
+	printf("no sensor on the bus: %s\n", statusText(r.status));
+	if(r.status != ONEWIRE_ASYNC_NO_PRESENCE){
+		failures++;
+	}
+
+	// the sensor on the bus is not addressed, so it stays silent and the bus reads as pulled up
+	r = run(true, rom, otherRom, 0);
+	printf("other sensor addressed: %s, %s\n", statusText(r.status), r.rxPulledUp ? "no answer" : "answered (wrong)");
+	if(!r.rxPulledUp || sensor.violations){
+		failures++;
+	}
+
+	printf("%d failure(s)\n", failures);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,271 @@
+/*
+ * Copyright 2012 BrewPi/Elco Jacobs.
+ *
+ * This file is part of BrewPi.
+ *
+ * BrewPi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BrewPi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BrewPi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host test of OneWireUart against a mock USART1 with a simulated DS18B20 on the bus.
+ Writing UDR1 starts a byte. micros() advances a simulated clock by 1 us per call, and when the byte has been
+ on the bus for 10 bit times at the baud rate in UBRR1, the mock calls the receive interrupt with the echo.
+ The simulated sensor answers a 9600 baud 0xF0 reset with a presence pulse and decodes 115200 baud time slots:
+ 0xFF writes a 1 or reads a bit, 0x00 writes a 0. It answers match ROM (0x55), skip ROM (0xCC) and
+ read scratchpad (0xBE). The echo can be disconnected, like a bus with TX not connected to RX.
+
+ Build and run from this directory:
+	g++ -O2 -DARDUINO=100 -DUSBCON -DONEWIRE_UART=1 -DONEWIRE_HOST -IhostArduino -I../brewpi_avr -o oneWireUartTest oneWireUartTest.cpp ../brewpi_avr/OneWireUart.cpp
+	./oneWireUartTest
+ It prints every check and exits with 1 if one of them fails. A wait that does not end within one second of
+ simulated time is reported as a hang.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <Arduino.h>
+#include "OneWireUart.h"
+
+#define UBRR_RESET (F_CPU / 8 / 9600 - 1)
+#define UBRR_SLOT (F_CPU / 8 / 115200 - 1)
+#define HANG_TIME 1000000UL // us
+
+extern "C" void USART1_RX_vect(void);
+
+volatile uint8_t UCSR1A, UCSR1B, UCSR1C;
+volatile uint16_t UBRR1;
+HostDataRegister UDR1;
+
+static const uint8_t rom[8] = { 0x28, 0x1F, 0x73, 0x5B, 0x04, 0x00, 0x00, 0x2E };
+static const uint8_t scratchpad[9] = { 0x50, 0x05, 0x4B, 0x46, 0x7F, 0xFF, 0x0C, 0x10, 0x1C };
+
+static int failures;
+
+static void check(const char * description, bool ok){
+	printf("%s %s\n", ok ? "PASS" : "FAIL", description);
+	if(!ok){
+		failures++;
+	}
+}
+
+class SimulatedSensor{
+	public:
+	bool present;
+	int errors; // bytes sent at the wrong baud rate or with a value that is not a time slot
+
+	// the echo of one UART byte on the bus
+	uint8_t transfer(uint8_t value, uint16_t ubrr){
+		if(ubrr == UBRR_RESET){
+			if(value != 0xF0){
+				errors++;
+			}
+			state = ROM_COMMAND;
+			bitCount = 0;
+			received = 0;
+			return present ? 0xE0 : 0xF0; // the presence pulse pulls the upper bits low
+		}
+		if(ubrr != UBRR_SLOT || (value != 0xFF && value != 0x00)){
+			errors++;
+			return value;
+		}
+		if(!present){
+			return value;
+		}
+		if(state == TRANSMIT){
+			if(value == 0xFF && !nextBit()){
+				return 0xE0; // the sensor holds the bus low for a 0
+			}
+			return value;
+		}
+		receiveBit(value == 0xFF);
+		return value;
+	}
+
+	private:
+	enum { ROM_COMMAND, MATCH_ROM, FUNCTION_COMMAND, TRANSMIT, SILENT };
+
+	void receiveBit(bool bit){
+		if(state == SILENT){
+			return;
+		}
+		received |= (bit ? 1 : 0) << bitCount;
+		if(++bitCount < 8){
+			return;
+		}
+		uint8_t value = received;
+		bitCount = 0;
+		received = 0;
+		switch(state){
+			case ROM_COMMAND:
+				if(value == 0x55){
+					state = MATCH_ROM;
+					romIndex = 0;
+				}
+				else{
+					state = (value == 0xCC) ? FUNCTION_COMMAND : SILENT;
+				}
+				break;
+			case MATCH_ROM:
+				if(value != rom[romIndex]){
+					state = SILENT;
+				}
+				else if(++romIndex == 8){
+					state = FUNCTION_COMMAND;
+				}
+				break;
+			case FUNCTION_COMMAND:
+				state = (value == 0xBE) ? TRANSMIT : SILENT;
+				transmitIndex = 0;
+				break;
+		}
+	}
+
+	bool nextBit(void){
+		if(transmitIndex >= 72){
+			return true;
+		}
+		bool bit = (scratchpad[transmitIndex >> 3] >> (transmitIndex & 7)) & 1;
+		transmitIndex++;
+		return bit;
+	}
+
+	uint8_t state;
+	uint8_t bitCount;
+	uint8_t received;
+	uint8_t romIndex;
+	uint8_t transmitIndex;
+};
+
+static SimulatedSensor sensor;
+static bool echoConnected;
+static unsigned long simMicros;
+static int overruns; // UDR1 written while the previous byte was still on the bus
+
+static struct{
+	bool busy;
+	uint8_t value;
+	uint16_t ubrr;
+	unsigned long done;
+} tx;
+static uint8_t rxData;
+
+void HostDataRegister::operator=(uint8_t value){
+	if(tx.busy){
+		overruns++;
+	}
+	tx.busy = true;
+	tx.value = value;
+	tx.ubrr = UBRR1;
+	tx.done = simMicros + 10UL * 8 * (UBRR1 + 1) / (F_CPU / 1000000UL); // start bit, 8 data bits, stop bit
+}
+
+HostDataRegister::operator uint8_t(){
+	return rxData;
+}
+
+// every call takes 1 us. Finished bytes are echoed through the receive interrupt
+unsigned long micros(void){
+	simMicros++;
+	if(simMicros > HANG_TIME){
+		printf("FAIL hang: still waiting after %lu us\n", simMicros);
+		exit(1);
+	}
+	if(tx.busy && simMicros >= tx.done){
+		tx.busy = false;
+		if(echoConnected){
+			rxData = sensor.transfer(tx.value, tx.ubrr);
+			if(UCSR1B & (1<<RXCIE1)){
+				USART1_RX_vect();
+			}
+		}
+	}
+	return simMicros;
+}
+
+int main(void){
+	OneWireUart::init();
+	echoConnected = true;
+
+	sensor.present = false;
+	check("reset() without a sensor reports no presence", OneWireUart::reset() == 0);
+	sensor.present = true;
+	check("reset() with a sensor reports presence", OneWireUart::reset() == 1);
+
+	// match ROM and read scratchpad, like TempSensor does
+	unsigned long start = simMicros;
+	bool written = OneWireUart::write(0x55);
+	for(uint8_t i = 0; i < 8; i++){
+		written = OneWireUart::write(rom[i]) && written;
+	}
+	written = OneWireUart::write(0xBE) && written;
+	check("10 queued writes succeed", written);
+	check("10 queued writes return without waiting for the bus", simMicros - start < 20);
+	uint8_t data[9];
+	for(uint8_t i = 0; i < 9; i++){
+		data[i] = OneWireUart::read();
+	}
+	check("read() returns the scratchpad after match ROM", memcmp(data, scratchpad, 9) == 0);
+	check("a match ROM and scratchpad read takes 152 slots of 85 us", simMicros - start < 152 * 90);
+
+	// skip ROM, read the first byte bit by bit
+	OneWireUart::reset();
+	for(uint8_t bitMask = 1; bitMask; bitMask <<= 1){
+		OneWireUart::write_bit(0xCC & bitMask);
+	}
+	OneWireUart::write(0xBE);
+	uint8_t first = 0;
+	for(uint8_t i = 0; i < 8; i++){
+		first |= OneWireUart::read_bit() << i;
+	}
+	check("write_bit() and read_bit() after skip ROM", first == scratchpad[0]);
+
+	// a full queue and the byte on the bus take 17 bytes of 8 slots, longer than the timeout of 10 ms.
+	// The echoes restart the timeout, so a healthy bus is not given up.
+	OneWireUart::reset();
+	written = OneWireUart::write(0x55);
+	for(uint8_t i = 0; i < 8; i++){
+		written = OneWireUart::write(rom[i]) && written;
+	}
+	written = OneWireUart::write(0xBE) && written;
+	for(uint8_t i = 0; i < 7; i++){
+		written = OneWireUart::write(0xFF) && written; // reads scratchpad byte i, the echo is not used
+	}
+	start = simMicros;
+	check("17 queued writes succeed", written);
+	check("read() after a full queue waits for all slots", OneWireUart::read() == scratchpad[7]);
+	check("waiting for a full queue takes longer than the timeout", simMicros - start > 10000);
+	check("every byte was sent at the right baud rate as a reset or time slot", sensor.errors == 0);
+	check("UDR1 is only written after the echo of the previous byte", overruns == 0);
+
+	// TX not connected to RX: nothing echoes, every wait has to time out
+	echoConnected = false;
+	check("reset() without echo reports no presence", OneWireUart::reset() == 0);
+	start = simMicros;
+	written = true;
+	for(uint8_t i = 0; i < 20; i++){
+		written = OneWireUart::write(0x55) && written;
+	}
+	check("write() without echo returns false when the queue stays full", !written);
+	check("write() without echo gives up within 20 ms", simMicros - start < 20000);
+
+	// after reconnecting, the dropped slots do not disturb the next transaction
+	echoConnected = true;
+	check("reset() after reconnecting reports presence", OneWireUart::reset() == 1);
+	OneWireUart::write(0xCC);
+	OneWireUart::write(0xBE);
+	check("read() after reconnecting returns the scratchpad", OneWireUart::read() == scratchpad[0]);
+
+	printf("%d check(s) failed\n", failures);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,126 @@
+/*
+ * Copyright 2012 BrewPi/Elco Jacobs.
+ *
+ * This file is part of BrewPi.
+ *
+ * BrewPi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BrewPi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BrewPi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Measures latency and throughput of the PiLink protocol with PiLinkClient.
+ 
+ Build and run from this directory:
+	g++ -O2 -o piLinkBench piLinkBench.cpp PiLinkClient.cpp
+	./piLinkBench /dev/ttyACM0 [requests per command]
+ 
+ For every request type it prints the round trip time (min/avg/max) and the number of bytes per second received.
+ It then sends all requests back to back without waiting, to measure the throughput when requests are pipelined.
+ The device can be anything that behaves like the firmware. Without an Arduino, piLinkRig runs the PiLink code
+ of the firmware on the host and starts the benchmark on its pty:
+	./piLinkRig ./piLinkBench 20
+	./piLinkRig -b 57600 ./piLinkBench 20
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include "PiLinkClient.h"
+
+static double seconds(void){
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return now.tv_sec + now.tv_usec * 1e-6;
+}
+
+struct Request{
+	char command;
+	char reply;
+	const char * name;
+};
+
+static const Request requests[] = {
+	{ 't', 'T', "temperatures" },
+	{ 's', 'S', "settings" },
+	{ 'c', 'C', "constants" },
+	{ 'v', 'V', "variables" },
+	{ 'r', 'R', "runtime statistics" },
+	{ 'e', 'E', "sensor errors" },
+	{ 'g', 'G', "events" },
+	{ 'l', 'L', "display" },
+	{ 'm', 'M', "display changes" },
+};
+#define NUM_REQUESTS (sizeof(requests) / sizeof(requests[0]))
+
+int main(int argc, char * argv[]){
+	if(argc < 2){
+		printf("Usage: %s device [requests per command]\n", argv[0]);
+		return 1;
+	}
+	int count = (argc > 2) ? atoi(argv[2]) : 20;
+	PiLinkClient client;
+	if(!client.open(argv[1])){
+		printf("Could not open %s\n", argv[1]);
+		return 1;
+	}
+	
+	double roundTrip, offset;
+	if(client.synchronizeTime(&roundTrip, &offset)){
+		printf("time synchronized, round trip %.1f ms, offset %.1f ms\n", roundTrip * 1000, offset * 1000);
+	}
+	
+	printf("%-20s %8s %8s %8s %10s %6s\n", "request", "min ms", "avg ms", "max ms", "bytes/s", "lost");
+	for(size_t r = 0; r < NUM_REQUESTS; r++){
+		double minTime = 1e9, maxTime = 0, totalTime = 0;
+		uint64_t bytesBefore = client.bytesReceived;
+		int lost = 0;
+		for(int i = 0; i < count; i++){
+			PiLinkReply reply;
+			double start = seconds();
+			if(!client.sendCommand(requests[r].command) || !client.waitForReply(requests[r].reply, &reply)){
+				lost++;
+				continue;
+			}
+			double elapsed = seconds() - start;
+			minTime = (elapsed < minTime) ? elapsed : minTime;
+			maxTime = (elapsed > maxTime) ? elapsed : maxTime;
+			totalTime += elapsed;
+		}
+		int received = count - lost;
+		if(received == 0){
+			printf("%-20s no replies\n", requests[r].name);
+			continue;
+		}
+		printf("%-20s %8.1f %8.1f %8.1f %10.0f %6d\n", requests[r].name, minTime * 1000, totalTime / received * 1000, maxTime * 1000,
+			(client.bytesReceived - bytesBefore) / totalTime, lost);
+	}
+	
+	// pipelined: all requests at once, then collect the replies
+	double start = seconds();
+	uint64_t bytesBefore = client.bytesReceived;
+	for(int i = 0; i < count; i++){
+		for(size_t r = 0; r < NUM_REQUESTS; r++){
+			client.sendCommand(requests[r].command);
+		}
+	}
+	int replies = 0;
+	PiLinkReply reply;
+	while(replies < count * (int) NUM_REQUESTS && client.readReply(&reply)){
+		if(reply.type != 'D'){
+			replies++;
+		}
+	}
+	double elapsed = seconds() - start;
+	printf("pipelined: %d of %d replies in %.2f s, %.1f replies/s, %.0f bytes/s\n", replies, count * (int) NUM_REQUESTS, elapsed,
+		replies / elapsed, (client.bytesReceived - bytesBefore) / elapsed);
+	return 0;
+}
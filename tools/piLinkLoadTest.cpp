@@ -0,0 +1,269 @@
+/*
+ * Copyright 2012 BrewPi/Elco Jacobs.
+ *
+ * This file is part of BrewPi.
+ *
+ * BrewPi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BrewPi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BrewPi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Load test of the PiLink protocol: checks that the controller keeps its control cadence while the host floods the link.
+ 
+ Build and run from this directory:
+	g++ -O2 -o piLinkLoadTest piLinkLoadTest.cpp PiLinkClient.cpp
+	./piLinkLoadTest /dev/ttyACM0 [seconds] [requests in flight] [p99 jitter bound in ms]
+ or without a controller, on the firmware running in piLinkRig (see piLinkRig.cpp), at the baud rate of the serial port:
+	./piLinkRig -b 57600 ./piLinkLoadTest 30
+ 
+ A random mix of requests is sent continuously, with a fixed number of requests waiting for a reply:
+ temperatures ('t'), display dumps ('l' and 'm'), constants ('c'), variables ('v') and JSON uploads.
+ Chunked bulk frames are enabled during the test and disabled again at the end, the default of the firmware.
+ The uploads are 'j' transactions that toggle beerSetting between two values. They are sent at most every
+ UPLOAD_INTERVAL, longer than PILINK_COMMIT_DELAY, so every change is also written to EEPROM during the flood.
+ At the end the last uploaded value is read back and the original beerSetting is restored. The read back needs
+ beer constant mode ('b'), in the other modes the control overwrites beerSetting.
+ For every request type it prints the percentiles of the response latency.
+ 
+ The control cadence is measured with the sample time in the T: frames, after synchronizing the clock of the firmware.
+ Every control update sets a new sample time, so the difference between two sample times is the tick period.
+ Temperatures are requested many times per tick, so every tick is seen. The loop of the firmware updates when more
+ than 1000 ms have passed, so the nominal period is 1001 ms. A period longer than 1.5 times that counts as missed ticks,
+ and the jitter is the deviation of every period from the nominal one, so a loop that is slow on every tick fails too.
+ A tick waits for the bulk frame that is being sent, the constants take about 130 ms at 57600 baud, so the default
+ bound of the p99 jitter is 150 ms. The exit code is 2 when ticks were missed, the p99 jitter exceeds the bound or an
+ upload was not applied, so the test can be used as a regression check after protocol changes.
+ The random sequence is always the same.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <sys/time.h>
+#include <algorithm>
+#include <deque>
+#include <vector>
+#include "PiLinkClient.h"
+
+#define NOMINAL_PERIOD 1.001 // seconds, the loop of brewpi_avr.cpp updates when more than 1000 ms have passed
+#define UPLOAD_INTERVAL 2.0 // seconds between setting uploads, longer than PILINK_COMMIT_DELAY
+static const double beerSettings[2] = { 19.5, 20.5 }; // values the uploads toggle between
+
+static double seconds(void){
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return now.tv_sec + now.tv_usec * 1e-6;
+}
+
+struct Request{
+	char command;
+	char reply;
+	const char * name;
+	int weight; // relative frequency in the mix
+};
+
+static const Request requests[] = {
+	{ 't', 'T', "temperatures", 8 },
+	{ 'l', 'L', "display", 2 },
+	{ 'm', 'M', "display changes", 2 },
+	{ 'c', 'C', "constants", 1 },
+	{ 'v', 'V', "variables", 1 },
+	{ 'j', 'A', "setting upload", 2 }, // a transaction that is cut off is answered with N:
+};
+#define NUM_REQUESTS (sizeof(requests) / sizeof(requests[0]))
+
+static size_t pickRequest(void){
+	int total = 0;
+	for(size_t r = 0; r < NUM_REQUESTS; r++){
+		total += requests[r].weight;
+	}
+	int pick = rand() % total;
+	for(size_t r = 0; r < NUM_REQUESTS; r++){
+		pick -= requests[r].weight;
+		if(pick < 0){
+			return r;
+		}
+	}
+	return 0;
+}
+
+// value below which the fraction of the sorted values lies
+static double percentile(const std::vector<double> & sorted, double fraction){
+	if(sorted.empty()){
+		return NAN;
+	}
+	size_t index = (size_t) (fraction * (sorted.size() - 1) + 0.5);
+	return sorted[index];
+}
+
+int main(int argc, char * argv[]){
+	if(argc < 2){
+		printf("Usage: %s device [seconds] [requests in flight] [p99 jitter bound in ms]\n", argv[0]);
+		return 1;
+	}
+	double duration = (argc > 2) ? atof(argv[2]) : 60;
+	size_t window = (argc > 3) ? atoi(argv[3]) : 4;
+	double jitterBound = ((argc > 4) ? atof(argv[4]) : 150) / 1000;
+	PiLinkClient client;
+	if(!client.open(argv[1])){
+		printf("Could not open %s\n", argv[1]);
+		return 1;
+	}
+	double roundTrip, offset;
+	if(!client.synchronizeTime(&roundTrip, &offset)){
+		printf("No answer to the time synchronization\n");
+		return 1;
+	}
+	PiLinkSettings settings;
+	if(!client.requestSettings(&settings)){
+		printf("No answer to the settings request\n");
+		return 1;
+	}
+	double originalBeerSetting = settings.beerSetting;
+	if(!client.enableChunks(true)){
+		printf("Could not enable chunked bulk frames\n");
+		return 1;
+	}
+	srand(1);
+	
+	std::vector<double> latencies[NUM_REQUESTS];
+	std::deque<double> pending[NUM_REQUESTS]; // send times of the requests waiting for a reply, per type
+	size_t inFlight = 0;
+	int lost = 0;
+	int cutOff = 0;
+	uint32_t transactionId = 0;
+	int uploads = 0;
+	int notApplied = 0;
+	double nextUpload = 0;
+	std::vector<double> periods;
+	double lastSampleTime = 0;
+	
+	double end = seconds() + duration;
+	while(seconds() < end){
+		while(inFlight < window){
+			size_t r;
+			do{
+				r = pickRequest();
+			}while(requests[r].command == 'j' && seconds() < nextUpload);
+			bool sent;
+			if(requests[r].command == 'j'){
+				char message[64];
+				snprintf(message, sizeof(message), "j{\"id\":%u,\"beerSetting\":%.1f}",
+					transactionId++ % 60000, beerSettings[uploads % 2]);
+				sent = client.sendText(message);
+				uploads++;
+				nextUpload = seconds() + UPLOAD_INTERVAL;
+			}
+			else{
+				sent = client.sendCommand(requests[r].command);
+			}
+			if(!sent){
+				printf("Could not write to %s\n", argv[1]);
+				return 1;
+			}
+			pending[r].push_back(seconds());
+			inFlight++;
+		}
+		
+		PiLinkReply reply;
+		if(!client.readReply(&reply)){
+			// no reply within the timeout, the requests in flight are lost
+			lost += inFlight;
+			for(size_t r = 0; r < NUM_REQUESTS; r++){
+				pending[r].clear();
+			}
+			inFlight = 0;
+			continue;
+		}
+		double now = seconds();
+		if(reply.type == 'N'){
+			cutOff++;
+			reply.type = 'A';
+		}
+		if(reply.type == 'A'){
+			PiLinkTransaction transaction;
+			if(!PiLinkClient::parse(reply.payload, &transaction) || transaction.applied.size() != 1
+				|| transaction.applied[0] != "beerSetting"){
+				notApplied++;
+			}
+		}
+		if(reply.type == 'T'){
+			PiLinkTemperatures temperatures;
+			if(PiLinkClient::parse(reply.payload, &temperatures) && temperatures.time > lastSampleTime){
+				if(lastSampleTime > 0){
+					periods.push_back(temperatures.time - lastSampleTime);
+				}
+				lastSampleTime = temperatures.time;
+			}
+		}
+		for(size_t r = 0; r < NUM_REQUESTS; r++){
+			if(requests[r].reply == reply.type && !pending[r].empty()){
+				latencies[r].push_back(now - pending[r].front());
+				pending[r].pop_front();
+				inFlight--;
+				break;
+			}
+		}
+		// other frames (debug messages) are not answers to a request
+	}
+	// the replies that are still in flight are skipped while waiting for the answer
+	if(!client.enableChunks(false)){
+		printf("Could not disable chunked bulk frames\n");
+	}
+	if(uploads > 0 && (!client.requestSettings(&settings) || settings.beerSetting != beerSettings[(uploads - 1) % 2])){
+		printf("Last uploaded beer setting %.1f is not in the settings\n", beerSettings[(uploads - 1) % 2]);
+		notApplied++;
+	}
+	if(!isnan(originalBeerSetting)){
+		PiLinkJson restore;
+		PiLinkTransaction transaction;
+		char value[16];
+		snprintf(value, sizeof(value), "%.2f", originalBeerSetting);
+		restore["beerSetting"] = value;
+		if(!client.sendTransaction(transactionId % 60000, restore, &transaction)){
+			printf("Could not restore the beer setting %s\n", value);
+		}
+	}
+	
+	printf("time synchronized, round trip %.1f ms\n", roundTrip * 1000);
+	printf("%-16s %8s %8s %8s %8s %8s\n", "request", "count", "p50 ms", "p90 ms", "p99 ms", "max ms");
+	for(size_t r = 0; r < NUM_REQUESTS; r++){
+		std::vector<double> & sorted = latencies[r];
+		std::sort(sorted.begin(), sorted.end());
+		printf("%-16s %8u %8.1f %8.1f %8.1f %8.1f\n", requests[r].name, (unsigned) sorted.size(),
+			percentile(sorted, 0.5) * 1000, percentile(sorted, 0.9) * 1000, percentile(sorted, 0.99) * 1000,
+			sorted.empty() ? NAN : sorted.back() * 1000);
+	}
+	printf("lost requests: %d, setting uploads: %d, cut off: %d, not applied: %d\n", lost, uploads, cutOff, notApplied);
+	
+	if(periods.empty()){
+		printf("No control ticks seen\n");
+		return 1;
+	}
+	std::vector<double> sorted = periods;
+	std::sort(sorted.begin(), sorted.end());
+	int missed = 0;
+	std::vector<double> jitter; // deviation of the periods from the nominal period
+	for(size_t i = 0; i < periods.size(); i++){
+		if(periods[i] > 1.5 * NOMINAL_PERIOD){
+			missed += (int) (periods[i] / NOMINAL_PERIOD + 0.5) - 1;
+		}
+		jitter.push_back(fabs(periods[i] - NOMINAL_PERIOD));
+	}
+	std::sort(jitter.begin(), jitter.end());
+	printf("control ticks: %u, period p50 %.1f ms, p99 %.1f ms, max %.1f ms, missed %d\n",
+		(unsigned) periods.size(), percentile(sorted, 0.5) * 1000, percentile(sorted, 0.99) * 1000, sorted.back() * 1000, missed);
+	printf("jitter against %.0f ms: p50 %.1f ms, p99 %.1f ms, max %.1f ms, bound %.0f ms\n", NOMINAL_PERIOD * 1000,
+		percentile(jitter, 0.5) * 1000, percentile(jitter, 0.99) * 1000, jitter.back() * 1000, jitterBound * 1000);
+	bool fail = missed > 0 || percentile(jitter, 0.99) > jitterBound || notApplied > 0;
+	return fail ? 2 : 0;
+}
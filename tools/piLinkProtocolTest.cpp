@@ -0,0 +1,138 @@
+/*
+ * Copyright 2012 BrewPi/Elco Jacobs.
+ *
+ * This file is part of BrewPi.
+ *
+ * BrewPi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BrewPi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BrewPi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Functional test of the PiLink protocol, with PiLinkClient. It needs a device that runs the firmware, usually piLinkRig.
+ 
+ Build and run from this directory (see piLinkRig.cpp for the build of the rig):
+	g++ -O2 -o piLinkProtocolTest piLinkProtocolTest.cpp PiLinkClient.cpp
+	./piLinkRig ./piLinkProtocolTest
+ It prints every check and exits with 1 if one of them fails.
+ The settings of the device are changed, only run it on a rig or on a controller that is not in use.
+*/
+
+#include <stdio.h>
+#include <math.h>
+#include <unistd.h>
+#include "PiLinkClient.h"
+
+static int failures;
+
+static void check(const char * description, bool ok){
+	printf("%s %s\n", ok ? "PASS" : "FAIL", description);
+	if(!ok){
+		failures++;
+	}
+}
+
+// true when the device sent a reply or logged an invalid command since the last call,
+// which means that input was executed as commands. Other log messages are skipped.
+static bool executedCommands(PiLinkClient & client){
+	PiLinkReply reply;
+	client.timeout = 200;
+	bool found = false;
+	while(client.readReply(&reply)){
+		if(reply.type != 'D' || reply.payload.find("Invalid command") != std::string::npos){
+			found = true;
+		}
+	}
+	client.timeout = 2000;
+	return found;
+}
+
+int main(int argc, char * argv[]){
+	if(argc < 2){
+		printf("usage: %s device\n", argv[0]);
+		return 2;
+	}
+	PiLinkClient client;
+	if(!client.open(argv[1])){
+		perror(argv[1]);
+		return 2;
+	}
+	executedCommands(client); // skip the messages of the startup
+
+	PiLinkJson settings;
+	PiLinkTransaction transaction;
+	settings["beerSetting"] = "19.5";
+	settings["noSuchSetting"] = "1";
+	bool ok = client.sendTransaction(7, settings, &transaction);
+	check("transaction is answered with A:", ok && transaction.complete);
+	check("A: lists the applied key and the rejected pair", ok && transaction.id == 7
+		&& transaction.applied.size() == 1 && transaction.applied[0] == "beerSetting" && transaction.rejected == 1);
+	PiLinkSettings controlSettings;
+	check("setting of the transaction is applied", client.requestSettings(&controlSettings) && controlSettings.beerSetting == 19.5);
+
+	// a value that is too long cuts the transaction off, the rest up to the closing brace must be skipped
+	PiLinkReply reply;
+	ok = client.sendText("j{\"id\":8,\"fridgeSetting\":18,\"beerSetting\":\"tscvrelmgtscvrelmgtscvrelmgtscvrelmg\"}")
+		&& client.waitForReply("AN", &reply) && PiLinkClient::parse(reply.payload, &transaction);
+	check("cut off transaction is answered with N:", ok && reply.type == 'N' && transaction.id == 8);
+	check("N: lists the pair received before the error", ok && transaction.applied.size() == 1 && transaction.applied[0] == "fridgeSetting");
+	PiLinkTemperatures temperatures;
+	check("next request after N: is answered", client.requestTemperatures(&temperatures));
+	check("rest of the cut off update is not executed as commands", !executedCommands(client));
+
+	PiLinkBatch batch;
+	PiLinkDisplay display;
+	ok = client.requestBatch("tsl", &batch);
+	check("batch is answered with B: with an object per request", ok && batch.size() == 3 && batch.count('T') && batch.count('S') && batch.count('L'));
+	check("objects of the batch can be parsed", ok && PiLinkClient::parse(batch['T'], &temperatures)
+		&& PiLinkClient::parse(batch['S'], &controlSettings) && PiLinkClient::parse(batch['L'], &display));
+	check("batch has the current settings", ok && controlSettings.beerSetting == 19.5);
+	check("display content of the batch is 4 lines", ok && display.lines[0].find("Mode") == 0);
+	ok = client.sendText("bl\n") && client.waitForReply('B', &reply);
+	bool ascii = true;
+	for(size_t i = 0; i < reply.payload.size(); i++){
+		ascii = ascii && (unsigned char) reply.payload[i] < 0x80;
+	}
+	check("degree sign is escaped in the batch, the frame is ASCII", ok && ascii && reply.payload.find("\\u00b0") != std::string::npos);
+	check("escaped display content is restored", ok && PiLinkClient::parse(reply.payload, &batch)
+		&& PiLinkClient::parse(batch['L'], &display) && display.lines[1].find('\xB0') != std::string::npos);
+
+	// bulk frames are single lines for hosts that do not know chunks
+	PiLinkConstants constants;
+	check("bulk frames are not chunked by default", client.requestConstants(&constants) && client.chunksReceived == 0);
+	check("chunks can be enabled", client.enableChunks(true));
+	check("chunked bulk frames are reassembled", client.requestConstants(&constants) && client.chunksReceived > 0
+		&& constants.tempFormat == 'C');
+	ok = client.sendText("Z") && client.waitForReply('D', &reply);
+	check("log message is one line with its prefix when chunks are enabled", ok
+		&& reply.payload.find("[warning link] Invalid command") == 0);
+	uint64_t chunks = client.chunksReceived;
+	check("chunks can be disabled", client.enableChunks(false) && client.requestConstants(&constants)
+		&& client.chunksReceived == chunks);
+	executedCommands(client);
+
+	// in fridge constant mode the beer setting is undefined (INT_MIN), which is sent as null
+	settings.clear();
+	settings["mode"] = "\"f\"";
+	settings["fridgeSetting"] = "18";
+	ok = client.sendSettings(settings);
+	usleep(1500000); // the beer setting is cleared by the next control update
+	ok = ok && client.requestTemperatures(&temperatures);
+	check("undefined beer setting is reported as null", ok && isnan(temperatures.BeerSet) && temperatures.FridgeSet == 18);
+	settings.clear();
+	settings["mode"] = "\"b\"";
+	settings["beerSetting"] = "19.5";
+	check("beer constant mode can be restored", client.sendSettings(settings) && client.requestSettings(&controlSettings)
+		&& controlSettings.mode == 'b' && controlSettings.beerSetting == 19.5);
+
+	printf("%d check(s) failed\n", failures);
+	return failures ? 1 : 0;
+}
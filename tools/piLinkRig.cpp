@@ -0,0 +1,377 @@
+/*
+ * Copyright 2012 BrewPi/Elco Jacobs.
+ *
+ * This file is part of BrewPi.
+ *
+ * BrewPi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BrewPi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BrewPi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Runs the PiLink code of the firmware on the host, with Serial connected to a pseudo terminal.
+ PiLink.cpp is linked with the control code, the display and the EEPROM layout of the firmware, so every request
+ is answered by the real firmware code. The host tools open the pty instead of /dev/ttyACM0.
+ - millis() is the real time, so the receive time budget and the timeouts of PiLink run like on the Arduino.
+ - The main loop is the loop() of brewpi_avr.cpp: a control update every second, PiLink in between.
+   The rig sleeps until a request arrives or the next update is due, instead of polling.
+ - The 1-Wire bus has no sensors, so the temperatures are null. The LCD writes go to the display buffer only.
+ - The EEPROM starts erased, so the firmware starts with its default settings. It is not stored.
+ - Serial has a receive buffer of 64 bytes like the USB serial port of the Leonardo: the host blocks when the
+   firmware does not read. With -b, sending is limited to that baud rate, 10 bits per byte. Without it, sending is
+   as fast as the pty, like the USB serial port that ignores the baud rate.
+ - int is 32 bits on the host. hostArduino/limits.h gives INT_MIN and INT_MAX the 16 bit values of the AVR,
+   so undefined settings (INT_MIN in a fixed7_9) and the peak detection work like on the Arduino.
+ The firmware code runs much faster here than on the AVR. Latencies measured with the rig include the protocol,
+ the time budget and the chunking of the firmware, but not its CPU time.
+
+ Build from this directory:
+	g++ -O2 -DARDUINO=100 -DONEWIRE_HOST -DREQUIRESNEW=0 -IhostArduino -I../brewpi_avr -o piLinkRig piLinkRig.cpp \
+		../brewpi_avr/PiLink.cpp ../brewpi_avr/TempControl.cpp ../brewpi_avr/TempSensor.cpp \
+		../brewpi_avr/DallasTemperature.cpp ../brewpi_avr/OneWire.cpp \
+		../brewpi_avr/FixedFilter.cpp ../brewpi_avr/SpikeFilter.cpp ../brewpi_avr/SlopeEstimator.cpp \
+		../brewpi_avr/OvershootModel.cpp ../brewpi_avr/BeerEstimator.cpp ../brewpi_avr/TimeProportionalOutput.cpp \
+		../brewpi_avr/EventLog.cpp ../brewpi_avr/RuntimeStats.cpp ../brewpi_avr/Ticks.cpp \
+		../brewpi_avr/temperatureFormats.cpp ../brewpi_avr/Display.cpp ../brewpi_avr/SpiLcd.cpp
+ Run:
+	./piLinkRig [-b baud]
+		prints the pty and runs until it is stopped
+	./piLinkRig [-b baud] program [arguments]
+		runs the program with the pty as its first argument and exits with its exit status, for example:
+		./piLinkRig ./piLinkBench 20
+		./piLinkRig ./piLinkProtocolTest
+		./piLinkRig -b 57600 ./piLinkLoadTest 30
+*/
+
+#define _XOPEN_SOURCE 600
+#include <Arduino.h>
+#include <avr/eeprom.h>
+#include <util/delay.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "Display.h"
+#include "TempControl.h"
+#include "PiLink.h"
+#include "Ticks.h"
+#include "EventLog.h"
+
+// time
+
+static uint64_t startTime;
+
+static uint64_t monotonicMicros(void){
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+unsigned long micros(void){
+	return (unsigned long) (uint32_t) (monotonicMicros() - startTime);
+}
+
+unsigned long millis(void){
+	return (unsigned long) (uint32_t) ((monotonicMicros() - startTime) / 1000);
+}
+
+void delay(unsigned long ms){
+	usleep(ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us){
+	(void) us; // only used for the timing of the 1-Wire bus, which has no devices
+}
+
+void _delay_ms(double ms){
+	(void) ms; // only used by the LCD, which is not connected
+}
+
+void _delay_us(double us){
+	(void) us;
+}
+
+// pins and registers
+
+void pinMode(uint8_t pin, uint8_t mode){
+	(void) pin;
+	(void) mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value){
+	(void) pin;
+	(void) value;
+}
+
+int digitalRead(uint8_t pin){
+	(void) pin;
+	return HIGH;
+}
+
+static volatile uint8_t portInput;
+
+volatile uint8_t * portInputRegister(uint8_t port){
+	(void) port;
+	return &portInput;
+}
+
+// 1-Wire bus without devices: the pull-up keeps it high
+uint8_t oneWireHostRead(volatile uint8_t * base, uint8_t mask){
+	(void) base;
+	(void) mask;
+	return 1;
+}
+
+void oneWireHostMode(volatile uint8_t * base, uint8_t mask, bool output){
+	(void) base;
+	(void) mask;
+	(void) output;
+}
+
+void oneWireHostWrite(volatile uint8_t * base, uint8_t mask, bool high){
+	(void) base;
+	(void) mask;
+	(void) high;
+}
+
+volatile uint8_t SPCR;
+volatile uint8_t SPSR = _BV(SPIF); // a transfer is always complete
+volatile uint8_t SPDR;
+volatile uint8_t TCCR1A, TCCR1B, TIMSK1, TIFR1;
+volatile uint16_t OCR1A, TCNT1;
+
+// EEPROM, the firmware passes addresses as pointers
+
+static uint8_t eeprom[1024];
+
+static uint8_t * eepromCell(const void * address, size_t size){
+	uintptr_t offset = (uintptr_t) address;
+	if(offset + size > sizeof(eeprom)){
+		fprintf(stderr, "EEPROM access at %lu, size %lu is out of range\n", (unsigned long) offset, (unsigned long) size);
+		exit(2);
+	}
+	return eeprom + offset;
+}
+
+uint8_t eeprom_read_byte(const uint8_t * address){
+	return *eepromCell(address, 1);
+}
+
+void eeprom_write_byte(uint8_t * address, uint8_t value){
+	*eepromCell(address, 1) = value;
+}
+
+void eeprom_update_byte(uint8_t * address, uint8_t value){
+	*eepromCell(address, 1) = value;
+}
+
+void eeprom_read_block(void * destination, const void * source, size_t size){
+	memcpy(destination, eepromCell(source, size), size);
+}
+
+void eeprom_write_block(const void * source, void * destination, size_t size){
+	memcpy(eepromCell(destination, size), source, size);
+}
+
+void eeprom_update_block(const void * source, void * destination, size_t size){
+	memcpy(eepromCell(destination, size), source, size);
+}
+
+// Serial on the master side of the pty
+
+HostSerial Serial;
+
+static int serialFd = -1;
+static uint8_t rxBuffer[64];
+static uint8_t rxCount;
+static uint32_t baudRate; // 0: not limited
+static uint64_t txFreeTime; // microseconds at which the bytes sent so far are out at the baud rate
+
+void HostSerial::begin(unsigned long baud){
+	(void) baud;
+}
+
+int HostSerial::available(void){
+	if(rxCount < sizeof(rxBuffer)){
+		ssize_t count = ::read(serialFd, rxBuffer + rxCount, sizeof(rxBuffer) - rxCount);
+		if(count > 0){
+			rxCount += count;
+		}
+	}
+	return rxCount;
+}
+
+int HostSerial::peek(void){
+	return available() ? rxBuffer[0] : -1;
+}
+
+int HostSerial::read(void){
+	if(!available()){
+		return -1;
+	}
+	uint8_t value = rxBuffer[0];
+	rxCount--;
+	memmove(rxBuffer, rxBuffer + 1, rxCount);
+	return value;
+}
+
+void HostSerial::flush(void){
+}
+
+size_t HostSerial::write(uint8_t value){
+	return write(&value, 1);
+}
+
+size_t HostSerial::write(const uint8_t * buffer, size_t size){
+	if(baudRate){
+		// wait until the bytes fit in a transmit buffer of 64 bytes
+		uint64_t now = monotonicMicros();
+		uint64_t byteTime = 10000000 / baudRate;
+		txFreeTime = ((txFreeTime > now) ? txFreeTime : now) + size * byteTime;
+		if(txFreeTime > now + 64 * byteTime){
+			usleep(txFreeTime - now - 64 * byteTime);
+		}
+	}
+	size_t written = 0;
+	while(written < size){
+		ssize_t count = ::write(serialFd, buffer + written, size - written);
+		if(count > 0){
+			written += count;
+		}
+		else if(count < 0 && errno == EAGAIN){
+			struct pollfd pfd = { serialFd, POLLOUT, 0 };
+			poll(&pfd, 1, 100); // the host does not read, block like the USB serial port
+		}
+		else{
+			break;
+		}
+	}
+	return written;
+}
+
+static int openPty(char * name, size_t size){
+	int fd = posix_openpt(O_RDWR | O_NOCTTY);
+	if(fd < 0 || grantpt(fd) != 0 || unlockpt(fd) != 0 || ptsname(fd) == NULL){
+		return -1;
+	}
+	strncpy(name, ptsname(fd), size - 1);
+	name[size - 1] = 0;
+	struct termios tty;
+	tcgetattr(fd, &tty);
+	cfmakeraw(&tty);
+	tcsetattr(fd, TCSANOW, &tty);
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	return fd;
+}
+
+// setup() and loop() of brewpi_avr.cpp, without the hardware that is not on the host
+
+static void setup(void){
+	Serial.begin(57600);
+	tempControl.loadSettingsAndConstants();
+	tempControl.init();
+	tempControl.updatePID();
+	tempControl.updateState();
+	display.init();
+	display.printStationaryText();
+	display.printState();
+	eventLog.add(EVENT_RESTARTED);
+}
+
+// returns the milliseconds until the next control update
+static uint32_t loop(void){
+	static uptime_t lastUpdate;
+	uint32_t timeSinceUpdate = ticks.timeSince(lastUpdate);
+	uint32_t wait = 0;
+	if(timeSinceUpdate > 1000){
+		lastUpdate = ticks.millis64();
+		tempControl.updateTemperatures();
+		tempControl.detectPeaks();
+		tempControl.updatePID();
+		tempControl.updateState();
+		tempControl.updateOutputs();
+		display.printState();
+		display.printAllTemperatures();
+		display.printMode();
+		wait = 1001;
+	}
+	else{
+		tempControl.prepareTemperatures(1000 - timeSinceUpdate);
+		wait = 1001 - timeSinceUpdate;
+	}
+	piLink.receive();
+	return wait;
+}
+
+static volatile sig_atomic_t childExited;
+
+static void onChildExit(int signal){
+	(void) signal;
+	childExited = 1;
+}
+
+int main(int argc, char * argv[]){
+	int arg = 1;
+	if(arg + 1 < argc && strcmp(argv[arg], "-b") == 0){
+		baudRate = strtoul(argv[arg + 1], NULL, 10);
+		arg += 2;
+	}
+	char ptyName[64];
+	serialFd = openPty(ptyName, sizeof(ptyName));
+	if(serialFd < 0){
+		perror("pty");
+		return 2;
+	}
+	startTime = monotonicMicros();
+	memset(eeprom, 0xFF, sizeof(eeprom));
+	setup();
+
+	pid_t child = 0;
+	if(arg < argc){
+		signal(SIGCHLD, onChildExit);
+		child = fork();
+		if(child == 0){
+			// the program, with the pty inserted as its first argument
+			char ** childArgs = new char *[argc - arg + 2];
+			childArgs[0] = argv[arg];
+			childArgs[1] = ptyName;
+			for(int i = arg + 1; i <= argc; i++){
+				childArgs[i - arg + 1] = argv[i];
+			}
+			execvp(argv[arg], childArgs);
+			perror(argv[arg]);
+			_exit(127);
+		}
+	}
+	else{
+		printf("%s\n", ptyName);
+		fflush(stdout);
+	}
+
+	while(!childExited){
+		uint32_t wait = loop();
+		if(Serial.available() == 0){
+			struct pollfd pfd = { serialFd, POLLIN, 0 };
+			poll(&pfd, 1, wait);
+		}
+	}
+	int status;
+	waitpid(child, &status, 0);
+	return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
@@ -0,0 +1,151 @@
+/*
+ * Copyright 2012 BrewPi/Elco Jacobs.
+ *
+ * This file is part of BrewPi.
+ *
+ * BrewPi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BrewPi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BrewPi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host tool to compare the slope estimate of the beer sensor with the method it replaced.
+ old: every 12 samples the change of the slow filter output goes into the slope filter (100 samples settling time),
+      the output is scaled by 300 to degrees per hour.
+ new: every SLOPE_ESTIMATOR_INTERVAL samples the fast filter output goes into SlopeEstimator, its least squares
+      slope is smoothed by the slope filter (25 samples settling time).
+ Both use the firmware's FixedFilter and SlopeEstimator with the default beer filter settings.
+
+ The input is 20 degrees for 5000 s, then a ramp of 1 deg/h, with gaussian noise and rounded to the 1/16 degree
+ steps of the DS18B20. For each noise level the tool prints:
+ - t90: seconds after the start of the ramp until the estimate first reaches 0.9 deg/h
+ - mean and standard deviation of the estimate on the ramp, after it has settled (from 8000 s into the ramp)
+
+ Build and run from this directory:
+	g++ -O2 -I../brewpi_avr -o slopeCompare slopeCompare.cpp ../brewpi_avr/FixedFilter.cpp ../brewpi_avr/SlopeEstimator.cpp
+	./slopeCompare					noise of 0, 0.02 and 0.05 degrees
+	./slopeCompare 0.1 0.2			other noise levels, standard deviation in degrees
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "FixedFilter.h"
+#include "SlopeEstimator.h"
+
+#define SIMULATION_LENGTH 30000 // seconds, one sample per second
+#define RAMP_START 5000
+#define SETTLED 8000 // seconds after the start of the ramp
+#define RAMP_SLOPE 1.0 // degrees per hour
+
+struct SlopeStatistics{
+	long t90;
+	double sum;
+	double sum2;
+	long count;
+
+	void init(void){
+		t90 = -1;
+		sum = 0;
+		sum2 = 0;
+		count = 0;
+	}
+	void add(long t, double slope){
+		if(t > RAMP_START && t90 < 0 && slope >= 0.9 * RAMP_SLOPE){
+			t90 = t - RAMP_START;
+		}
+		if(t > RAMP_START + SETTLED){
+			sum += slope;
+			sum2 += slope * slope;
+			count++;
+		}
+	}
+	double mean(void){
+		return sum / count;
+	}
+	double deviation(void){
+		return sqrt(sum2 / count - mean() * mean());
+	}
+};
+
+// normal distribution with the Box-Muller transform. Fixed seed, so results are repeatable
+static double gauss(void){
+	double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+	double v = (rand() + 1.0) / (RAND_MAX + 2.0);
+	return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+static void compare(double sigma){
+	FixedFilter slowFilter; // old method
+	FixedFilter oldSlopeFilter;
+	FixedFilter fastFilter; // new method
+	FixedFilter slopeFilter;
+	SlopeEstimator estimator;
+	slowFilter.setCoefficients(SETTLING_TIME_400_SAMPLES);
+	oldSlopeFilter.setCoefficients(SETTLING_TIME_100_SAMPLES);
+	fastFilter.setCoefficients(SETTLING_TIME_50_SAMPLES);
+	slopeFilter.setCoefficients(SETTLING_TIME_25_SAMPLES);
+
+	fixed7_9 start = 20 * 512;
+	slowFilter.init(start);
+	oldSlopeFilter.init(0);
+	fastFilter.init(start);
+	estimator.init(start);
+	slopeFilter.init(0);
+
+	SlopeStatistics oldStatistics, newStatistics;
+	oldStatistics.init();
+	newStatistics.init();
+	srand(1);
+	unsigned char oldCounter = 255; // the old method skipped the first 242 samples after startup
+	fixed7_25 previousOutput = 0;
+	unsigned char newCounter = SLOPE_ESTIMATOR_INTERVAL;
+	for(long t = 0; t < SIMULATION_LENGTH; t++){
+		double temperature = 20.0 + ((t > RAMP_START) ? (t - RAMP_START) * RAMP_SLOPE / 3600.0 : 0) + sigma * gauss();
+		fixed7_9 sample = ((int) floor(temperature * 16 + 0.5)) << 5; // 1/16 degree steps
+		slowFilter.add(sample);
+		fastFilter.add(sample);
+
+		if(--oldCounter == 13){
+			previousOutput = slowFilter.readOutputDoublePrecision();
+		}
+		if(oldCounter == 0){
+			oldSlopeFilter.addDoublePrecision(slowFilter.readOutputDoublePrecision() - previousOutput);
+			previousOutput = slowFilter.readOutputDoublePrecision();
+			oldCounter = 12;
+		}
+		oldStatistics.add(t, ((oldSlopeFilter.readOutputDoublePrecision() * 300) >> 16) / 512.0);
+
+		if(--newCounter == 0){
+			estimator.add(fastFilter.readOutput());
+			slopeFilter.addDoublePrecision(estimator.readSlopeDoublePrecision());
+			newCounter = SLOPE_ESTIMATOR_INTERVAL;
+		}
+		newStatistics.add(t, slopeFilter.readOutput() / 512.0);
+	}
+	printf("%5.2f   old  %5ld s  %6.3f  %7.4f\n", sigma, oldStatistics.t90, oldStatistics.mean(), oldStatistics.deviation());
+	printf("        new  %5ld s  %6.3f  %7.4f\n", newStatistics.t90, newStatistics.mean(), newStatistics.deviation());
+}
+
+int main(int argc, char * argv[]){
+	printf("noise        t90      mean     std   (slope in deg/h, ramp of %.1f deg/h)\n", RAMP_SLOPE);
+	if(argc > 1){
+		for(int i = 1; i < argc; i++){
+			compare(atof(argv[i]));
+		}
+	}
+	else{
+		compare(0);
+		compare(0.02);
+		compare(0.05);
+	}
+	return 0;
+}
@@ -0,0 +1,123 @@
+/*
+ * Copyright 2012 BrewPi/Elco Jacobs.
+ *
+ * This file is part of BrewPi.
+ *
+ * BrewPi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BrewPi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BrewPi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host test of the 64 bit time base in Ticks.cpp.
+ millis() is a stub, so the test can jump the clock to just before the 49.7 day overflow of millis()
+ and check that millis64() keeps counting up and that timeSince() is correct across the overflow.
+ It also checks the conversion to Unix time for timestamps long before and after the synchronization with the host.
+
+ Build and run from this directory:
+	g++ -O2 -IhostArduino -I../brewpi_avr -o ticksTest ticksTest.cpp ../brewpi_avr/Ticks.cpp
+	./ticksTest
+ It prints every check and exits with 1 if one of them fails.
+*/
+
+#include <stdio.h>
+#include "Ticks.h"
+
+static uint32_t fakeMillis;
+
+unsigned long millis(void){
+	return fakeMillis;
+}
+
+static int failures;
+
+static void check(const char * description, uint64_t value, uint64_t expected){
+	bool ok = (value == expected);
+	printf("%s %-72s %llu (expected %llu)\n", ok ? "PASS" : "FAIL", description,
+		(unsigned long long) value, (unsigned long long) expected);
+	if(!ok){
+		failures++;
+	}
+}
+
+// advance the clock in steps of at most stepSize, like loop() calling millis64() every second
+static void advance(uint64_t milliseconds, uint32_t stepSize){
+	while(milliseconds > 0){
+		uint32_t step = (milliseconds > stepSize) ? stepSize : (uint32_t) milliseconds;
+		fakeMillis += step; // wraps like the real millis()
+		ticks.millis64();
+		milliseconds -= step;
+	}
+}
+
+int main(void){
+	const uint64_t wrap = 1ULL << 32;
+
+	const uint64_t day = 24ULL * 3600 * 1000;
+	const uint32_t syncSeconds = 1356994800UL;
+	uint32_t seconds;
+	uint16_t milliseconds;
+
+	fakeMillis = 0;
+	check("millis64() at startup", ticks.millis64(), 0);
+	ticks.toEpoch(60 * day + 1234, &seconds, &milliseconds);
+	check("toEpoch() before the first synchronization is the uptime", seconds * 1000ULL + milliseconds, 60 * day + 1234);
+	// synchronized at startup: the synchronized second started before startup
+	ticks.setEpoch(syncSeconds, 700);
+	ticks.toEpoch(300, &seconds, &milliseconds);
+	check("toEpoch() when the synchronized second started before startup", seconds * 1000ULL + milliseconds, syncSeconds * 1000ULL + 1000);
+	check("timeSince(0) is the time since startup", (advance(1234, 1000), ticks.timeSince(0)), 1234);
+
+	// jump to 5 seconds before the overflow, the real clock gets there by calling millis64() every second
+	fakeMillis = 0xFFFFFFFFUL - 4999;
+	check("millis64() just before the overflow", ticks.millis64(), wrap - 5000);
+	uptime_t beforeWrap = ticks.millis64();
+
+	advance(8000, 1000);
+	check("millis64() after the overflow", ticks.millis64(), wrap + 3000);
+	check("timeSince() across the overflow", ticks.timeSince(beforeWrap), 8000);
+
+	// one big step over the overflow, like a loop that was blocked for almost 49.7 days
+	fakeMillis = 0xFFFFFFF0UL;
+	ticks.millis64();
+	advance(0x20, 0x20);
+	check("millis64() after a single step over the second overflow", ticks.millis64(), 2 * wrap + 0x10);
+
+	// a timestamp taken in the previous 'epoch' of millis()
+	uptime_t start = ticks.millis64();
+	advance(3 * wrap + 500, 1000000000UL);
+	check("millis64() after three more overflows", ticks.millis64(), 5 * wrap + 0x10 + 500);
+	check("timeSince() longer than 49.7 days saturates", ticks.timeSince(start), 0xFFFFFFFFUL);
+
+	uptime_t recent = ticks.millis64();
+	advance(wrap - 1, 1000000000UL);
+	check("timeSince() of exactly 2^32-1 ms", ticks.timeSince(recent), 0xFFFFFFFFUL);
+	check("timeSince() of a timestamp in the future is saturated, not negative", ticks.timeSince(ticks.millis64() + 1), 0xFFFFFFFFUL);
+
+	// Unix time in milliseconds, from toEpoch(), far from the synchronization
+	uptime_t syncUptime = ticks.millis64();
+	ticks.setEpoch(syncSeconds, 250);
+	const uint64_t syncUnix = syncSeconds * 1000ULL + 250;
+	ticks.toEpoch(syncUptime, &seconds, &milliseconds);
+	check("toEpoch() of the synchronization time", seconds * 1000ULL + milliseconds, syncUnix);
+	ticks.toEpoch(syncUptime + 30 * day + 800, &seconds, &milliseconds);
+	check("toEpoch() 30 days after the synchronization (over 2^31 ms)", seconds * 1000ULL + milliseconds, syncUnix + 30 * day + 800);
+	ticks.toEpoch(syncUptime + 400 * day + 5, &seconds, &milliseconds);
+	check("toEpoch() 400 days after the synchronization (over 2^32 ms)", seconds * 1000ULL + milliseconds, syncUnix + 400 * day + 5);
+	ticks.toEpoch(syncUptime - 30 * day - 300, &seconds, &milliseconds);
+	check("toEpoch() of an event 30 days before the synchronization", seconds * 1000ULL + milliseconds, syncUnix - 30 * day - 300);
+	ticks.toEpoch(syncUptime - 251, &seconds, &milliseconds);
+	check("toEpoch() just before the synchronized second rounds down", seconds * 1000ULL + milliseconds, syncUnix - 251);
+	check("milliseconds of a negative difference are positive", milliseconds, 999);
+
+	printf("%d check(s) failed\n", failures);
+	return failures ? 1 : 0;
+}